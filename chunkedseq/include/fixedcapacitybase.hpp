@@ -17,6 +17,9 @@
 #include <algorithm>
 
 #include "segment.hpp"
+#ifdef USE_PASL_ALLOC
+#include "alloc.hpp"
+#endif
 
 #ifndef _PASL_DATA_FIXEDCAPACITYBASE_H_
 #define _PASL_DATA_FIXEDCAPACITYBASE_H_
@@ -31,6 +34,25 @@ namespace base {
 /*---------------------------------------------------------------------*/
 /* Array allocation */
 
+/* with `USE_PASL_ALLOC`, the items of the chunks come from the heap of
+ * the calling worker in the worker-local allocator (see alloc.hpp)
+ */
+static inline void* heap_malloc(size_t szb) {
+#ifdef USE_PASL_ALLOC
+  return pasl::alloc::malloc(szb);
+#else
+  return malloc(szb);
+#endif
+}
+
+static inline void heap_free(void* p) {
+#ifdef USE_PASL_ALLOC
+  pasl::alloc::free(p);
+#else
+  free(p);
+#endif
+}
+
 template <class Item, int Capacity>
 class heap_allocator {
 private:
@@ -38,7 +60,7 @@ private:
   class Deleter {
   public:
     void operator()(Item* items) {
-      free(items);
+      heap_free(items);
     }
   };
   
@@ -56,7 +78,7 @@ public:
   static constexpr int capacity = Capacity;
   
   heap_allocator() {
-    Item* p = (value_type*)malloc(sizeof(value_type) * capacity);
+    Item* p = (value_type*)heap_malloc(sizeof(value_type) * capacity);
     assert(p != NULL);
     items.reset(p);
   }
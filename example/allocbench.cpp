@@ -0,0 +1,114 @@
+/*!
+ * \file allocbench.cpp
+ * \brief Throughput and footprint of the worker-local allocator.
+ * \example allocbench.cpp
+ * \date 2014
+ * \copyright COPYRIGHT (c) 2012 Umut Acar, Arthur Chargueraud, and
+ * Michael Rainey. All rights reserved.
+ * \license This project is released under the GNU Public License.
+ *
+ * Arguments:
+ * ==================================================================
+ *   - `-allocator <pasl|malloc>` (default=pasl)
+ *       allocator under test
+ *   - `-n <int>` (default=1000000)
+ *       number of blocks allocated in each round
+ *   - `-rounds <int>` (default=10)
+ *       number of rounds
+ *   - `-max_szb <int>` (default=256)
+ *       sizes of blocks are drawn in [8, max_szb]
+ *
+ * Implementation: each round allocates `-n` blocks in a parallel loop,
+ * writes in each of them, then frees them in a second parallel loop,
+ * which visits the blocks in the reverse order, so that many blocks
+ * get freed by a worker other than the one that allocated them.
+ *
+ * The benchmark reports the number of allocations and frees per
+ * second. When compiled with `USE_ALLOCATOR=malloc_count`, it also
+ * reports the total, peak and current amounts of memory obtained from
+ * `malloc`, which, with `-allocator pasl`, consist mostly of the slabs
+ * of the worker-local heaps.
+ *
+ */
+
+#include <vector>
+#include "benchmark.hpp"
+#include "alloc.hpp"
+#ifdef USE_MALLOC_COUNT
+#include "malloc_count.h"
+#endif
+
+/***********************************************************************/
+
+namespace par = pasl::sched::native;
+
+/*---------------------------------------------------------------------*/
+
+static inline size_t size_of_block(long i, long max_szb) {
+  uint64_t h = (uint64_t)i * 0x9E3779B97F4A7C15ull;
+  return 8 + (size_t)((h >> 32) % (uint64_t)(max_szb - 7));
+}
+
+/*---------------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+  long n = 0;
+  long nb_rounds = 0;
+  long max_szb = 0;
+  bool use_pasl = true;
+  std::vector<char*> blocks;
+  long checksum = 0;
+
+  auto init = [&] {
+    n = (long)pasl::util::cmdline::parse_or_default_int("n", 1000000);
+    nb_rounds = (long)pasl::util::cmdline::parse_or_default_int("rounds", 10);
+    max_szb = std::max(8l, (long)pasl::util::cmdline::parse_or_default_int("max_szb", 256));
+    std::string allocator = pasl::util::cmdline::parse_or_default_string("allocator", "pasl");
+    if (allocator.compare("pasl") == 0)
+      use_pasl = true;
+    else if (allocator.compare("malloc") == 0)
+      use_pasl = false;
+    else
+      pasl::util::atomic::die("bogus allocator %s\n", allocator.c_str());
+    blocks.resize(n);
+  };
+  auto run = [&] (bool sequential) {
+    uint64_t start = pasl::util::microtime::now();
+    for (long r = 0; r < nb_rounds; r++) {
+      par::parallel_for(0l, n, [&] (long i) {
+        size_t szb = size_of_block(i, max_szb);
+        char* p = (char*)(use_pasl ? pasl::alloc::malloc(szb) : malloc(szb));
+        p[0] = (char)i;
+        p[szb - 1] = (char)i;
+        blocks[i] = p;
+      });
+      par::parallel_for(0l, n, [&] (long j) {
+        long i = n - 1 - j;
+        char* p = blocks[i];
+        if (p[0] != (char)i)
+          pasl::util::atomic::die("corrupted block %ld\n", i);
+        if (use_pasl)
+          pasl::alloc::free(p);
+        else
+          free(p);
+      });
+    }
+    double elapsed = pasl::util::microtime::seconds_since(start);
+    printf("ops_per_sec\t%.0lf\n", (double)(2 * n * nb_rounds) / elapsed);
+    checksum = n * nb_rounds;
+  };
+  auto output = [&] {
+#ifdef USE_MALLOC_COUNT
+    malloc_pasl_report();
+#endif
+    pasl::alloc::report(stdout);
+    std::cout << "result " << checksum << std::endl;
+  };
+  auto destroy = [&] {
+    ;
+  };
+  pasl::sched::launch(argc, argv, init, run, output, destroy);
+  return 0;
+}
+
+/***********************************************************************/
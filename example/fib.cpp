@@ -1,6 +1,6 @@
 /*!
  * \file fib.cpp
- * \brief Exponential Fibonacci computation.
+ * \brief Exponential Fibonacci computation and mergesort.
  * \example fib.cpp
  * \date 2014
  * \copyright COPYRIGHT (c) 2012 Umut Acar, Arthur Chargueraud, and
@@ -13,14 +13,32 @@
  *       determines the value of fib(n) to compute
  *   - `-cutoff <int>` (default=20)
  *       sequentializes fib(m) as soon as m <= cutoff.
+ *   - `-algo <fib|mergesort>` (default=fib)
+ *       selects the benchmark.
+ *   - `-size <int>` (default=1000000)
+ *       number of items to sort for `-algo mergesort`.
+ *   - `-sort_cutoff <int>` (default=2048)
+ *       sorts sequentially subarrays of at most that many items.
+ *   - `-autotune <bool>` (default=0)
+ *       calibrates the cutoff of the selected benchmark before the
+ *       timed run, unless it is given on the command line (see
+ *       `autotune.hpp`); with `-write_csts 1`, the value found is
+ *       saved, and later runs with `-read_csts 1` use it.
  *
  * Implementation: compute in parallel the recursive calls,
  * using fork-join.
  *
+ * Both benchmarks spend most of their time in `fork2`, which makes
+ * them suitable for comparing the eager and the lazy implementations
+ * of `fork2` (e.g., `fib.opt` against `fib.lazy`).
+ *
  */
 
 #include <math.h>
+#include <algorithm>
+#include <vector>
 #include "benchmark.hpp"
+#include "autotune.hpp"
 
 /***********************************************************************/
 
@@ -50,9 +68,28 @@ static long par_fib(long n) {
 
 /*---------------------------------------------------------------------*/
 
+long sort_cutoff = 0;
+
+static void par_mergesort(long* xs, long* tmp, long n) {
+  if (n <= sort_cutoff) {
+    std::sort(xs, xs + n);
+    return;
+  }
+  long mid = n / 2;
+  par::fork2([xs, tmp, mid] { par_mergesort(xs, tmp, mid); },
+             [xs, tmp, mid, n] { par_mergesort(xs + mid, tmp + mid, n - mid); });
+  std::merge(xs, xs + mid, xs + mid, xs + n, tmp);
+  std::copy(tmp, tmp + n, xs);
+}
+
+/*---------------------------------------------------------------------*/
+
 int main(int argc, char** argv) {
   long result = 0;
   long n = 0;
+  std::string algo;
+  std::vector<long> xs;
+  std::vector<long> tmp;
 
   /* The call to `launch` creates an instance of the PASL runtime and
    * then runs a few given functions in order. Specifically, the call
@@ -69,14 +106,46 @@ int main(int argc, char** argv) {
    * call `run();`.
    */
 
+  auto fill = [&] {
+    long size = (long)xs.size();
+    for (long i = 0; i < size; i++)
+      xs[i] = (i * 1103515245l + 12345l) % size;
+  };
+  // the cutoffs are read by each run, so that they can be calibrated
+  auto run_once = [&] {
+    if (algo.compare("mergesort") == 0) {
+      sort_cutoff = std::max(1l, (long)pasl::sched::autotune::cutoff("sort_cutoff", 2048));
+      par_mergesort(xs.data(), tmp.data(), (long)xs.size());
+    } else {
+      cutoff = (long)pasl::sched::autotune::cutoff("cutoff", 25);
+      result = par_fib(n);
+    }
+  };
   auto init = [&] {
-    cutoff = (long)pasl::util::cmdline::parse_or_default_int("cutoff", 25);
     n = (long)pasl::util::cmdline::parse_or_default_int("n", 24);
+    algo = pasl::util::cmdline::parse_or_default_string("algo", "fib");
+    if (algo.compare("mergesort") == 0) {
+      long size = (long)pasl::util::cmdline::parse_or_default_int("size", 1000000);
+      xs.resize(size);
+      tmp.resize(size);
+    } else if (algo.compare("fib") != 0)
+      pasl::util::atomic::die("bogus algo %s\n", algo.c_str());
+    // the input of mergesort is built before each calibration run,
+    // which adds the same time to the runs of all the cutoffs
+    pasl::sched::autotune::calibrate([&] {
+      if (algo.compare("mergesort") == 0)
+        fill();
+      run_once();
+    });
+    if (algo.compare("mergesort") == 0)
+      fill();
   };
   auto run = [&] (bool sequential) {
-    result = par_fib(n);
+    run_once();
   };
   auto output = [&] {
+    if (algo.compare("mergesort") == 0)
+      result = std::is_sorted(xs.begin(), xs.end()) ? 1 : 0;
     std::cout << "result " << result << std::endl;
   };
   auto destroy = [&] {
@@ -0,0 +1,44 @@
+#!/bin/bash
+#
+# Compares the join counters of finish blocks, as selected by
+# -finish_instrategy, on two workloads of spawnloop:
+#   - rounds: many finish blocks of few threads, which measures the
+#     latency of the detection of the end of a block;
+#   - wide: one finish block of many threads, which measures the
+#     contention on the counter.
+#
+# usage: finishbench.sh [procs] [runs]
+#   procs   list of numbers of workers (default: 1,2,4,8)
+#   runs    number of timed runs per number of workers (default: 5)
+#
+# The binary is ./spawnloop.opt, or the one given by PROG. One CSV
+# file per workload and counter goes to the directory given by OUT
+# (default: finishbench); the files are also printed. ROUNDS and N
+# (default: 10000 and 1000000) set the sizes of the two workloads.
+
+PROCS=${1:-1,2,4,8}
+RUNS=${2:-5}
+PROG=${PROG:-./spawnloop.opt}
+OUT=${OUT:-finishbench}
+ROUNDS=${ROUNDS:-10000}
+N=${N:-1000000}
+
+if [[ ! -x $PROG ]]
+then
+    make spawnloop.opt || exit 1
+fi
+mkdir -p $OUT || exit 1
+
+for workload in "rounds:-n 100 -work 200 -rounds $ROUNDS" \
+                "wide:-n $N -work 200"
+do
+    name=${workload%%:*}
+    args=${workload#*:}
+    for counter in distributed fetch_add snzi
+    do
+        csv=$OUT/$name-$counter.csv
+        $PROG $args -procs $PROCS -runs $RUNS -finish_instrategy $counter -csv $csv > /dev/null || exit 1
+        echo "== $name $counter"
+        cat $csv
+    done
+done
@@ -0,0 +1,92 @@
+/*!
+ * \file inject.cpp
+ * \brief Throughput of tasks submitted from outside the worker group.
+ * \example inject.cpp
+ * \date 2014
+ * \copyright COPYRIGHT (c) 2012 Umut Acar, Arthur Chargueraud, and
+ * Michael Rainey. All rights reserved.
+ * \license This project is released under the GNU Public License.
+ *
+ * Arguments:
+ * ==================================================================
+ *   - `-producers <int>` (default=2)
+ *       number of external threads submitting tasks
+ *   - `-tasks <int>` (default=100000)
+ *       number of tasks submitted by each producer
+ *   - `-work <int>` (default=200)
+ *       number of iterations of the busy loop run by each task
+ *
+ * Implementation: the benchmark does not use `launch`. It initializes
+ * the worker group, then starts `-producers` plain `std::thread`s, each
+ * of which submits its tasks one after the other with
+ * `native::submit`, and waits on the futures of its tasks. The main
+ * thread waits, outside of any launch, for the producers, and reports
+ * the number of tasks completed per second.
+ *
+ * Because worker 0 is the main thread, which only runs the scheduler
+ * during a launch, tasks are served by workers 1 to `-proc`-1: the
+ * benchmark requires `-proc 2` or more.
+ *
+ */
+
+#include <thread>
+#include <vector>
+#include <future>
+#include <atomic>
+#include "benchmark.hpp"
+
+/***********************************************************************/
+
+namespace par = pasl::sched::native;
+
+long work = 0;
+
+/*---------------------------------------------------------------------*/
+
+static long busy(long i) {
+  long x = i;
+  for (long k = 0; k < work; k++)
+    x = (x * 1103515245l + 12345l) & 0xffffffl;
+  return x;
+}
+
+/*---------------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+  pasl::util::cmdline::set(argc, argv);
+  int proc = pasl::util::cmdline::parse_or_default_int("proc", 1, false);
+  long nb_producers = (long)pasl::util::cmdline::parse_or_default_int("producers", 2);
+  long nb_tasks = (long)pasl::util::cmdline::parse_or_default_int("tasks", 100000);
+  work = (long)pasl::util::cmdline::parse_or_default_int("work", 200);
+  if (proc < 2)
+    pasl::util::atomic::die("inject requires -proc 2 or more\n");
+  pasl::sched::threaddag::init();
+  std::atomic<long> sum(0);
+  auto producer = [&] (long p) {
+    std::vector<std::future<long>> futures;
+    futures.reserve(nb_tasks);
+    for (long i = 0; i < nb_tasks; i++) {
+      long k = p * nb_tasks + i;
+      futures.push_back(par::submit([k] { return busy(k); }));
+    }
+    long s = 0;
+    for (auto& f : futures)
+      s += f.get();
+    sum += s;
+  };
+  auto start = pasl::util::microtime::now();
+  std::vector<std::thread> producers;
+  for (long p = 0; p < nb_producers; p++)
+    producers.push_back(std::thread(producer, p));
+  for (auto& t : producers)
+    t.join();
+  double exectime = pasl::util::microtime::seconds_since(start);
+  long nb_total = nb_producers * nb_tasks;
+  printf("exectime %.3lf\n", exectime);
+  printf("tasks_per_sec %.0lf\n", (double)nb_total / exectime);
+  std::cout << "result " << sum.load() << std::endl;
+  pasl::sched::threaddag::destroy();
+  return 0;
+}
+
+/***********************************************************************/
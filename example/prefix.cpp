@@ -0,0 +1,171 @@
+/*!
+ * \file prefix.cpp
+ * \brief Parallel prefix sums, pipelined by futures or split by fork2.
+ * \example prefix.cpp
+ * \date 2014
+ * \copyright COPYRIGHT (c) 2012 Umut Acar, Arthur Chargueraud, and
+ * Michael Rainey. All rights reserved.
+ * \license This project is released under the GNU Public License.
+ *
+ * Arguments:
+ * ==================================================================
+ *   - `-algo <future|fork2>` (default=future)
+ *       parallel construct used to compute the prefix sums
+ *   - `-n <int>` (default=10000000)
+ *       number of items
+ *   - `-block <int>` (default=100000)
+ *       number of items per block
+ *
+ * Implementation: the input is cut into blocks. For each block `i`,
+ * both algorithms scan the block in place, compute the offset of the
+ * block from the sums of the blocks before it, and add the offset to
+ * the items of the block.
+ *
+ * - With `-algo future`, three futures are spawned per block, all
+ *   upfront: the scan of the block, the offset of the block, which
+ *   waits for the offset of block `i-1` and the scan of block `i-1`,
+ *   and the fix-up of the block, which waits for the scan and the
+ *   offset of the block. The chain of offsets proceeds as soon as the
+ *   scans complete, and the fix-ups follow the chain, without any
+ *   global synchronization.
+ * - With `-algo fork2`, a parallel loop over the blocks (written with
+ *   `fork2`) scans the blocks, then the offsets are computed
+ *   sequentially, then a second parallel loop fixes up the blocks.
+ *
+ */
+
+#include <vector>
+#include "benchmark.hpp"
+
+/***********************************************************************/
+
+namespace par = pasl::sched::native;
+
+typedef long value_type;
+
+/*---------------------------------------------------------------------*/
+
+// scans items [lo, hi) in place; returns the sum of the items
+static value_type scan_block(value_type* items, long lo, long hi) {
+  value_type s = 0;
+  for (long i = lo; i < hi; i++) {
+    s += items[i];
+    items[i] = s;
+  }
+  return s;
+}
+
+static void add_to_block(value_type* items, long lo, long hi, value_type d) {
+  for (long i = lo; i < hi; i++)
+    items[i] += d;
+}
+
+/*---------------------------------------------------------------------*/
+
+static void prefix_future(value_type* items, long n, long block) {
+  long nb_blocks = (n + block - 1) / block;
+  std::vector<par::future<value_type>> sums(nb_blocks);
+  std::vector<par::future<value_type>> offsets(nb_blocks);
+  std::vector<par::future<int>> fixups(nb_blocks);
+  for (long b = 0; b < nb_blocks; b++) {
+    long lo = b * block;
+    long hi = std::min(n, lo + block);
+    sums[b] = par::spawn_future([=] {
+      return scan_block(items, lo, hi);
+    });
+    if (b == 0) {
+      offsets[b] = par::spawn_future([] { return (value_type)0; });
+    } else {
+      par::future<value_type>* prev_offset = &offsets[b - 1];
+      par::future<value_type>* prev_sum = &sums[b - 1];
+      offsets[b] = par::spawn_future([=] {
+        return prev_offset->get() + prev_sum->get();
+      });
+    }
+    par::future<value_type>* sum = &sums[b];
+    par::future<value_type>* offset = &offsets[b];
+    fixups[b] = par::spawn_future([=] {
+      sum->get();
+      add_to_block(items, lo, hi, offset->get());
+      return 0;
+    });
+  }
+  for (long b = 0; b < nb_blocks; b++)
+    fixups[b].get();
+}
+
+/*---------------------------------------------------------------------*/
+
+template <class Body>
+static void parallel_blocks(long lo, long hi, const Body& body) {
+  if (hi - lo == 1) {
+    body(lo);
+    return;
+  }
+  long mid = (lo + hi) / 2;
+  par::fork2([&] { parallel_blocks(lo, mid, body); },
+             [&] { parallel_blocks(mid, hi, body); });
+}
+
+static void prefix_fork2(value_type* items, long n, long block) {
+  long nb_blocks = (n + block - 1) / block;
+  std::vector<value_type> sums(nb_blocks);
+  parallel_blocks(0, nb_blocks, [&] (long b) {
+    long lo = b * block;
+    sums[b] = scan_block(items, lo, std::min(n, lo + block));
+  });
+  value_type offset = 0;
+  for (long b = 0; b < nb_blocks; b++) {
+    value_type s = sums[b];
+    sums[b] = offset;
+    offset += s;
+  }
+  parallel_blocks(0, nb_blocks, [&] (long b) {
+    long lo = b * block;
+    add_to_block(items, lo, std::min(n, lo + block), sums[b]);
+  });
+}
+
+/*---------------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+  long n = 0;
+  long block = 0;
+  std::string algo;
+  std::vector<value_type> items;
+
+  auto init = [&] {
+    n = (long)pasl::util::cmdline::parse_or_default_int("n", 10000000);
+    block = std::max(1l, (long)pasl::util::cmdline::parse_or_default_int("block", 100000));
+    algo = pasl::util::cmdline::parse_or_default_string("algo", "future");
+    if (algo.compare("future") != 0 && algo.compare("fork2") != 0)
+      pasl::util::atomic::die("bogus algo %s\n", algo.c_str());
+    items.resize(n);
+    for (long i = 0; i < n; i++)
+      items[i] = i % 7;
+  };
+  auto run = [&] (bool sequential) {
+    if (n == 0)
+      return;
+    if (algo.compare("future") == 0)
+      prefix_future(items.data(), n, block);
+    else
+      prefix_fork2(items.data(), n, block);
+  };
+  auto output = [&] {
+    value_type expected = 0;
+    for (long i = 0; i < n; i++)
+      expected += i % 7;
+    value_type last = (n == 0) ? 0 : items[n - 1];
+    std::cout << "result " << last << std::endl;
+    if (last != expected)
+      pasl::util::atomic::die("wrong result: expected %ld\n", (long)expected);
+  };
+  auto destroy = [&] {
+    ;
+  };
+  pasl::sched::launch(argc, argv, init, run, output, destroy);
+  return 0;
+}
+
+/***********************************************************************/
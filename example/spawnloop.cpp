@@ -0,0 +1,89 @@
+/*!
+ * \file spawnloop.cpp
+ * \brief Flat loop of fine-grained threads.
+ * \example spawnloop.cpp
+ * \date 2014
+ * \copyright COPYRIGHT (c) 2012 Umut Acar, Arthur Chargueraud, and
+ * Michael Rainey. All rights reserved.
+ * \license This project is released under the GNU Public License.
+ *
+ * Arguments:
+ * ==================================================================
+ *   - `-n <int>` (default=100000)
+ *       number of threads created by the loop
+ *   - `-work <int>` (default=2000)
+ *       number of iterations of the busy loop run by each thread
+ *   - `-rounds <int>` (default=1)
+ *       number of times the loop is run, each time in its own `finish`
+ *       block
+ *
+ * Implementation: a single thread creates all the threads, one after
+ * the other, by calls to `async` inside a `finish` block. The deque
+ * of the worker that runs the loop thus fills up with many small
+ * threads, which idle workers steal from its front. This benchmark
+ * is intended to compare stealing one thread at a time with
+ * `-steal_half 1`, which lets a thief take up to half of the deque of
+ * its victim; build in `sta` mode and pass `-stats_light 0` to get
+ * the number of steals (`thread_send`), the number of threads moved
+ * by batched steals (`thread_batched`) and the utilization.
+ *
+ * With many rounds of few threads, the benchmark also measures the
+ * latency of the detection of the end of `finish` blocks, which
+ * depends on `-finish_instrategy distributed|fetch_add|snzi`.
+ *
+ */
+
+#include <vector>
+#include "benchmark.hpp"
+
+/***********************************************************************/
+
+namespace par = pasl::sched::native;
+
+long work = 0;
+
+/*---------------------------------------------------------------------*/
+
+static long busy(long i) {
+  long x = i;
+  for (long k = 0; k < work; k++)
+    x = (x * 1103515245l + 12345l) & 0xffffffl;
+  return x;
+}
+
+/*---------------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+  long n = 0;
+  long rounds = 0;
+  std::vector<long> results;
+
+  auto init = [&] {
+    n = (long)pasl::util::cmdline::parse_or_default_int("n", 100000);
+    work = (long)pasl::util::cmdline::parse_or_default_int("work", 2000);
+    rounds = (long)pasl::util::cmdline::parse_or_default_int("rounds", 1);
+    results.resize(n);
+  };
+  auto run = [&] (bool sequential) {
+    long* rs = results.data();
+    for (long r = 0; r < rounds; r++) {
+      par::finish([&] (par::multishot* join) {
+        for (long i = 0; i < n; i++)
+          par::async([rs, i] { rs[i] = busy(i); }, join);
+      });
+    }
+  };
+  auto output = [&] {
+    long sum = 0;
+    for (long i = 0; i < n; i++)
+      sum += results[i];
+    std::cout << "result " << sum << std::endl;
+  };
+  auto destroy = [&] {
+    ;
+  };
+  pasl::sched::launch(argc, argv, init, run, output, destroy);
+  return 0;
+}
+
+/***********************************************************************/
@@ -12,6 +12,7 @@
 #include "bfs.hpp"
 #include "dfs.hpp"
 #include "benchmark.hpp"
+#include "autotune.hpp"
 #include "container.hpp"
 #include "ls_bag.hpp"
 #include "frontierseg.hpp"
@@ -88,6 +89,10 @@ void search_benchmark_select_input_graph(const Search& search,
     tmg.add("by_generator",       [&] { generate_graph(graph); });
     util::cmdline::dispatch_by_argmap(tmg, "load");
     mlockall(0);
+    sched::autotune::calibrate([&] {
+      search(graph, source);
+      destroy();
+    });
   };
   auto run = [&] (bool sequential) {
     search(graph, source);
@@ -177,6 +182,8 @@ void search_benchmark_sequential_select_algo() {
       data::myfree(dists);
     else if (visited != NULL)
       data::myfree(visited);
+    dists = NULL;
+    visited = NULL;
   };
   search_benchmark_select_input_graph<Adjlist>(search, report, destroy);
 }
@@ -218,6 +225,8 @@ void search_benchmark_frontier_sequential_select_algo() {
       data::myfree(dists);
     else if (visited != nullptr)
       data::myfree(visited);
+    dists = nullptr;
+    visited = nullptr;
   };
   search_benchmark_select_input_graph<Adjlist>(search, report, destroy);
 }
@@ -239,17 +248,17 @@ void search_benchmark_parallel_select_algo() {
   m.add("pbbs_pbfs",   [&] (const adjlist_type& graph, vtxid_type source) {
     dists = pbbs_pbfs<idempotent, adjlist_type>(graph, source); });
   m.add("our_pbfs",    [&] (const adjlist_type& graph, vtxid_type source) {
-    our_bfs_cutoff = util::cmdline::parse_or_default_int("our_pbfs_cutoff", 1024);
+    our_bfs_cutoff = sched::autotune::cutoff("our_pbfs_cutoff", 1024);
     dists = our_bfs<idempotent>::template main<adjlist_type, frontiersegbag<adjlist_alias_type>>(graph, source); });
   m.add("our_pbfs_with_swap",    [&] (const adjlist_type& graph, vtxid_type source) {
-    our_bfs_cutoff = util::cmdline::parse_or_default_int("our_pbfs_cutoff", 1024);
+    our_bfs_cutoff = sched::autotune::cutoff("our_pbfs_cutoff", 1024);
     dists = our_bfs<idempotent>::template main_with_swap<adjlist_type, frontiersegbag<adjlist_alias_type>>(graph, source); });
   m.add("our_lazy_pbfs",    [&] (const adjlist_type& graph, vtxid_type source) {
-    our_lazy_bfs_cutoff = util::cmdline::parse_or_default_int("our_lazy_pbfs_cutoff", 1024);
+    our_lazy_bfs_cutoff = sched::autotune::cutoff("our_lazy_pbfs_cutoff", 1024);
     dists = our_lazy_bfs<idempotent>::template main<adjlist_type, frontiersegbag<adjlist_alias_type>>(graph, source); });
 #endif
   m.add("our_pseudodfs",   [&] (const adjlist_type& graph, vtxid_type source) {
-    our_pseudodfs_cutoff = util::cmdline::parse_or_default_int("our_pseudodfs_cutoff", 1024);
+    our_pseudodfs_cutoff = sched::autotune::cutoff("our_pseudodfs_cutoff", 1024);
     visited = our_pseudodfs<adjlist_type, frontiersegbag<adjlist_alias_type>, idempotent>(graph, source); });
   m.add("cong_pseudodfs",   [&] (const adjlist_type& graph, vtxid_type source) {
     visited = cong_pseudodfs<adjlist_seq_type, idempotent>(graph, source); });
@@ -266,6 +275,8 @@ void search_benchmark_parallel_select_algo() {
       data::myfree(dists);
     else if (visited != nullptr)
       data::myfree(visited);
+    dists = nullptr;
+    visited = nullptr;
   };
   search_benchmark_select_input_graph<Adjlist>(search, report, destroy);
 }
@@ -285,8 +296,8 @@ void search_benchmark_frontier_parallel_select_algo() {
   util::cmdline::argmap<search_type> m;
 #ifndef SKIP_FAST
   m.add("ls_pbfs",   [&] (const adjlist_type& graph, vtxid_type source) {
-    ls_pbfs_cutoff = util::cmdline::parse_or_default_int("ls_pbfs_cutoff", 1024);
-    ls_pbfs_loop_cutoff = util::cmdline::parse_or_default_int("ls_pbfs_loop_cutoff", 1024);
+    ls_pbfs_cutoff = sched::autotune::cutoff("ls_pbfs_cutoff", 1024);
+    ls_pbfs_loop_cutoff = sched::autotune::cutoff("ls_pbfs_loop_cutoff", 1024);
     dists = ls_pbfs<idempotent>::template main<adjlist_seq_type, Frontier>(graph, source); });
 #endif
 
@@ -302,6 +313,8 @@ void search_benchmark_frontier_parallel_select_algo() {
       data::myfree(dists);
     else if (visited != nullptr)
       data::myfree(visited);
+    dists = nullptr;
+    visited = nullptr;
   };
   search_benchmark_select_input_graph<Adjlist>(search, report, destroy);
 }
@@ -145,6 +145,45 @@ benchmark_type map_incr_bench(bool student_soln = false) {
   return make_benchmark(init, bench, output, destroy);
 }
 
+benchmark_type tabulate_bench() {
+  long n = pasl::util::cmdline::parse_or_default_long("n", 1l<<20);
+  sparray* outp = new sparray(0);
+  auto init = [=] {
+
+  };
+  auto bench = [=] {
+    *outp = tabulate([&] (long i) { return (value_type)i; }, n);
+  };
+  auto output = [=] {
+    std::cout << "result " << (*outp)[outp->size()-1] << std::endl;
+  };
+  auto destroy = [=] {
+    delete outp;
+  };
+  return make_benchmark(init, bench, output, destroy);
+}
+
+// packs the even items, by the loop of `pack_by_predicate`
+benchmark_type pack_bench() {
+  long n = pasl::util::cmdline::parse_or_default_long("n", 1l<<20);
+  sparray* inp = new sparray(0);
+  sparray* outp = new sparray(0);
+  auto init = [=] {
+    *inp = gen_random_sparray(n);
+  };
+  auto bench = [=] {
+    *outp = pack_by_predicate(is_even_fct, *inp);
+  };
+  auto output = [=] {
+    std::cout << "result " << outp->size() << std::endl;
+  };
+  auto destroy = [=] {
+    delete inp;
+    delete outp;
+  };
+  return make_benchmark(init, bench, output, destroy);
+}
+
 benchmark_type duplicate_bench(bool ex = false) {
   long n = pasl::util::cmdline::parse_or_default_long("n", 1l<<20);
   sparray* inp = new sparray(0);
@@ -404,7 +443,9 @@ int main(int argc, char** argv) {
     pasl::util::cmdline::argmap<std::function<benchmark_type()>> m;
     m.add("fib",                  [&] { return fib_bench(); });
     m.add("mfib",                 [&] { return mfib_bench(); });
+    m.add("tabulate",             [&] { return tabulate_bench(); });
     m.add("map_incr",             [&] { return map_incr_bench(); });
+    m.add("pack",                 [&] { return pack_bench(); });
     m.add("reduce",               [&] { return reduce_bench(); });
     m.add("scan",                 [&] { return scan_bench(); });
     m.add("mcss",                 [&] { return mcss_bench(); });
@@ -427,7 +427,9 @@ value_type *binsplit(value_type val, value_type *low, value_type *high)
     return low;
 }
 
-controller_type cilkmerge_contr("cilkmerge");
+// the cost of a merge is predicted from the sizes of the two ranges,
+// plus a fixed cost per call
+multi_controller_type cilkmerge_contr("cilkmerge");
 
 void cilkmerge(value_type *low1, value_type *high1, value_type *low2,
                value_type *high2, value_type *lowdest)
@@ -457,7 +459,10 @@ void cilkmerge(value_type *low1, value_type *high1, value_type *low2,
     seqmerge(low1, high1, low2, high2, lowdest);
   };
 
-  par::cstmt(cilkmerge_contr, [=] { return std::max(0l,(high1-low1)+(high2-low2)); }, [&] {
+  auto features = [=] {
+    return par::features_type(std::max(0l, high1-low1), std::max(0l, high2-low2), 1);
+  };
+  par::cstmt(cilkmerge_contr, features, [&] {
       
   if (high2 - low2 > high1 - low1) {
     swap_indices(low1, low2);
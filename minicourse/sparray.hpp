@@ -35,12 +35,19 @@ namespace par = pasl::sched::granularity;
 
 #if defined(CONTROL_BY_FORCE_SEQUENTIAL)
 using controller_type = par::control_by_force_sequential;
+using multi_controller_type = par::control_by_force_sequential;
 #elif defined(CONTROL_BY_FORCE_PARALLEL)
 using controller_type = par::control_by_force_parallel;
+using multi_controller_type = par::control_by_force_parallel;
 #else
 using controller_type = par::control_by_prediction;
+using multi_controller_type = par::control_by_prediction_multi;
 #endif
+#ifdef LOOP_BY_LAZY_BINARY_SPLITTING
+using loop_controller_type = par::loop_by_lazy_binary_splitting<controller_type>;
+#else
 using loop_controller_type = par::loop_by_eager_binary_splitting<controller_type>;
+#endif
 
 #ifdef VALUE_32_BITS
 using value_type = int;
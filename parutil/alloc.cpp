@@ -0,0 +1,349 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file alloc.cpp
+ *
+ */
+
+#include <atomic>
+#include <vector>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "alloc.hpp"
+#include "perworker.hpp"
+#include "cmdline.hpp"
+
+namespace pasl {
+namespace alloc {
+
+/***********************************************************************/
+
+// prefix of each block; 16 bytes, so that the block stays 16-byte aligned
+typedef struct header_s {
+  struct header_s* next;  // link in a freelist or a batch, unused while live
+  int32_t owner;          // worker id, or worker::undef for global blocks
+  int32_t cls;            // size class
+} header_t;
+
+typedef header_t* header_p;
+
+static constexpr size_t small_class_szb = 16;
+static constexpr int nb_small_classes = 64;             // up to 1KB
+static constexpr int nb_large_classes = 6;              // 2KB to 64KB
+static constexpr int nb_classes = nb_small_classes + nb_large_classes;
+static constexpr size_t max_small_szb = small_class_szb * nb_small_classes;
+static constexpr size_t max_szb = max_small_szb << nb_large_classes;
+static constexpr size_t min_slab_szb = 1 << 16;
+static constexpr int slab_nb_blocks = 16;
+
+static inline int class_of_size(size_t szb) {
+  szb += sizeof(header_t);
+  if (szb <= max_small_szb)
+    return (int)((szb + small_class_szb - 1) / small_class_szb) - 1;
+  int cls = nb_small_classes;
+  size_t c = max_small_szb * 2;
+  while (c < szb) {
+    c *= 2;
+    cls++;
+  }
+  return cls;
+}
+
+static inline size_t size_of_class(int cls) {
+  if (cls < nb_small_classes)
+    return small_class_szb * (cls + 1);
+  return max_small_szb << (cls - nb_small_classes + 1);
+}
+
+/*---------------------------------------------------------------------*/
+
+// blocks freed by one worker on behalf of another
+class batch_t {
+public:
+  header_p head;
+  header_p tail;
+  int nb;
+  batch_t() : head(nullptr), tail(nullptr), nb(0) { }
+};
+
+class heap_t {
+public:
+
+  // batches of blocks returned by other workers; written concurrently
+  std::atomic<header_p> remote;
+  char padding[64];
+  // blocks owned and released by the owner
+  header_p freelists[nb_classes];
+  char* bump_ptr;
+  char* bump_end;
+  // slabs obtained from `malloc`, linked through their first header
+  header_p slabs;
+  // pending batches of this worker, indexed by owner; sized by `init`,
+  // so that `free` never allocates
+  std::vector<batch_t> pending;
+
+  long nb_malloc;
+  long nb_local_free;
+  long nb_remote_free;
+  long nb_batches;
+  long slab_szb;
+
+  heap_t() : remote(nullptr), bump_ptr(nullptr), bump_end(nullptr),
+             slabs(nullptr), nb_malloc(0), nb_local_free(0), nb_remote_free(0),
+             nb_batches(0), slab_szb(0) {
+    for (int i = 0; i < nb_classes; i++)
+      freelists[i] = nullptr;
+  }
+
+  void drain_remote() {
+    header_p h = remote.exchange(nullptr);
+    while (h != nullptr) {
+      header_p next = h->next;
+      h->next = freelists[h->cls];
+      freelists[h->cls] = h;
+      h = next;
+    }
+  }
+
+  // moves the remainder of the current slab to the freelists, as
+  // blocks of the largest classes that fit
+  void release_remainder() {
+    while (bump_ptr + small_class_szb <= bump_end) {
+      size_t rest = bump_end - bump_ptr;
+      int cls = nb_classes - 1;
+      while (size_of_class(cls) > rest)
+        cls--;
+      header_p h = (header_p)bump_ptr;
+      h->cls = cls;
+      h->next = freelists[cls];
+      freelists[cls] = h;
+      bump_ptr += size_of_class(cls);
+    }
+  }
+
+  header_p bump(int cls) {
+    size_t szb = size_of_class(cls);
+    if (bump_ptr + szb > bump_end) {
+      release_remainder();
+      size_t s = std::max(min_slab_szb, szb * slab_nb_blocks + sizeof(header_t));
+      header_p slab = (header_p)::malloc(s);
+      if (slab == nullptr)
+        throw std::bad_alloc();
+      slab->next = slabs;
+      slabs = slab;
+      bump_ptr = (char*)(slab + 1);
+      bump_end = (char*)slab + s;
+      slab_szb += (long)s;
+    }
+    header_p h = (header_p)bump_ptr;
+    bump_ptr += szb;
+    return h;
+  }
+
+  header_p alloc(int cls) {
+    nb_malloc++;
+    header_p h = freelists[cls];
+    if (h == nullptr) {
+      drain_remote();
+      h = freelists[cls];
+    }
+    if (h == nullptr)
+      return bump(cls);
+    freelists[cls] = h->next;
+    return h;
+  }
+
+  void local_free(header_p h) {
+    nb_local_free++;
+    h->next = freelists[h->cls];
+    freelists[h->cls] = h;
+  }
+
+  void push_remote(header_p head, header_p tail) {
+    header_p old = remote.load();
+    do {
+      tail->next = old;
+    } while (! remote.compare_exchange_weak(old, head));
+  }
+
+  // moves the slabs and the free blocks of this heap into `dst`, and
+  // sends the pending batches to their owners, or to `dst` if they left
+  void move_into(heap_t& dst, int nb_owners);
+
+  void destroy() {
+    while (slabs != nullptr) {
+      header_p next = slabs->next;
+      ::free(slabs);
+      slabs = next;
+    }
+    remote.store(nullptr);
+    for (int i = 0; i < nb_classes; i++)
+      freelists[i] = nullptr;
+    bump_ptr = nullptr;
+    bump_end = nullptr;
+    pending.clear();
+    slab_szb = 0;
+  }
+
+};
+
+static int batch_size = 32;
+static data::perworker::array<heap_t> heaps;
+
+void heap_t::move_into(heap_t& dst, int nb_owners) {
+  for (size_t owner = 0; owner < pending.size(); owner++) {
+    batch_t& b = pending[owner];
+    if (b.head == nullptr)
+      continue;
+    heap_t& h = ((int)owner < nb_owners) ? heaps[(worker_id_t)owner] : dst;
+    h.push_remote(b.head, b.tail);
+    b = batch_t();
+  }
+  drain_remote();
+  release_remainder();
+  bump_ptr = nullptr;
+  bump_end = nullptr;
+  for (int i = 0; i < nb_classes; i++) {
+    while (freelists[i] != nullptr) {
+      header_p h = freelists[i];
+      freelists[i] = h->next;
+      h->next = dst.freelists[i];
+      dst.freelists[i] = h;
+    }
+  }
+  while (slabs != nullptr) {
+    header_p slab = slabs;
+    slabs = slab->next;
+    slab->next = dst.slabs;
+    dst.slabs = slab;
+  }
+  dst.slab_szb += slab_szb;
+  slab_szb = 0;
+}
+
+/*---------------------------------------------------------------------*/
+
+void init() {
+  batch_size = std::max(1, util::cmdline::parse_or_default_int("alloc_batch", 32, false));
+  int nb_workers = util::worker::get_nb();
+  heaps.for_each([&] (worker_id_t, heap_t& heap) {
+    heap.pending.assign(nb_workers, batch_t());
+  });
+}
+
+void shrink(int nb_workers) {
+  nb_workers = std::max(1, nb_workers);
+  for (worker_id_t id = nb_workers; id < util::worker::get_nb(); id++)
+    heaps[id].move_into(heaps[0], nb_workers);
+}
+
+void destroy() {
+  heaps.for_each([] (worker_id_t, heap_t& heap) {
+    heap.destroy();
+  });
+}
+
+void* global_malloc(size_t szb) {
+  header_p h = (header_p)::malloc(szb + sizeof(header_t));
+  if (h == nullptr)
+    throw std::bad_alloc();
+  h->owner = (int32_t)util::worker::undef;
+  return h + 1;
+}
+
+void* malloc(size_t szb) {
+  worker_id_t my_id = util::worker::get_my_id();
+  if (my_id < 0 || szb > max_szb - sizeof(header_t))
+    return global_malloc(szb);
+  int cls = class_of_size(szb);
+  header_p h = heaps[my_id].alloc(cls);
+  h->owner = (int32_t)my_id;
+  h->cls = cls;
+  return h + 1;
+}
+
+static void remote_free(worker_id_t my_id, worker_id_t owner, header_p h) {
+  if (my_id < 0) {
+    // not a worker: nowhere to keep a batch
+    heaps[owner].push_remote(h, h);
+    return;
+  }
+  heap_t& heap = heaps[my_id];
+  heap.nb_remote_free++;
+  assert(owner < (worker_id_t)heap.pending.size());
+  batch_t& b = heap.pending[owner];
+  h->next = b.head;
+  if (b.head == nullptr)
+    b.tail = h;
+  b.head = h;
+  if (++b.nb < batch_size)
+    return;
+  heap.nb_batches++;
+  heaps[owner].push_remote(b.head, b.tail);
+  b = batch_t();
+}
+
+void free(void* p) {
+  if (p == nullptr)
+    return;
+  header_p h = (header_p)p - 1;
+  worker_id_t owner = (worker_id_t)h->owner;
+  if (owner == util::worker::undef) {
+    ::free(h);
+    return;
+  }
+  worker_id_t my_id = util::worker::get_my_id();
+  if (owner == my_id) {
+    heaps[owner].local_free(h);
+    return;
+  }
+  // the owner left the group, which was resized down: the block is
+  // adopted by the caller, or by worker 0
+  if (owner >= util::worker::get_nb())
+    owner = (my_id < 0) ? 0 : my_id;
+  if (owner == my_id)
+    heaps[owner].local_free(h);
+  else
+    remote_free(my_id, owner, h);
+}
+
+void flush() {
+  worker_id_t my_id = util::worker::get_my_id();
+  if (my_id < 0)
+    return;
+  heap_t& heap = heaps[my_id];
+  for (size_t owner = 0; owner < heap.pending.size(); owner++) {
+    batch_t& b = heap.pending[owner];
+    if (b.head == nullptr)
+      continue;
+    heap.nb_batches++;
+    // the batches of workers which left the group are adopted
+    worker_id_t dst = ((int)owner < util::worker::get_nb()) ? (worker_id_t)owner : my_id;
+    heaps[dst].push_remote(b.head, b.tail);
+    b = batch_t();
+  }
+}
+
+void report(FILE* f) {
+  long nb_malloc = 0, nb_local_free = 0, nb_remote_free = 0;
+  long nb_batches = 0, slab_szb = 0;
+  heaps.for_each([&] (worker_id_t, heap_t& heap) {
+    nb_malloc += heap.nb_malloc;
+    nb_local_free += heap.nb_local_free;
+    nb_remote_free += heap.nb_remote_free;
+    nb_batches += heap.nb_batches;
+    slab_szb += heap.slab_szb;
+  });
+  fprintf(f, "alloc_malloc\t%ld\n", nb_malloc);
+  fprintf(f, "alloc_local_free\t%ld\n", nb_local_free);
+  fprintf(f, "alloc_remote_free\t%ld\n", nb_remote_free);
+  fprintf(f, "alloc_remote_batches\t%ld\n", nb_batches);
+  fprintf(f, "alloc_slab_bytes\t%ld\n", slab_szb);
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
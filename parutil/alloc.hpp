@@ -0,0 +1,148 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file alloc.hpp
+ * \brief Worker-local memory allocator
+ *
+ */
+
+#ifndef _PASL_ALLOC_H_
+#define _PASL_ALLOC_H_
+
+#include <cstddef>
+#include <stdio.h>
+#include <new>
+#include <utility>
+
+/***********************************************************************/
+
+namespace pasl {
+namespace alloc {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * Each worker owns a heap, which consists of one freelist per size
+ * class, refilled from slabs obtained from `malloc`. Size classes are
+ * spaced by 16 bytes up to 1KB, then by powers of two up to 64KB;
+ * larger blocks, and blocks requested by threads which are not
+ * workers, go to `malloc`. Each block is prefixed by a 16-byte
+ * header that records its owner and its size class, so that `free`
+ * needs no size.
+ *
+ * A block freed by its owner goes back to the freelist of its owner.
+ * A block freed by another worker (e.g., a thread object deallocated
+ * after a steal) is added to a batch that the freeing worker keeps
+ * for the owner; once the batch holds `-alloc_batch` blocks (default
+ * 32), the batch is pushed with a single CAS on a lock-free stack of
+ * the owner, which moves these blocks back into its freelists the
+ * next time one of its freelists runs empty. Incomplete batches are
+ * pushed by `flush()`, which the scheduler calls each time a worker
+ * runs out of work.
+ *
+ * When a slab cannot hold the next block, its remainder is cut into
+ * blocks of the largest size classes that fit. The slabs of a heap
+ * are returned to the system by `destroy()`.
+ */
+
+/*! \brief Reads the command line options and sets up the heaps of the
+ *  workers
+ *  \pre the group of workers is initialized
+ */
+void init();
+/*! \brief Prepares the heaps for a group of `nb_workers` workers
+ *
+ * The heaps of the workers that leave the group are moved into the
+ * heap of worker 0: their slabs, their free blocks, and the blocks
+ * that other workers returned to them. Their pending batches are
+ * pushed to their owners.
+ *
+ * \pre no worker is running, and the group still has its former size
+ */
+void shrink(int nb_workers);
+/*! \brief Returns the slabs of all the heaps to the system
+ *  \pre all the blocks returned by `malloc` to workers are released
+ */
+void destroy();
+
+//! Returns a block of at least `szb` bytes, aligned on 16 bytes
+void* malloc(size_t szb);
+//! Same as `malloc`, except that the block always comes from `::malloc`
+void* global_malloc(size_t szb);
+//! Releases a block returned by `malloc` or `global_malloc`
+void free(void* p);
+
+//! Pushes the incomplete batches of remote frees of the calling worker
+void flush();
+
+//! Prints the counters of all the heaps
+void report(FILE* f);
+
+/*---------------------------------------------------------------------*/
+
+/*! \class allocator
+ *  \brief Standard allocator backed by `pasl::alloc::malloc`
+ */
+template <class T>
+class allocator {
+public:
+
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = size_t;
+  using difference_type = ptrdiff_t;
+
+  template <class U>
+  struct rebind {
+    using other = allocator<U>;
+  };
+
+  allocator() { }
+
+  template <class U>
+  allocator(const allocator<U>&) { }
+
+  T* allocate(size_t n) {
+    return (T*)alloc::malloc(n * sizeof(T));
+  }
+
+  void deallocate(T* p, size_t) {
+    alloc::free(p);
+  }
+
+  template <class U, class... Args>
+  void construct(U* p, Args&&... args) {
+    new ((void*)p) U(std::forward<Args>(args)...);
+  }
+
+  template <class U>
+  void destroy(U* p) {
+    p->~U();
+  }
+
+  size_t max_size() const {
+    return ((size_t)-1) / sizeof(T);
+  }
+
+};
+
+template <class T, class U>
+bool operator==(const allocator<T>&, const allocator<U>&) {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const allocator<T>&, const allocator<U>&) {
+  return false;
+}
+
+} // end namespace
+} // end namespace
+
+/***********************************************************************/
+
+#endif /*! _PASL_ALLOC_H_ */
@@ -9,7 +9,12 @@
 #include <sys/sysctl.h>
 #endif
 #include <stdlib.h>
+#include <stdio.h>
+#ifdef TARGET_LINUX
+#include <dirent.h>
+#endif
 #include <vector>
+#include <algorithm>
 
 #include "machine.hpp"
 #include "worker.hpp"
@@ -27,6 +32,7 @@ struct cpuinfo_t {
   float cpu_frequency_mhz;
   int   nb_cpus;
   int   cache_line_szb;
+  char  model_name[256];
 };
 
 /*---------------------------------------------------------------------*/
@@ -34,6 +40,7 @@ struct cpuinfo_t {
 
 int              cache_line_szb = 0;
 double           cpu_frequency_ghz;
+std::string      cpu_model_name;
 #ifdef HAVE_HWLOC
 hwloc_topology_t topology;
 #endif
@@ -61,7 +68,7 @@ hyperthreading_mode_t htmode_of_string(std::string s) {
 }
 
 static struct cpuinfo_t mine_cpuinfo () {
-  struct cpuinfo_t cpuinfo = { 0., 0, 0 };
+  struct cpuinfo_t cpuinfo = { 0., 0, 0, "unknown" };
 #ifdef TARGET_LINUX
   /* Get information from /proc/cpuinfo.  The interesting
    * fields are:
@@ -69,6 +76,8 @@ static struct cpuinfo_t mine_cpuinfo () {
    * cpu MHz         : <float>             # cpu frequency in MHz
    *
    * cache_alignment : <int>               # cache alignment in bytes
+   *
+   * model name      : <string>            # cpu model
    */
   FILE *cpuinfo_file = fopen("/proc/cpuinfo", "r");
   char buf[1024];
@@ -79,6 +88,8 @@ static struct cpuinfo_t mine_cpuinfo () {
         cpuinfo.nb_cpus++;
       } else if (sscanf(buf, "cache_alignment : %d", &cache_line_szb) == 1) {
         cpuinfo.cache_line_szb = cache_line_szb;
+      } else if (sscanf(buf, "model name : %255[^\n]", cpuinfo.model_name) == 1) {
+        ;
       }
     }
     fclose (cpuinfo_file);
@@ -104,6 +115,10 @@ static struct cpuinfo_t mine_cpuinfo () {
     perror("sysctl");
   }
   cpuinfo.cache_line_szb = (int)cache_lineszb;
+  size = sizeof(cpuinfo.model_name);
+  if (sysctlbyname("machdep.cpu.brand_string", cpuinfo.model_name, &size, NULL, 0) < 0) {
+    perror("sysctl");
+  }
 #endif
   if (cpuinfo.cpu_frequency_mhz == 0.) {
     atomic::die("Failed to read CPU frequency\n");
@@ -142,6 +157,7 @@ void init(hyperthreading_mode_t _htmode) {
   struct cpuinfo_t cpuinfo = mine_cpuinfo ();
   cache_line_szb = cpuinfo.cache_line_szb;
   cpu_frequency_ghz = (double)(cpuinfo.cpu_frequency_mhz / 1000.0);
+  cpu_model_name = std::string(cpuinfo.model_name);
   ticks::set_ticks_per_seconds(cpuinfo.cpu_frequency_mhz * 1000000.);
 
 #ifdef HAVE_HWLOC
@@ -282,6 +298,13 @@ void binding_policy::init(policy_t node_policy, bool no0, int nb_workers) {
   this->policy = policy;
   this->no0 = no0;
   this->nb_workers = nb_workers;
+  location_t unknown = { -1, -1, -1, -1 };
+  locations.assign(nb_workers, unknown);
+#if ! defined(HAVE_HWLOC) && defined(TARGET_LINUX)
+  pu_locations.resize(nb_pus);
+  for (int pu = 0; pu < nb_pus; pu++)
+    pu_locations[pu] = location_of_pu(pu);
+#endif
   if (no0 && (nb_workers == 1)) {
     // if there is just one pu, we do not exclude pu 0
     no0 = false;
@@ -351,6 +374,11 @@ void binding_policy::destroy() {
   }
   delete [] cpusets;
 #endif
+  locations.clear();
+#if ! defined(HAVE_HWLOC) && defined(TARGET_LINUX)
+  pu_locations.clear();
+#endif
+  nb_workers = 0;
 }
 
 void binding_policy::pin_calling_thread(worker_id_t my_id) {
@@ -381,6 +409,181 @@ void binding_policy::pin_calling_thread(worker_id_t my_id) {
 #else
   // in this case, cpu binding is not supported
 #endif
+  locations[my_id] = location_of_calling_thread(my_id);
+}
+
+std::string name_of_locality(locality_t locality) {
+  switch (locality) {
+    case LOCALITY_CORE: return std::string("core");
+    case LOCALITY_L3: return std::string("l3");
+    case LOCALITY_NODE: return std::string("node");
+    case LOCALITY_REMOTE: return std::string("remote");
+    default: return std::string("unknown");
+  }
+}
+
+#ifdef HAVE_HWLOC
+
+// returns the index of the object at the given depth that contains all
+// of `set`, or -1
+static int index_at_depth(hwloc_const_cpuset_t set, int depth) {
+  if (depth == HWLOC_TYPE_DEPTH_UNKNOWN || depth == HWLOC_TYPE_DEPTH_MULTIPLE)
+    return -1;
+  int nb = hwloc_get_nbobjs_by_depth(topology, depth);
+  for (int i = 0; i < nb; i++) {
+    hwloc_obj_t obj = hwloc_get_obj_by_depth(topology, depth, i);
+    if (hwloc_bitmap_isincluded(set, obj->cpuset))
+      return i;
+  }
+  return -1;
+}
+
+#elif defined(TARGET_LINUX)
+
+static const char* sysfs_cpu_dir = "/sys/devices/system/cpu";
+
+// returns the first integer of file `file` of the sysfs directory of `pu`, or -1
+static int read_sysfs_int(int pu, const char* file) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/cpu%d/%s", sysfs_cpu_dir, pu, file);
+  FILE* f = fopen(path, "r");
+  if (f == NULL)
+    return -1;
+  int v;
+  if (fscanf(f, "%d", &v) != 1)
+    v = -1;
+  fclose(f);
+  return v;
+}
+
+// returns the NUMA node of `pu`, as given by its `nodeN` entry, or -1
+static int read_sysfs_node(int pu) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/cpu%d", sysfs_cpu_dir, pu);
+  DIR* dir = opendir(path);
+  if (dir == NULL)
+    return -1;
+  int node = -1;
+  struct dirent* entry;
+  while (node == -1 && (entry = readdir(dir)) != NULL)
+    if (sscanf(entry->d_name, "node%d", &node) != 1)
+      node = -1;
+  closedir(dir);
+  return node;
+}
+
+#endif
+
+#ifdef HAVE_HWLOC
+
+binding_policy::location_t binding_policy::location_of_cpuset(hwloc_const_cpuset_t set) {
+  location_t location;
+  location.core = index_at_depth(set, hwloc_get_type_depth(topology, HWLOC_OBJ_CORE));
+  location.l3 = index_at_depth(set, hwloc_get_cache_type_depth(topology, 3, (hwloc_obj_cache_type_t)-1));
+  location.node = index_at_depth(set, hwloc_get_type_or_below_depth(topology, HWLOC_OBJ_NODE));
+  location.package = index_at_depth(set, hwloc_get_type_depth(topology, HWLOC_OBJ_SOCKET));
+  return location;
+}
+
+#elif defined(TARGET_LINUX)
+
+/* The core and the L3 cache are identified by the first processing
+ * element that they contain. */
+binding_policy::location_t binding_policy::location_of_pu(int pu) {
+  location_t location;
+  location.core = read_sysfs_int(pu, "topology/thread_siblings_list");
+  location.l3 = -1;
+  for (int index = 0; ; index++) {
+    char file[64];
+    snprintf(file, sizeof(file), "cache/index%d/level", index);
+    int level = read_sysfs_int(pu, file);
+    if (level == -1)
+      break;
+    if (level == 3) {
+      snprintf(file, sizeof(file), "cache/index%d/shared_cpu_list", index);
+      location.l3 = read_sysfs_int(pu, file);
+      break;
+    }
+  }
+  location.package = read_sysfs_int(pu, "topology/physical_package_id");
+  location.node = read_sysfs_node(pu);
+  if (location.node == -1)
+    location.node = location.package;
+  return location;
+}
+
+#endif
+
+/* A level is known only if all the processing elements on which the
+ * worker may execute share it: with the `none` binding policy, a worker
+ * may run anywhere and its location is unknown, unless the whole
+ * process is confined to, e.g., one NUMA node. */
+binding_policy::location_t binding_policy::location_of_calling_thread(worker_id_t my_id) {
+  location_t location = { -1, -1, -1, -1 };
+#ifdef HAVE_HWLOC
+  if (! hwloc_bitmap_iszero(cpusets[my_id]))
+    location = location_of_cpuset(cpusets[my_id]);
+#elif defined(TARGET_LINUX)
+  cpu_set_t cpus;
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &cpus) != 0)
+    return location;
+  bool first = true;
+  for (int pu = 0; pu < nb_pus && pu < CPU_SETSIZE; pu++) {
+    if (! CPU_ISSET(pu, &cpus))
+      continue;
+    location_t l = pu_locations[pu];
+    if (first) {
+      location = l;
+      first = false;
+      continue;
+    }
+    if (location.core != l.core)
+      location.core = -1;
+    if (location.l3 != l.l3)
+      location.l3 = -1;
+    if (location.node != l.node)
+      location.node = -1;
+    if (location.package != l.package)
+      location.package = -1;
+  }
+#endif
+  return location;
+}
+
+locality_t binding_policy::locality_of_workers(worker_id_t id1, worker_id_t id2) {
+  // if this assert fails, you forgot to call the_binding_policy.init()
+  assert(this->nb_workers != 0);
+  location_t l1 = locations[id1];
+  location_t l2 = locations[id2];
+  if (l1.node == -1 || l2.node == -1)
+    return LOCALITY_NODE;
+  else if (l1.core != -1 && l1.core == l2.core)
+    return LOCALITY_CORE;
+  else if (l1.l3 != -1 && l1.l3 == l2.l3)
+    return LOCALITY_L3;
+  else if (l1.node == l2.node)
+    return LOCALITY_NODE;
+  else
+    return LOCALITY_REMOTE;
+}
+
+void binding_policy::check_localities() {
+  std::vector<int> packages;
+  bool found[NB_LOCALITIES] = { false };
+  for (worker_id_t id1 = 0; id1 < nb_workers; id1++) {
+    int package = locations[id1].package;
+    if (package != -1 && std::find(packages.begin(), packages.end(), package) == packages.end())
+      packages.push_back(package);
+    for (worker_id_t id2 = id1 + 1; id2 < nb_workers; id2++)
+      found[locality_of_workers(id1, id2)] = true;
+  }
+  int nb_found = (int)std::count(found, found + NB_LOCALITIES, true);
+  int nb_packages = (int)packages.size();
+  // with more workers than sockets, two workers share a socket
+  if (nb_packages > 1 && nb_workers > nb_packages && nb_found < 2)
+    fprintf(stderr, "warning: %d workers run on %d sockets, but all pairs of "
+            "workers are at the same level of the machine hierarchy\n",
+            nb_workers, nb_packages);
 }
 
 #ifdef HAVE_HWLOC
@@ -460,19 +663,32 @@ void numa::init(int nb_workers) {
       assert(rank_of_worker(worker_of_rank(node, i)) == i);
 }
 
-numa::numa() {
+numa::numa()
+: nb_nodes(0), nodes(nullptr), nb_workers_per_node(nullptr),
+  node_ranks(nullptr), leaders(nullptr) {
   this->bpol = &the_bindpolicy;
 }
 
-numa::numa(binding_policy_p bpol) {
+numa::numa(binding_policy_p bpol)
+: nb_nodes(0), nodes(nullptr), nb_workers_per_node(nullptr),
+  node_ranks(nullptr), leaders(nullptr) {
   this->bpol = bpol;
 }
 
 numa::~numa() {
+  destroy();
+}
+
+void numa::destroy() {
   delete [] nodes;
   delete [] nb_workers_per_node;
   delete [] node_ranks;
   delete [] leaders;
+  nodes = nullptr;
+  nb_workers_per_node = nullptr;
+  node_ranks = nullptr;
+  leaders = nullptr;
+  node_info.clear();
 }
 
 int numa::get_nb_nodes() {
@@ -11,6 +11,7 @@
 #define _PASL_UTIL_MACHINE_H_
 
 #include <vector>
+#include <string>
 #ifdef HAVE_HWLOC
 #include <hwloc.h>
 #else
@@ -34,6 +35,9 @@ extern int cache_line_szb;
 /* \brief CPU frequency in gigaherz */
 extern double cpu_frequency_ghz;
 
+/* \brief CPU model, as reported by the system, or "unknown" */
+extern std::string cpu_model_name;
+
 #ifdef HAVE_HWLOC
 extern hwloc_topology_t    topology;
 #endif
@@ -55,6 +59,19 @@ void destroy();
 
 /*---------------------------------------------------------------------*/
 
+//! Levels of the machine hierarchy, from the closest to the farthest
+typedef enum {
+  LOCALITY_CORE = 0,
+  LOCALITY_L3,
+  LOCALITY_NODE,
+  LOCALITY_REMOTE,
+  NB_LOCALITIES
+} locality_t;
+
+std::string name_of_locality(locality_t locality);
+
+/*---------------------------------------------------------------------*/
+
 /*! \class binding_policy
  *  \brief A policy which determines on which hardware processing element 
  *  each worker thread may execute.
@@ -83,6 +100,29 @@ public:
   void pin_calling_thread(worker_id_t my_id);
   //! Tries to convert the given string to a binding policy id
   static policy_t policy_of_string(std::string s);
+  /*! \brief Returns the closest level of the machine hierarchy that
+   *  contains the processing elements on which the two given workers
+   *  may run.
+   *
+   * The position of a worker is derived from the set of processing
+   * elements it may execute on, as given by the binding policy (or,
+   * without hwloc, by the affinity of the thread), and from the
+   * topology given by hwloc, or else by `/sys/devices/system/cpu`. A
+   * level is known only if the whole set fits in one object of that
+   * level; for instance, with the `none` policy, workers may run
+   * anywhere and the level of a pair of workers is only known if the
+   * process is confined to one NUMA node. If the NUMA node of either
+   * worker is unknown, the result is `LOCALITY_NODE`.
+   *
+   * \pre both workers have called `pin_calling_thread`
+   */
+  locality_t locality_of_workers(worker_id_t id1, worker_id_t id2);
+  /*! \brief Prints a warning if the workers run on several sockets
+   *  but all pairs of workers are at the same level of the hierarchy.
+   *
+   * \pre all workers have called `pin_calling_thread`
+   */
+  void check_localities();
 
 #ifdef HAVE_HWLOC
   /* \brief Returns the set of NUMA nodes that are close to the given
@@ -95,9 +135,33 @@ public:
 #endif
 
 protected:
+  /* \brief Position of a set of processing elements in the machine
+   * hierarchy; each field identifies the core, L3 cache, NUMA node or
+   * socket that contains the whole set, or is -1 if there is none or
+   * it is unknown. */
+  struct location_t {
+    int core;
+    int l3;
+    int node;
+    int package;
+  };
+
   policy_t                    policy;
   bool                        no0;
   int                         nb_workers;
+  /* \brief The location of each worker, as recorded by
+   * `pin_calling_thread`. */
+  std::vector<location_t>     locations;
+
+  location_t location_of_calling_thread(worker_id_t my_id);
+#ifdef HAVE_HWLOC
+  static location_t location_of_cpuset(hwloc_const_cpuset_t set);
+#elif defined(TARGET_LINUX)
+  //! The location of each processing element, read at `init`
+  std::vector<location_t>     pu_locations;
+
+  static location_t location_of_pu(int pu);
+#endif
 #ifdef HAVE_HWLOC
   /* \brief An array of CPU sets keyed by worker ID; Each item 
    * determines the set of CPUs on which the worker can execute. */
@@ -145,6 +209,8 @@ public:
   numa(binding_policy_p bpol);
   ~numa();
   void init(int nb_workers);
+  //! Teardown, after which `init` may be called again
+  void destroy();
   //! Returns the number of nodes that are allocated to workers
   int get_nb_nodes();
   /*! \brief Returns one of multiple nodes to which the given worker
@@ -34,12 +34,17 @@ namespace worker {
 
 tls_extern_declare(worker_id_t, worker_id);
 
-//! Returns the id of calling worker.
+/*! \brief Returns the id of calling worker.
+ *
+ * Ids are stored shifted by one, so that a thread which was not
+ * created by the worker group (e.g., a thread that submits work from
+ * outside), whose thread-local storage is zeroed, reads `undef`.
+ */
 static inline worker_id_t get_my_id () {
 #ifdef USE_CILK_RUNTIME
   return __cilkrts_get_worker_number();
 #else
-  return tls_getter(worker_id_t, worker_id);
+  return tls_getter(worker_id_t, worker_id) - 1;
 #endif
 }
 
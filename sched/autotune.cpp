@@ -0,0 +1,169 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file autotune.cpp
+ *
+ */
+
+#include <vector>
+#include <map>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+#include "autotune.hpp"
+#include "estimator.hpp"
+#include "cmdline.hpp"
+#include "microtime.hpp"
+
+namespace pasl {
+namespace sched {
+namespace autotune {
+
+/***********************************************************************/
+
+// cutoffs read by the program, by order of their first reading
+static std::vector<std::string> names;
+static std::map<std::string, int> defaults;
+// values set by the calibration
+static std::map<std::string, int> tuned;
+
+static std::string name_of_constant(std::string name) {
+  return "tuned_" + name;
+}
+
+static bool given_on_cmdline(std::string name) {
+  return util::cmdline::parse_or_default_string(name, "", false) != "";
+}
+
+int cutoff(std::string name, int dflt) {
+  if (std::find(names.begin(), names.end(), name) == names.end())
+    names.push_back(name);
+  defaults[name] = dflt;
+  int value = dflt;
+  auto it = tuned.find(name);
+  double cst;
+  if (it != tuned.end()) {
+    value = it->second;
+  } else if (data::estimator::get_preloaded_constant(name_of_constant(name), cst)) {
+    value = (int) cst;
+    // kept in the constants file if it is written again
+    data::estimator::record_constant(name_of_constant(name), cst);
+  }
+  return util::cmdline::parse_or_default_int(name, value, false);
+}
+
+/*---------------------------------------------------------------------*/
+
+class search_t {
+public:
+  std::string name;
+  int min_value;
+  int max_value;
+  int max_nb_evals;
+  int nb_runs;
+  const std::function<void()>& run;
+  // median time of the runs, by value of the cutoff
+  std::map<int, double> times;
+  int nb_evals;
+
+  search_t(std::string name, const std::function<void()>& run)
+  : name(name), run(run), nb_evals(0) {
+    min_value = std::max(1, util::cmdline::parse_or_default_int("autotune_min", 16, false));
+    max_value = std::max(min_value, util::cmdline::parse_or_default_int("autotune_max", 1 << 20, false));
+    max_nb_evals = util::cmdline::parse_or_default_int("autotune_evals", 8, false);
+    nb_runs = std::max(1, util::cmdline::parse_or_default_int("autotune_runs", 3, false));
+  }
+
+  double measure(int value) {
+    auto it = times.find(value);
+    if (it != times.end())
+      return it->second;
+    tuned[name] = value;
+    std::vector<double> samples;
+    for (int k = 0; k < nb_runs; k++) {
+      util::microtime::microtime_t start = util::microtime::now();
+      run();
+      samples.push_back(util::microtime::seconds_since(start));
+    }
+    std::sort(samples.begin(), samples.end());
+    double t = samples[samples.size() / 2];
+    times[value] = t;
+    return t;
+  }
+
+  // values are searched by their logarithm
+  double eval(double x) {
+    int value = (int) std::lround(std::pow(2., x));
+    value = std::min(max_value, std::max(min_value, value));
+    if (times.find(value) == times.end()) {
+      if (nb_evals >= max_nb_evals)
+        return std::numeric_limits<double>::max();
+      nb_evals++;
+    }
+    return measure(value);
+  }
+
+  int best() {
+    auto it = std::min_element(times.begin(), times.end(),
+      [] (const std::pair<const int, double>& p1, const std::pair<const int, double>& p2) {
+        return p1.second < p2.second;
+      });
+    return it->first;
+  }
+
+  int golden_section(int start) {
+    const double r = 0.6180339887;
+    measure(std::min(max_value, std::max(min_value, start)));
+    double a = std::log2((double) min_value);
+    double b = std::log2((double) max_value);
+    double x1 = b - r * (b - a);
+    double x2 = a + r * (b - a);
+    double f1 = eval(x1);
+    double f2 = eval(x2);
+    // stops when the interval is within a factor sqrt(2)
+    while (nb_evals < max_nb_evals && b - a > 0.5) {
+      if (f1 <= f2) {
+        b = x2;
+        x2 = x1;
+        f2 = f1;
+        x1 = b - r * (b - a);
+        f1 = eval(x1);
+      } else {
+        a = x1;
+        x1 = x2;
+        f1 = f2;
+        x2 = a + r * (b - a);
+        f2 = eval(x2);
+      }
+    }
+    return best();
+  }
+};
+
+void calibrate(const std::function<void()>& run) {
+  if (! util::cmdline::parse_or_default_bool("autotune", false, false))
+    return;
+  // records the cutoffs read by the benchmark
+  names.clear();
+  run();
+  // copied, since `names` is extended while the benchmark runs
+  std::vector<std::string> to_tune = names;
+  for (std::string name : to_tune) {
+    if (given_on_cmdline(name))
+      continue;
+    search_t search(name, run);
+    int value = search.golden_section(cutoff(name, defaults[name]));
+    tuned[name] = value;
+    printf("autotune_%s\t%d\n", name.c_str(), value);
+    data::estimator::record_constant(name_of_constant(name), (double) value);
+  }
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
@@ -0,0 +1,60 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file autotune.hpp
+ * \brief Calibration of integer cutoffs by repeated runs
+ *
+ */
+
+#ifndef _PASL_SCHED_AUTOTUNE_H_
+#define _PASL_SCHED_AUTOTUNE_H_
+
+#include <string>
+#include <functional>
+
+/***********************************************************************/
+
+namespace pasl {
+namespace sched {
+namespace autotune {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * A program reads each of its cutoffs by `cutoff(name, dflt)` instead
+ * of `util::cmdline::parse_or_default_int(name, dflt)`. The value is,
+ * by order of priority:
+ * - the one given on the command line by `-<name>`;
+ * - the one found by a calibration made by this run;
+ * - the one found by a previous calibration, read with the constants
+ *   of the estimators (`-read_csts`), under the name `tuned_<name>`;
+ * - `dflt`.
+ *
+ * With `-autotune 1`, `calibrate(run)` calibrates the cutoffs of the
+ * program, where `run()` runs the benchmark once and frees its result.
+ * A first run records the cutoffs that the benchmark reads. Then the
+ * cutoffs are tuned one after the other, each one by a golden-section
+ * search over the logarithm of its value, between `-autotune_min`
+ * (default 16) and `-autotune_max` (default 1048576). The search
+ * evaluates at most `-autotune_evals` (default 8) values besides the
+ * starting one, and it measures each value by the median time of
+ * `-autotune_runs` runs (default 3). The best value found is printed
+ * as `autotune_<name>`, and it is written with the constants of the
+ * estimators (`-write_csts`), so that later runs with `-read_csts` use
+ * it without calibrating again.
+ */
+
+//! Returns the value of the cutoff `name`
+int cutoff(std::string name, int dflt);
+
+//! Calibrates the cutoffs read by `run`, if `-autotune 1` is given
+void calibrate(const std::function<void()>& run);
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+#endif /*! _PASL_SCHED_AUTOTUNE_H_ */
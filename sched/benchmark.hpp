@@ -14,9 +14,17 @@
 #include <numa.h>
 #endif
 
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
 #include "cmdline.hpp"
 #include "threaddag.hpp"
 #include "native.hpp"
+#include "polling.hpp"
+#include "alloc.hpp"
 
 #ifndef _PASL_BENCHMARK_H_
 #define _PASL_BENCHMARK_H_
@@ -49,26 +57,193 @@ void launch(const Body& body) {
 #endif
 }
 
+/*---------------------------------------------------------------------*/
+/* Speedup curves
+ *
+ * With `-procs <n1>,<n2>,...`, `launch` runs the benchmark for each of
+ * the given numbers of workers in turn, in the same process: the
+ * worker group is rebuilt by `threaddag::resize` between two numbers
+ * of workers. For each number, the benchmark is run `-warmup` times
+ * (default 1), then `-runs` times (default 5), each run being timed.
+ * A number of workers of 0 stands for a run of the sequential version
+ * (`run(true)`) by a single worker.
+ *
+ * The summary goes to the file given by `-csv`, or to stdout, as a CSV
+ * table with one row per number of workers: the median, mean, standard
+ * deviation, minimum and maximum of the run times, in seconds, then
+ * the speedup and the efficiency. The speedup is relative to the median
+ * time of the sequential version, if it is in the list, and otherwise
+ * to the one of the first number of workers of the list. The efficiency
+ * is the speedup divided by the ratio of the number of workers to the
+ * one of the baseline (the sequential version counting as one worker).
+ *
+ * The input is built once, by `init`: `run` must leave it unchanged,
+ * unless `-reinit 1` is given, in which case `destroy` and `init` are
+ * called (without being timed) before each run but the first.
+ */
+
+class speedup_curve {
+public:
+
+  class row_t {
+  public:
+    int nb_workers;
+    std::vector<double> times;
+    row_t(int nb_workers) : nb_workers(nb_workers) { }
+    double median() const {
+      std::vector<double> t = times;
+      std::sort(t.begin(), t.end());
+      size_t n = t.size();
+      return (n % 2 == 1) ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2.;
+    }
+    double mean() const {
+      double sum = 0.;
+      for (double x : times)
+        sum += x;
+      return sum / (double) times.size();
+    }
+    double stddev() const {
+      if (times.size() < 2)
+        return 0.;
+      double m = mean();
+      double sum = 0.;
+      for (double x : times)
+        sum += (x - m) * (x - m);
+      return std::sqrt(sum / (double) (times.size() - 1));
+    }
+  };
+
+  std::vector<row_t> rows;
+
+  static std::vector<int> parse_procs(std::string procs) {
+    std::vector<int> r;
+    size_t pos = 0;
+    while (pos <= procs.size()) {
+      size_t next = procs.find(',', pos);
+      if (next == std::string::npos)
+        next = procs.size();
+      std::string item = procs.substr(pos, next - pos);
+      if (! item.empty())
+        r.push_back(std::max(0, atoi(item.c_str())));
+      pos = next + 1;
+    }
+    if (r.empty())
+      util::atomic::die("bad value for -procs: %s\n", procs.c_str());
+    return r;
+  }
+
+  void print_csv(FILE* f) const {
+    double baseline = -1.;
+    int baseline_nb_workers = 1;
+    for (const row_t& row : rows)
+      if (row.nb_workers == 0)
+        baseline = row.median();
+    if (baseline < 0. && ! rows.empty()) {
+      baseline = rows[0].median();
+      baseline_nb_workers = std::max(1, rows[0].nb_workers);
+    }
+    fprintf(f, "proc,runs,median,mean,stddev,min,max,speedup,efficiency\n");
+    for (const row_t& row : rows) {
+      double median = row.median();
+      double speedup = (median > 0.) ? baseline / median : 0.;
+      double efficiency = speedup * (double) baseline_nb_workers
+                        / (double) std::max(1, row.nb_workers);
+      fprintf(f, "%d,%d,%.6lf,%.6lf,%.6lf,%.6lf,%.6lf,%.4lf,%.4lf\n",
+              row.nb_workers, (int) row.times.size(), median, row.mean(), row.stddev(),
+              *std::min_element(row.times.begin(), row.times.end()),
+              *std::max_element(row.times.begin(), row.times.end()),
+              speedup, efficiency);
+    }
+  }
+
+};
+
+//! Initializes the runtime with `nb_workers` workers, or `-proc` if negative
+static inline void init_runtime(int nb_workers = -1) {
+#ifdef USE_LIBNUMA
+  numa_set_interleave_mask(numa_all_nodes_ptr);
+#endif
+  if (nb_workers < 0)
+    threaddag::init();
+  else
+    threaddag::init(nb_workers);
+}
+
+template <class Init, class Run, class Output, class Destroy>
+void launch_speedup_curve(std::string procs,
+                          const Init& init, const Run& run, const Output& output,
+                          const Destroy& destroy) {
+  std::vector<int> nb_workers_list = speedup_curve::parse_procs(procs);
+  int nb_warmups = std::max(0, util::cmdline::parse_or_default_int("warmup", 1, false));
+  int nb_runs = std::max(1, util::cmdline::parse_or_default_int("runs", 5, false));
+  bool reinit = util::cmdline::parse_or_default_bool("reinit", false, false);
+  std::string csv = util::cmdline::parse_or_default_string("csv", "", false);
+  // the per-worker state is set up for the largest group, which is
+  // then resized down for each count
+  int max_nb_workers = *std::max_element(nb_workers_list.begin(), nb_workers_list.end());
+  init_runtime(std::max(1, max_nb_workers));
+  launch(init);
+  speedup_curve curve;
+  bool first = true;
+  for (int nb_workers : nb_workers_list) {
+    bool sequential = (nb_workers == 0);
+    threaddag::resize(std::max(1, nb_workers));
+    speedup_curve::row_t row(nb_workers);
+    for (int k = 0; k < nb_warmups + nb_runs; k++) {
+      if (reinit && ! first) {
+        launch(destroy);
+        launch(init);
+      }
+      first = false;
+      uint64_t start_time = util::microtime::now();
+      launch([&] { run(sequential); });
+      double exec_time = util::microtime::seconds_since(start_time);
+      if (k >= nb_warmups)
+        row.times.push_back(exec_time);
+    }
+    curve.rows.push_back(row);
+  }
+  if (csv.empty()) {
+    curve.print_csv(stdout);
+  } else {
+    FILE* f = fopen(csv.c_str(), "w");
+    if (f == nullptr)
+      util::atomic::die("cannot open %s\n", csv.c_str());
+    curve.print_csv(f);
+    fclose(f);
+  }
+  launch(output);
+  launch(destroy);
+  threaddag::destroy();
+}
+
+/*---------------------------------------------------------------------*/
+
 template <class Init, class Run, class Output, class Destroy>
 void launch(const Init& init, const Run& run, const Output& output,
             const Destroy& destroy) {
+  std::string procs = util::cmdline::parse_or_default_string("procs", "", false);
+  if (! procs.empty()) {
+    launch_speedup_curve(procs, init, run, output, destroy);
+    return;
+  }
   bool sequential = (util::cmdline::parse_or_default_int("proc", 1, false) == 0);
   bool report_time = util::cmdline::parse_or_default_bool("report_time", true, false);
-#ifdef USE_LIBNUMA
-  numa_set_interleave_mask(numa_all_nodes_ptr);
-#endif
-  threaddag::init();
+  init_runtime();
   launch(init);
   LOG_BASIC(ENTER_ALGO);
   uint64_t start_time = util::microtime::now();
-  launch([&] { run(sequential); });
+  launch([&] { native::measure_workspan([&] { run(sequential); }); });
   double exec_time = util::microtime::seconds_since(start_time);
   LOG_BASIC(EXIT_ALGO);
   if (report_time)
     printf ("exectime %.3lf\n", exec_time);
+  WORKSPAN_ONLY(workspan::print(stdout, threaddag::get_nb_workers(), exec_time));
   STAT_IDLE(sum());
   STAT(dump(stdout));
+  STAT_ONLY(alloc::report(stdout));
   STAT_IDLE(print_idle(stdout));
+  polling::output(stdout);
 #ifdef DUMP_JEMALLOC_STATS
   // Dump allocator statistics to stderr.
   malloc_stats_print(NULL, NULL, NULL);
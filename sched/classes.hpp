@@ -103,6 +103,11 @@ namespace scheduler {
       assert(false);
       return nullptr;
     }
+
+    virtual thread_p local_pop() {
+      assert(false);
+      return nullptr;
+    }
     
     //! Creates a dependency edge from thread `t2` to `t1`.
     virtual void add_dependency(thread_p t1, thread_p t2) = 0;
@@ -119,6 +124,14 @@ namespace scheduler {
      *  with a new `outstrategy::noop`.
      */
     virtual outstrategy_p capture_outstrategy() = 0;
+
+    /*! Replaces the outstrategy of the current thread.
+     *  \pre The outstrategy of the current thread has been captured
+     *  by a call to `capture_outstrategy`.
+     *  \post The outstrategy `out` is finished by the scheduler
+     *  once the current thread returns control to the scheduler.
+     */
+    virtual void set_current_outstrategy(outstrategy_p out) = 0;
     
     /*! \brief Ensures that the scheduler does not deallocate the
      *  calling thread.
@@ -133,6 +146,15 @@ namespace scheduler {
     virtual bool& should_communicate_flag() = 0;
     
     virtual bool should_call_communicate() = 0;
+
+    /*! \brief Returns true if another worker is waiting for work from
+     *  the calling worker: a steal request is posted to it, or, in
+     *  sender-initiated work stealing, some worker is idle.
+     *
+     * Unlike `should_call_communicate`, it does not depend on the
+     * period of the scheduler.
+     */
+    virtual bool has_pending_request() = 0;
     
     virtual size_t nb_threads() = 0;
 
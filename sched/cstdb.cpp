@@ -0,0 +1,370 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file cstdb.cpp
+ *
+ */
+
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#ifdef TARGET_LINUX
+#include <link.h>
+#include <elf.h>
+#endif
+
+#include "cstdb.hpp"
+#include "cmdline.hpp"
+#include "machine.hpp"
+#include "atomic.hpp"
+
+namespace pasl {
+namespace data {
+namespace estimator {
+namespace cstdb {
+
+/***********************************************************************/
+
+static const char* header = "pasl-cstdb 1";
+
+// the machine and the program to which constants belong
+class dbkey_t {
+public:
+  std::string host;
+  std::string cpu;
+  int nb_workers;
+  std::string build;
+  dbkey_t() : nb_workers(0) { }
+  bool same_setting(const dbkey_t& other) const {
+    return host == other.host && cpu == other.cpu
+        && nb_workers == other.nb_workers;
+  }
+  bool operator==(const dbkey_t& other) const {
+    return same_setting(other) && build == other.build;
+  }
+};
+
+class entry_t {
+public:
+  std::string name;
+  dbkey_t key;
+  double cst;
+  long weight;
+  time_t updated;
+  entry_t() : cst(0.), weight(0), updated(0) { }
+};
+
+class learned_t {
+public:
+  double cst;
+  long nb_measures;
+};
+
+static std::string path = "";
+static bool write_back = true;
+static long min_weight;
+static long max_weight;
+static double max_age_seconds;
+static dbkey_t my_key;
+// constants of the entries which match `my_key`
+static std::map<std::string, double> loaded;
+// constants learned by the estimators during this run
+static std::map<std::string, learned_t> learned;
+
+/*---------------------------------------------------------------------*/
+/* Key of the program */
+
+static std::string get_host_name() {
+  char buf[256];
+  if (gethostname(buf, sizeof(buf)) != 0)
+    return std::string("unknown");
+  buf[sizeof(buf) - 1] = '\0';
+  return std::string(buf);
+}
+
+static std::string hex_of_bytes(const unsigned char* bytes, size_t nb) {
+  std::string s;
+  char buf[3];
+  for (size_t i = 0; i < nb; i++) {
+    sprintf(buf, "%02x", bytes[i]);
+    s += buf;
+  }
+  return s;
+}
+
+#ifdef TARGET_LINUX
+static size_t align4(size_t n) {
+  return (n + 3) & ~((size_t) 3);
+}
+
+// looks for the build id note of the executable, the first object listed
+static int find_build_id(struct dl_phdr_info* info, size_t, void* data) {
+  std::string& id = *(std::string*) data;
+  for (int i = 0; i < info->dlpi_phnum; i++) {
+    const ElfW(Phdr)& ph = info->dlpi_phdr[i];
+    if (ph.p_type != PT_NOTE)
+      continue;
+    const char* p = (const char*) (info->dlpi_addr + ph.p_vaddr);
+    const char* end = p + ph.p_memsz;
+    while (p + sizeof(ElfW(Nhdr)) <= end) {
+      const ElfW(Nhdr)* note = (const ElfW(Nhdr)*) p;
+      const char* note_name = p + sizeof(ElfW(Nhdr));
+      const char* desc = note_name + align4(note->n_namesz);
+      if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4
+          && memcmp(note_name, "GNU", 4) == 0) {
+        id = hex_of_bytes((const unsigned char*) desc, note->n_descsz);
+        return 1;
+      }
+      p = desc + align4(note->n_descsz);
+    }
+  }
+  return 1;
+}
+#endif
+
+static std::string get_build_id() {
+  std::string id = "";
+#ifdef TARGET_LINUX
+  dl_iterate_phdr(find_build_id, &id);
+  if (id != "")
+    return id;
+  std::string executable = "/proc/self/exe";
+#else
+  std::string executable = util::cmdline::name_of_my_executable();
+#endif
+  struct stat st;
+  if (stat(executable.c_str(), &st) != 0)
+    return std::string("unknown");
+  std::ostringstream s;
+  s << "size" << (long) st.st_size << "-date" << (long) st.st_mtime;
+  return s.str();
+}
+
+/*---------------------------------------------------------------------*/
+/* Reading and writing the file */
+
+// fields are separated by tabs, since the name of a cpu has spaces
+static bool parse_entry(const std::string& line, entry_t& e) {
+  std::vector<std::string> fields;
+  std::istringstream in(line);
+  std::string field;
+  while (std::getline(in, field, '\t'))
+    fields.push_back(field);
+  if (fields.size() != 8)
+    return false;
+  e.name = fields[0];
+  e.key.host = fields[1];
+  e.key.cpu = fields[2];
+  e.key.nb_workers = atoi(fields[3].c_str());
+  e.key.build = fields[4];
+  e.cst = atof(fields[5].c_str());
+  e.weight = atol(fields[6].c_str());
+  e.updated = (time_t) atol(fields[7].c_str());
+  return true;
+}
+
+static std::string string_of_entry(const entry_t& e) {
+  char buf[64];
+  std::ostringstream s;
+  s << e.name << "\t" << e.key.host << "\t" << e.key.cpu << "\t"
+    << e.key.nb_workers << "\t" << e.key.build << "\t";
+  sprintf(buf, "%.9lf", e.cst);
+  s << buf << "\t" << e.weight << "\t" << (long) e.updated << "\n";
+  return s.str();
+}
+
+static bool read_contents(int fd, std::string& contents) {
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    contents.append(buf, (size_t) n);
+  return n == 0;
+}
+
+// returns false if the file is not a database of this version
+static bool read_entries(int fd, std::vector<entry_t>& entries) {
+  std::string contents;
+  if (! read_contents(fd, contents))
+    return false;
+  std::istringstream in(contents);
+  std::string line;
+  if (! std::getline(in, line))
+    return true;
+  if (line != header)
+    return false;
+  while (std::getline(in, line)) {
+    if (line == "" || line[0] == '#')
+      continue;
+    entry_t e;
+    if (parse_entry(line, e))
+      entries.push_back(e);
+  }
+  return true;
+}
+
+// the file is rewritten in place, under the lock taken by the caller
+static bool write_entries(int fd, const std::vector<entry_t>& entries) {
+  std::ostringstream out;
+  out << header << "\n";
+  out << "# name\thost\tcpu\tnb_workers\tbuild\tconstant\tweight\tupdated\n";
+  for (const entry_t& e : entries)
+    out << string_of_entry(e);
+  std::string contents = out.str();
+  if (lseek(fd, 0, SEEK_SET) == -1 || ftruncate(fd, 0) != 0)
+    return false;
+  size_t done = 0;
+  while (done < contents.size()) {
+    ssize_t n = write(fd, contents.data() + done, contents.size() - done);
+    if (n <= 0)
+      return false;
+    done += (size_t) n;
+  }
+  return true;
+}
+
+// the lock is taken on the database itself: shared to read it, and
+// exclusive to update it, so that processes which share the file
+// see it whole and merge their updates one after the other
+static int open_locked(int flags, int operation) {
+  int fd = open(path.c_str(), flags, 0644);
+  if (fd != -1)
+    flock(fd, operation);
+  return fd;
+}
+
+static void close_locked(int fd) {
+  if (fd == -1)
+    return;
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+static bool is_stale(const entry_t& e, time_t now) {
+  if (e.key.same_setting(my_key) && e.key.build != my_key.build)
+    return true;
+  return difftime(now, e.updated) > max_age_seconds;
+}
+
+/*---------------------------------------------------------------------*/
+
+void init(int nb_workers) {
+  path = util::cmdline::parse_or_default_string("cstdb_file", "", false);
+  if (path == "" && util::cmdline::parse_or_default_bool("cstdb", false, false))
+    path = util::cmdline::name_of_my_executable() + ".cstdb";
+  if (path == "")
+    return;
+  write_back = util::cmdline::parse_or_default_bool("cstdb_write", true, false);
+  min_weight = util::cmdline::parse_or_default_long("cstdb_min_weight", 1, false);
+  max_weight = util::cmdline::parse_or_default_long("cstdb_max_weight", 1000, false);
+  max_age_seconds = 86400. * util::cmdline::parse_or_default_double("cstdb_max_age", 30., false);
+  my_key.host = get_host_name();
+  my_key.cpu = util::machine::cpu_model_name;
+  my_key.nb_workers = std::max(1, nb_workers);
+  my_key.build = get_build_id();
+  // under -procs, the estimators learn from runs with several numbers
+  // of workers, which the entries keep apart
+  if (util::cmdline::parse_or_default_string("procs", "", false) != "")
+    write_back = false;
+  std::vector<entry_t> entries;
+  int fd = open_locked(O_RDONLY, LOCK_SH);
+  bool ok = (fd == -1) || read_entries(fd, entries);
+  close_locked(fd);
+  if (! ok) {
+    util::atomic::afprintf(stderr, "warning: %s is not a constants database; it is ignored\n", path.c_str());
+    write_back = false;
+    return;
+  }
+  time_t now = time(NULL);
+  int nb_stale = 0;
+  for (const entry_t& e : entries) {
+    if (is_stale(e, now)) {
+      if (e.key.same_setting(my_key))
+        nb_stale++;
+    } else if (e.key == my_key && e.weight >= min_weight) {
+      loaded[e.name] = e.cst;
+    }
+  }
+  if (nb_stale > 0)
+    util::atomic::afprintf(stderr, "warning: ignored %d stale constants of %s\n", nb_stale, path.c_str());
+}
+
+void destroy() {
+  if (path == "" || ! write_back || learned.empty()) {
+    loaded.clear();
+    learned.clear();
+    return;
+  }
+  int fd = open_locked(O_RDWR | O_CREAT, LOCK_EX);
+  if (fd == -1) {
+    util::atomic::afprintf(stderr, "warning: failed to open %s\n", path.c_str());
+    loaded.clear();
+    learned.clear();
+    return;
+  }
+  // read again, to merge with the updates of other processes
+  std::vector<entry_t> entries;
+  if (read_entries(fd, entries)) {
+    time_t now = time(NULL);
+    std::vector<entry_t> kept;
+    for (const entry_t& e : entries)
+      if (! is_stale(e, now))
+        kept.push_back(e);
+    for (auto& l : learned) {
+      const learned_t& cst = l.second;
+      auto it = std::find_if(kept.begin(), kept.end(), [&] (const entry_t& e) {
+        return e.name == l.first && e.key == my_key;
+      });
+      if (it == kept.end()) {
+        entry_t e;
+        e.name = l.first;
+        e.key = my_key;
+        e.cst = cst.cst;
+        e.weight = std::min(cst.nb_measures, max_weight);
+        e.updated = now;
+        kept.push_back(e);
+      } else {
+        double w1 = (double) it->weight;
+        double w2 = (double) cst.nb_measures;
+        it->cst = (w1 * it->cst + w2 * cst.cst) / (w1 + w2);
+        it->weight = std::min(it->weight + cst.nb_measures, max_weight);
+        it->updated = now;
+      }
+    }
+    if (! write_entries(fd, kept))
+      util::atomic::afprintf(stderr, "warning: failed to write %s\n", path.c_str());
+  }
+  close_locked(fd);
+  loaded.clear();
+  learned.clear();
+}
+
+bool lookup(std::string name, double& cst) {
+  auto it = loaded.find(name);
+  if (it == loaded.end())
+    return false;
+  cst = it->second;
+  return true;
+}
+
+void record(std::string name, double cst, long nb_measures) {
+  if (path == "" || nb_measures <= 0 || cst <= 0.)
+    return;
+  learned_t& l = learned[name];
+  l.cst = cst;
+  l.nb_measures = nb_measures;
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
+} // end namespace
@@ -0,0 +1,72 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file cstdb.hpp
+ * \brief Persistent database of the constants of the estimators
+ *
+ */
+
+#ifndef _PASL_DATA_CSTDB_H_
+#define _PASL_DATA_CSTDB_H_
+
+#include <string>
+
+/***********************************************************************/
+
+namespace pasl {
+namespace data {
+namespace estimator {
+namespace cstdb {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * With `-cstdb 1` (file `<executable>.cstdb`) or `-cstdb_file <file>`,
+ * the constants learned by the estimators are kept from one run to the
+ * next, so that a program starts with the cutoffs tuned by its previous
+ * runs instead of learning them again.
+ *
+ * Each entry of the file holds the constant of one estimator for one
+ * machine and one program: it is keyed by the name of the estimator,
+ * the host name, the cpu model, the number of workers (`-proc`) and the
+ * build id of the executable (its GNU build id, or else its size and
+ * date). When the program starts, the estimators whose entry matches
+ * this key start from the value of the entry.
+ *
+ * Each entry has a weight, the number of measures from which it was
+ * learned, and the date of its last update. When the program exits,
+ * the constants learned by the estimators which made measures are
+ * merged into the file, which is locked while it is updated: an entry
+ * of the same key is replaced by the average of the two values,
+ * weighted by their weights, and the weights are summed up to
+ * `-cstdb_max_weight` (default 1000), so that the entry keeps following
+ * the constant; entries of other keys are left as they are. Entries of
+ * less than `-cstdb_min_weight` measures (default 1) are not loaded.
+ *
+ * An entry is stale if it was learned by another build of the program,
+ * on the same machine and with the same number of workers, or if it
+ * was not updated for `-cstdb_max_age` days (default 30). Stale entries
+ * are not loaded, a warning reports them, and they are removed when the
+ * file is next written. With `-cstdb_write 0`, the file is only read;
+ * so it is with `-procs`, where the estimators learn from runs with
+ * several numbers of workers.
+ */
+
+void init(int nb_workers);
+void destroy();
+
+//! Returns true, and the stored constant in `cst`, if the estimator has an entry
+bool lookup(std::string name, double& cst);
+
+//! Records the constant learned by an estimator from `nb_measures` measures
+void record(std::string name, double cst, long nb_measures);
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
+} // end namespace
+
+#endif /*! _PASL_DATA_CSTDB_H_ */
@@ -9,6 +9,9 @@
 
 #include <fstream>
 #include <map>
+#include <cmath>
+#include <new>
+#include <stdlib.h>
 #ifndef NDEBUG
 #include <unordered_set>
 #endif
@@ -17,6 +20,8 @@
 #include "stats.hpp"
 #include "cmdline.hpp"
 #include "estimator.hpp"
+#include "cstdb.hpp"
+#include "idle.hpp"
 
 /***********************************************************************/
 
@@ -25,17 +30,27 @@ namespace data {
 namespace estimator {
   
 static double local_ticks_per_microsec;
+// whether estimators print the error of their predictions
+static bool report_errors = false;
+// whether estimators keep constants by load (see `distributed`)
+static bool by_load = false;
 
 static void try_write_constants_to_file();
 static void try_read_constants_from_file();
 
-void init() {
+void init(int nb_workers) {
   local_ticks_per_microsec = util::machine::cpu_frequency_ghz * 1000.;
+  report_errors = util::cmdline::parse_or_default_bool("estim_errors", false, false);
+  by_load = util::cmdline::parse_or_default_bool("estim_by_load", false, false);
+  if (by_load)
+    sched::idle::count_active_workers();
   try_read_constants_from_file();
+  cstdb::init(nb_workers);
 }
 
 void destroy() {
   try_write_constants_to_file();
+  cstdb::destroy();
 }
   
 #if 1
@@ -105,6 +120,18 @@ static void try_read_constants_from_file() {
   }
 }
 
+bool get_preloaded_constant(std::string name, double& cst) {
+  constant_map_t::iterator it = preloaded_constants.find(name);
+  if (it == preloaded_constants.end())
+    return false;
+  cst = it->second;
+  return true;
+}
+
+void record_constant(std::string name, double cst) {
+  recorded_constants[name] = cst;
+}
+
 static void try_write_constants_to_file() {
   std::string outfile_path = get_path_to_constants_file_from_cmdline("write_csts");
   if (outfile_path == "")
@@ -121,11 +148,22 @@ static void try_write_constants_to_file() {
 // common
 
 void common::init() {
-  LOG_ESTIM(new util::logging::estim_name_event_t(this, name));
+  LOG_ESTIM(util::logging::estim_name_event(this, name));
 }
 
 void common::output() {
   recorded_constants[name] = get_constant();
+  long nb_reports = 0;
+  double error_sum = 0.;
+  long nb_errors = 0;
+  measures.for_each([&] (worker_id_t, measures_t& m) {
+    nb_reports += m.nb_reports;
+    error_sum += m.error_sum;
+    nb_errors += m.nb_errors;
+  });
+  cstdb::record(name, get_constant(), nb_reports);
+  if (report_errors && nb_errors > 0)
+    printf("estim_error_%s\t%.4lf\n", name.c_str(), error_sum / (double) nb_errors);
 }
 
 void common::destroy() {
@@ -160,7 +198,7 @@ cost_type common::predict_impl(complexity_type comp) {
 
 cost_type common::predict(complexity_type comp) {
   cost_type t = predict_impl(comp);
-  LOG_ESTIM(new util::logging::estim_predict_event_t(this, comp, t));
+  LOG_ESTIM(util::logging::estim_predict_event(this, comp, t));
   return t;
 }
 
@@ -174,7 +212,7 @@ uint64_t common::predict_nb_iterations() {
 }
 
 void common::log_update(cost_type new_cst) {
-  LOG_CSTS(new util::logging::estim_update_event_t(this, new_cst));
+  LOG_CSTS(util::logging::estim_update_event(this, new_cst));
 }
   
 void common::check() {
@@ -184,31 +222,117 @@ void common::check() {
 void common::report(complexity_type comp, cost_type elapsed_ticks) {
   double elapsed_time = elapsed_ticks / (double) local_ticks_per_microsec;
   cost_type measured_cst = elapsed_time / comp;
-  LOG_ESTIM(new util::logging::estim_report_event_t(this, comp, elapsed_time, measured_cst));
+  LOG_ESTIM(util::logging::estim_report_event(this, comp, elapsed_time, measured_cst));
   STAT_COUNT(ESTIM_REPORT);
+  cost_type cst = get_constant();
+  measures_t& m = measures.mine();
+  m.nb_reports++;
+  if (report_errors && cst > 0. && measured_cst > 0.) {
+    m.error_sum += std::fabs(cst - measured_cst) / measured_cst;
+    m.nb_errors++;
+  }
   analyse(measured_cst);
 }
 
 /*---------------------------------------------------------------------*/
 // disbtributed
 
+// class of load: 1, 2, 3-4, 5-8, ... active workers
+static int load_bucket_of(int nb_active) {
+  int bucket = 0;
+  while ((1 << bucket) < nb_active && bucket < nb_load_buckets - 1)
+    bucket++;
+  return bucket;
+}
+
+static int current_load_bucket() {
+  return load_bucket_of(sched::idle::nb_active_workers());
+}
+
+distributed::load_csts_t::load_csts_t() {
+  for (int b = 0; b < nb_load_buckets; b++) {
+    csts[b] = cost::undefined;
+    measured_sum[b] = 0.;
+    nb_measured[b] = 0;
+  }
+}
+
 void distributed::init() {
   common::init();
   shared_cst = cost::undefined;
+  if (by_load && load_csts == nullptr) {
+    // the cells of the array are aligned on cache lines, which a plain
+    // `new` does not guarantee before C++17
+    using array_type = perworker::array<load_csts_t>;
+    void* p;
+    if (posix_memalign(&p, alignof(array_type), sizeof(array_type)) != 0)
+      throw std::bad_alloc();
+    load_csts = new (p) array_type();
+  }
+  for (int b = 0; b < nb_load_buckets; b++)
+    shared_load_csts[b] = cost::undefined;
   constant_map_t::iterator preloaded = preloaded_constants.find(common::name);
+  double stored_cst;
   if (preloaded != preloaded_constants.end())
     set_init_constant(preloaded->second);
+  else if (cstdb::lookup(common::name, stored_cst))
+    set_init_constant(stored_cst);
 }
 
 void distributed::destroy() {
   common::destroy();
+  if (load_csts != nullptr) {
+    load_csts->~array();
+    free(load_csts);
+  }
+  load_csts = nullptr;
 }
   
 void distributed::output() {
   common::output();
+  if (load_csts != nullptr)
+    output_load();
+}
+
+void distributed::output_load() {
+  double min_cst = 0.;
+  double max_cst = 0.;
+  for (int b = 0; b < nb_load_buckets; b++) {
+    double sum = 0.;
+    long nb = 0;
+    load_csts->for_each([&] (worker_id_t, load_csts_t& l) {
+      sum += l.measured_sum[b];
+      nb += l.nb_measured[b];
+    });
+    if (nb == 0)
+      continue;
+    double cst = sum / (double) nb;
+    int lo = (b == 0) ? 1 : (1 << (b - 1)) + 1;
+    printf("estim_load_%s_%d_%d\t%lf\n", name.c_str(), lo, 1 << b, cst);
+    min_cst = (min_cst == 0.) ? cst : std::min(min_cst, cst);
+    max_cst = std::max(max_cst, cst);
+  }
+  if (min_cst > 0.)
+    printf("estim_drift_%s\t%.3lf\n", name.c_str(), max_cst / min_cst);
 }
 
 cost_type distributed::get_constant() {
+  if (load_csts != nullptr) {
+    cost_type cst = get_load_constant(current_load_bucket());
+    if (cst != cost::undefined)
+      return cst;
+  }
+  return get_regular_constant();
+}
+
+cost_type distributed::get_load_constant(int bucket) {
+  cost_type cst = load_csts->mine().csts[bucket];
+  if (cst == cost::undefined)
+    return shared_load_csts[bucket];
+  return cst;
+}
+
+cost_type distributed::get_regular_constant() {
   cost_type cst = private_csts.mine();
   
   // if local constant is undefined, use shared cst
@@ -254,7 +378,9 @@ void distributed::update(cost_type new_cst) {
 }
 
 void distributed::analyse(cost_type measured_cst) {
-  cost_type cst = get_constant();
+  if (load_csts != nullptr)
+    analyse_load(measured_cst);
+  cost_type cst = get_regular_constant();
   if (cst == cost::undefined) {
     // handle the first measure without average
     update(measured_cst);
@@ -265,11 +391,239 @@ void distributed::analyse(cost_type measured_cst) {
   }
 }
 
+// same policy as for the regular constant, for the constant of the current load
+void distributed::analyse_load(cost_type measured_cst) {
+  int b = current_load_bucket();
+  load_csts_t& l = load_csts->mine();
+  l.measured_sum[b] += measured_cst;
+  l.nb_measured[b]++;
+  cost_type cst = get_load_constant(b);
+  cost_type new_cst = measured_cst;
+  if (cst != cost::undefined)
+    new_cst = ((weighted_average_factor * cst) + measured_cst)
+              / (weighted_average_factor + 1.0);
+  cost_type shared = shared_load_csts[b];
+  if (shared == cost::undefined)
+    shared_load_csts[b] = new_cst;
+  else if (new_cst < shared / min_report_shared_factor)
+    shared_load_csts[b] = shared / min_report_shared_factor;
+  l.csts[b] = new_cst;
+}
+
 bool distributed::constant_is_known() {
   return (shared_cst != cost::unknown);
 }
 
-  
+/*---------------------------------------------------------------------*/
+// linear
+
+// measures shorter than this many microseconds weigh as much as this
+static constexpr double min_weighted_time = 0.1;
+
+void linear::normal_t::reset() {
+  for (int i = 0; i < max_nb_features; i++) {
+    b[i] = 0.;
+    for (int j = 0; j < max_nb_features; j++)
+      a[i][j] = 0.;
+  }
+  nb_measures = 0;
+}
+
+// each measure has weight 1/time^2, so that the relative error is minimized
+void linear::normal_t::add(const features_type& x, double time) {
+  double t = std::max(time, min_weighted_time);
+  double w = 1. / (t * t);
+  for (int i = 0; i < x.nb; i++) {
+    b[i] += w * x.values[i] * time;
+    for (int j = 0; j < x.nb; j++)
+      a[i][j] += w * x.values[i] * x.values[j];
+  }
+  nb_measures++;
+}
+
+void linear::normal_t::add(const normal_t& other) {
+  for (int i = 0; i < max_nb_features; i++) {
+    b[i] += other.b[i];
+    for (int j = 0; j < max_nb_features; j++)
+      a[i][j] += other.a[i][j];
+  }
+  nb_measures += other.nb_measures;
+}
+
+/* solves the normal equations restricted to the active features, by
+ * gaussian elimination; a feature whose weight comes out negative is
+ * made inactive, and the system is solved again
+ */
+bool linear::normal_t::solve(double* weights) const {
+  bool active[max_nb_features];
+  int nb_active = 0;
+  for (int i = 0; i < max_nb_features; i++) {
+    weights[i] = 0.;
+    active[i] = (a[i][i] > 0.);
+    if (active[i])
+      nb_active++;
+  }
+  while (nb_active > 0) {
+    int idx[max_nb_features];
+    int n = 0;
+    for (int i = 0; i < max_nb_features; i++)
+      if (active[i])
+        idx[n++] = i;
+    double m[max_nb_features][max_nb_features + 1];
+    for (int i = 0; i < n; i++) {
+      for (int j = 0; j < n; j++)
+        m[i][j] = a[idx[i]][idx[j]];
+      // slight regularization, for features which are proportional
+      m[i][i] *= 1. + 1e-9;
+      m[i][n] = b[idx[i]];
+    }
+    for (int k = 0; k < n; k++) {
+      int pivot = k;
+      for (int i = k + 1; i < n; i++)
+        if (std::fabs(m[i][k]) > std::fabs(m[pivot][k]))
+          pivot = i;
+      for (int j = 0; j <= n; j++)
+        std::swap(m[k][j], m[pivot][j]);
+      if (m[k][k] == 0.)
+        continue;
+      for (int i = k + 1; i < n; i++) {
+        double f = m[i][k] / m[k][k];
+        for (int j = k; j <= n; j++)
+          m[i][j] -= f * m[k][j];
+      }
+    }
+    double sol[max_nb_features];
+    for (int k = n - 1; k >= 0; k--) {
+      double v = m[k][n];
+      for (int j = k + 1; j < n; j++)
+        v -= m[k][j] * sol[j];
+      sol[k] = (m[k][k] == 0.) ? 0. : v / m[k][k];
+    }
+    int most_negative = -1;
+    for (int k = 0; k < n; k++)
+      if (sol[k] < 0. && (most_negative == -1 || sol[k] < sol[most_negative]))
+        most_negative = k;
+    if (most_negative == -1) {
+      for (int k = 0; k < n; k++)
+        weights[idx[k]] = sol[k];
+      return true;
+    }
+    active[idx[most_negative]] = false;
+    nb_active--;
+  }
+  return false;
+}
+
+void linear::local_t::reset() {
+  model.reset();
+  pending.reset();
+  for (int j = 0; j < max_nb_features; j++)
+    weights[j] = 0.;
+  fitted = false;
+  error_sum = 0.;
+  nb_errors = 0;
+}
+
+linear::linear(std::string name)
+: name(name) {
+  check_estimator_name(name);
+  for (int j = 0; j < max_nb_features; j++)
+    shared_weights[j].store(0.);
+  shared_fitted.store(false);
+  util::callback::register_client(this);
+}
+
+void linear::init() {
+  LOG_ESTIM(util::logging::estim_name_event(this, name));
+  locals.for_each([&] (worker_id_t, local_t& local) {
+    local.reset();
+  });
+  shared.reset();
+  shared_fitted.store(false);
+}
+
+void linear::destroy() {
+
+}
+
+void linear::output() {
+  if (! report_errors)
+    return;
+  double error_sum = 0.;
+  long nb_errors = 0;
+  locals.for_each([&] (worker_id_t, local_t& local) {
+    error_sum += local.error_sum;
+    nb_errors += local.nb_errors;
+  });
+  if (nb_errors > 0)
+    printf("estim_error_%s\t%.4lf\n", name.c_str(), error_sum / (double) nb_errors);
+}
+
+cost_type linear::predict_with(const double* weights, const features_type& x) {
+  cost_type t = 0.;
+  for (int j = 0; j < x.nb; j++)
+    t += weights[j] * x.values[j];
+  return t;
+}
+
+cost_type linear::predict_impl(const features_type& x) {
+  if (x.is_tiny())
+    return cost::tiny;
+  local_t& local = locals.mine();
+  cost_type t = 0.;
+  // a local fit needs as many measures as features
+  if (local.fitted && local.model.nb_measures >= x.nb) {
+    t = predict_with(local.weights, x);
+  } else if (shared_fitted.load(std::memory_order_relaxed)) {
+    double weights[max_nb_features];
+    for (int j = 0; j < max_nb_features; j++)
+      weights[j] = shared_weights[j].load(std::memory_order_relaxed);
+    t = predict_with(weights, x);
+  }
+  if (t > 0.)
+    return t;
+  // no fit yet, or one which ignores all the features of x
+  for (int j = 0; j < x.nb; j++)
+    t += cost::pessimistic * x.values[j];
+  return t;
+}
+
+cost_type linear::predict(const features_type& x) {
+  cost_type t = predict_impl(x);
+  LOG_ESTIM(util::logging::estim_predict_event(this, (int64_t) x.values[0], t));
+  return t;
+}
+
+void linear::merge(local_t& local) {
+  std::lock_guard<std::mutex> guard(shared_mutex);
+  shared.add(local.pending);
+  local.pending.reset();
+  double weights[max_nb_features];
+  if (! shared.solve(weights))
+    return;
+  for (int j = 0; j < max_nb_features; j++)
+    shared_weights[j].store(weights[j], std::memory_order_relaxed);
+  shared_fitted.store(true);
+  LOG_CSTS(util::logging::estim_update_event(this, weights[0]));
+  STAT_COUNT(ESTIM_UPDATE);
+}
+
+void linear::report(const features_type& x, double elapsed_ticks) {
+  double elapsed_time = elapsed_ticks / (double) local_ticks_per_microsec;
+  LOG_ESTIM(util::logging::estim_report_event(this, (uint64_t) x.values[0], elapsed_time, 0.));
+  STAT_COUNT(ESTIM_REPORT);
+  local_t& local = locals.mine();
+  if (report_errors && local.fitted && elapsed_time > 0.) {
+    local.error_sum += std::fabs(predict_impl(x) - elapsed_time) / elapsed_time;
+    local.nb_errors++;
+  }
+  local.model.add(x, elapsed_time);
+  local.pending.add(x, elapsed_time);
+  local.fitted = local.model.solve(local.weights);
+  if (local.pending.nb_measures >= merge_period || ! shared_fitted.load(std::memory_order_relaxed))
+    merge(local);
+}
+
 } // end namespace
 } // end namespace
 } // end namespace
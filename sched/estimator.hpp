@@ -11,6 +11,8 @@
 #define _PASL_DATA_ESTIMATOR_H_
 
 #include <string>
+#include <atomic>
+#include <mutex>
 
 #include "perworker.hpp"
 #include "callback.hpp"
@@ -31,8 +33,15 @@ namespace estimator {
  * @}
  */
 
-void init();
+//! `nb_workers` is the number of workers to which learned constants belong
+void init(int nb_workers);
 void destroy();
+
+//! Returns true, and the value in `cst`, if `name` was read by `-read_csts`
+bool get_preloaded_constant(std::string name, double& cst);
+
+//! Adds a constant to the ones written by `-write_csts`
+void record_constant(std::string name, double cst);
   
 /*---------------------------------------------------------------------*/
 /* Complexity representation */
@@ -176,6 +185,16 @@ protected:
   void log_update(cost_type new_cst);
   
   void check();
+
+  // measures of tasks, and relative errors of their predictions
+  class measures_t {
+  public:
+    long nb_reports;
+    double error_sum;
+    long nb_errors;
+    measures_t() : nb_reports(0), error_sum(0.), nb_errors(0) { }
+  };
+  perworker::array<measures_t> measures;
   
 public:
   
@@ -209,10 +228,23 @@ public:
 
 /*---------------------------------------------------------------------*/
 
+//! Number of classes of loads of the machine, see `distributed`
+static constexpr int nb_load_buckets = 8;
+
 /*! \class distributed
  *  \brief A distributed implementation of the estimator which
  *  uses both a shared value and thread-local values.
  *
+ * With `-estim_by_load 1`, the estimator also keeps one constant for
+ * each class of numbers of workers that are active (not looking for
+ * work) when a task is measured: 1, 2, 3-4, 5-8, ... up to 65-128.
+ * A prediction uses the constant of the current load if that constant
+ * is known, and the regular constant otherwise, so that tasks whose
+ * speed depends on the load, e.g. memory-bound loops, get the cutoff
+ * which suits the load. The output then gives the average measured
+ * constant at each load, and the drift of the constant, that is the
+ * ratio of the highest average to the lowest.
+ *
  * @ingroup estimator
  */
 
@@ -224,22 +256,39 @@ private:
   constexpr static const double weighted_average_factor = 8.0;
   
   bool init_constant_provided_flg;
+
+  // constants by class of load
+  class load_csts_t {
+  public:
+    cost_type csts[nb_load_buckets];
+    // sum and number of the constants measured at each load
+    double measured_sum[nb_load_buckets];
+    long nb_measured[nb_load_buckets];
+    load_csts_t();
+  };
   
 public: //! \todo find a better way to avoid false sharing
   volatile int padding1[64*2];
   cost_type shared_cst;
   perworker::cell<cost_type> private_csts;
+  // allocated only with `-estim_by_load 1`
+  perworker::array<load_csts_t>* load_csts;
+  cost_type shared_load_csts[nb_load_buckets];
   
 protected:
   void update(cost_type new_cst);
   void analyse(cost_type measured_cst);
+  void analyse_load(cost_type measured_cst);
   cost_type get_constant();
+  cost_type get_regular_constant();
+  cost_type get_load_constant(int bucket);
   void update_shared(cost_type new_cst);
+  void output_load();
   
 public:
   distributed(std::string name)
-  : init_constant_provided_flg(false), private_csts(cost::undefined),
-    common(name) {
+  : common(name), init_constant_provided_flg(false),
+    private_csts(cost::undefined), load_csts(nullptr) {
     util::callback::register_client(this);
   }
   void init();
@@ -249,7 +298,127 @@ public:
   bool init_constant_provided();
   bool constant_is_known();
 };
-  
+
+/*---------------------------------------------------------------------*/
+/* Multi-variable estimator */
+
+//! Maximal number of features of a `linear` estimator
+static constexpr int max_nb_features = 4;
+
+/*! \class features_type
+ *  \brief Complexity of a task as a vector of features, e.g.,
+ *  `features_type(n, m)` for a task on `n` vertices and `m` edges.
+ */
+class features_type {
+public:
+  //! number of features, or `complexity::tiny` to force sequential execution
+  int nb;
+  double values[max_nb_features];
+
+  features_type() : nb(0) { }
+
+  template <class... Values>
+  features_type(Values... vs) : nb((int) sizeof...(vs)) {
+    static_assert(sizeof...(vs) <= max_nb_features, "too many features");
+    double tmp[] = { (double) vs... };
+    for (int j = 0; j < max_nb_features; j++)
+      values[j] = (j < nb) ? tmp[j] : 0.;
+  }
+
+  static features_type tiny() {
+    features_type x;
+    x.nb = (int) complexity::tiny;
+    return x;
+  }
+
+  bool is_tiny() const {
+    return nb == (int) complexity::tiny;
+  }
+};
+
+/*! \class linear
+ *  \brief An estimator which predicts the execution time of a task
+ *  as a linear combination of the features of the task.
+ *
+ * Each worker fits the weights of the combination to its own measures
+ * by least squares, relative to the measured times, with the weights
+ * constrained to be nonnegative. Every `merge_period` measures, a
+ * worker merges its new measures into a shared model, which is used
+ * by the workers that do not have enough measures of their own yet.
+ * Features that are never nonzero get a weight of zero; a constant
+ * feature of 1 accounts for a fixed cost per task.
+ *
+ * @ingroup estimator
+ */
+class linear : public util::callback::client {
+private:
+  static constexpr int merge_period = 8;
+
+  // normal equations of the weighted least-squares problem
+  class normal_t {
+  public:
+    double a[max_nb_features][max_nb_features];
+    double b[max_nb_features];
+    long nb_measures;
+    normal_t() {
+      reset();
+    }
+    void reset();
+    void add(const features_type& x, double time);
+    void add(const normal_t& other);
+    //! Solves for nonnegative weights; returns false if the fit is empty
+    bool solve(double* weights) const;
+  };
+
+  class local_t {
+  public:
+    normal_t model;
+    // measures not yet merged into the shared model
+    normal_t pending;
+    double weights[max_nb_features];
+    bool fitted;
+    // sum of the relative errors of the predictions of measured tasks
+    double error_sum;
+    long nb_errors;
+    local_t() {
+      reset();
+    }
+    void reset();
+  };
+
+  std::string name;
+  perworker::array<local_t> locals;
+  std::mutex shared_mutex;
+  normal_t shared;
+  std::atomic<double> shared_weights[max_nb_features];
+  std::atomic<bool> shared_fitted;
+
+  cost_type predict_with(const double* weights, const features_type& x);
+  cost_type predict_impl(const features_type& x);
+  void merge(local_t& local);
+
+public:
+
+  linear(std::string name);
+
+  void init();
+  void destroy();
+  void output();
+
+  std::string get_name() {
+    return name;
+  }
+
+  //! Predicts the execution time of a task, in microseconds
+  cost_type predict(const features_type& x);
+
+  /*! \brief Adds to the model a measurement of a task execution.
+   *  \param x the features of the task
+   *  \param elapsed_ticks the number of ticks taken by the execution
+   */
+  void report(const features_type& x, double elapsed_ticks);
+};
+
 } // end namespace
 } // end namespace
   
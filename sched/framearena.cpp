@@ -0,0 +1,43 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file framearena.cpp
+ *
+ */
+
+#include "framearena.hpp"
+#include "alloc.hpp"
+#include "cmdline.hpp"
+
+namespace pasl {
+namespace sched {
+namespace framearena {
+
+/***********************************************************************/
+
+static bool enabled = false;
+
+/*---------------------------------------------------------------------*/
+
+void init() {
+  enabled = util::cmdline::parse_or_default_bool("frame_arena", true, false);
+}
+
+void destroy() {
+  enabled = false;
+}
+
+void* alloc(size_t szb) {
+  return enabled ? pasl::alloc::malloc(szb) : pasl::alloc::global_malloc(szb);
+}
+
+void dealloc(void* p) {
+  pasl::alloc::free(p);
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
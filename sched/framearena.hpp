@@ -0,0 +1,51 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file framearena.hpp
+ * \brief Per-worker arenas for thread objects
+ *
+ */
+
+#ifndef _PASL_SCHED_FRAMEARENA_H_
+#define _PASL_SCHED_FRAMEARENA_H_
+
+#include <cstddef>
+
+/***********************************************************************/
+
+namespace pasl {
+namespace sched {
+namespace framearena {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * Thread objects (e.g., the two `multishot_by_lambda` objects created
+ * by each call to `native::fork2`) are allocated from the heap of the
+ * calling worker in the worker-local allocator (see alloc.hpp), so
+ * that the allocation and deallocation of a thread by the same worker
+ * never call `malloc`, and a thread deallocated by another worker
+ * (e.g., after a steal) is returned to its owner in batches.
+ *
+ * With `-frame_arena 0`, thread objects are handled by the global
+ * heap.
+ *
+ * The memory of the heaps is returned to the system by
+ * `alloc::destroy()`, which `threaddag::destroy()` calls right after
+ * `destroy()`.
+ */
+
+void init();
+void destroy();
+
+void* alloc(size_t szb);
+void dealloc(void* p);
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+/***********************************************************************/
+
+#endif /*! _PASL_SCHED_FRAMEARENA_H_ */
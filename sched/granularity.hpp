@@ -9,6 +9,7 @@
 
 #include "native.hpp"
 #include "estimator.hpp"
+#include "polling.hpp"
 
 #ifndef _PASL_SCHED_GRANULARITY_H_
 #define _PASL_SCHED_GRANULARITY_H_
@@ -28,6 +29,8 @@ void todo() {
 
 using cmeasure_type = data::estimator::complexity_type;
 using estimator_type = data::estimator::distributed;
+using features_type = data::estimator::features_type;
+using multi_estimator_type = data::estimator::linear;
 
 class control {};
 
@@ -58,6 +61,23 @@ public:
   }
 };
 
+/* predicts from several features of the tasks; the complexity
+ * function passed to `cstmt` returns a `features_type`
+ */
+class control_by_prediction_multi : public control {
+public:
+  multi_estimator_type estimator;
+
+  control_by_prediction_multi(std::string name = ""): estimator(name) { }
+
+  multi_estimator_type& get_estimator() {
+    return estimator;
+  }
+  void set(std::string policy_arg) {
+    ;
+  }
+};
+
 class control_by_cmdline : public control {
 public:
   using policy_type = enum {
@@ -168,6 +188,22 @@ void cstmt_parallel(execmode_type c, const Body_fct& body_fct) {
   execmode.mine().block(c, body_fct);
 }
   
+// `report_fct(elapsed)` reports the number of ticks taken by the body
+template <class Seq_body_fct, class Report_fct>
+void cstmt_sequential_measured(Seq_body_fct& seq_body_fct,
+                               const Report_fct& report_fct) {
+  polling::poll();
+  STAT_IDLE_ONLY(util::perfcounters::sample_t perf_start;
+                 bool perf_measured = util::perfcounters::read_mine(perf_start));
+  cost_type start = util::ticks::now();
+  execmode.mine().block(Sequential, seq_body_fct);
+  cost_type elapsed = util::ticks::since(start);
+  STAT_IDLE_ONLY(if (perf_measured) util::stats::the_stats.add_to_sequential_perf(perf_start));
+  report_fct(elapsed);
+  STAT_COUNT(MEASURED_RUN);
+  polling::poll();
+}
+
 template <class Seq_body_fct>
 void cstmt_sequential_with_reporting(cmeasure_type m,
                                      Seq_body_fct& seq_body_fct,
@@ -175,11 +211,23 @@ void cstmt_sequential_with_reporting(cmeasure_type m,
 
   if (m < 0)
     pasl::util::atomic::fatal([] { std::cout << "error" << std::endl; });
-  cost_type start = util::ticks::now();
-  execmode.mine().block(Sequential, seq_body_fct);
-  cost_type elapsed = util::ticks::since(start);
-  estimator.report(std::max(1l, m), elapsed);
-  STAT_COUNT(MEASURED_RUN);
+  cstmt_sequential_measured(seq_body_fct, [&] (cost_type elapsed) {
+    estimator.report(std::max(1l, m), elapsed);
+  });
+}
+
+template <class Seq_body_fct>
+void cstmt_sequential_with_reporting(const features_type& x,
+                                     Seq_body_fct& seq_body_fct,
+                                     multi_estimator_type& estimator) {
+  if (x.is_tiny()) {
+    // tiny tasks are not measured
+    cstmt_sequential(Sequential, seq_body_fct);
+    return;
+  }
+  cstmt_sequential_measured(seq_body_fct, [&] (cost_type elapsed) {
+    estimator.report(x, elapsed);
+  });
 }
 template <
 class Complexity_measure_fct,
@@ -286,6 +334,46 @@ void cstmt(control_by_prediction& contr,
   cstmt(contr, complexity_measure_fct, par_body_fct, seq_body_fct);
 }
 
+template <
+class Features_fct,
+class Par_body_fct,
+class Seq_body_fct
+>
+void cstmt(control_by_prediction_multi& contr,
+           const Features_fct& features_fct,
+           const Par_body_fct& par_body_fct,
+           const Seq_body_fct& seq_body_fct) {
+#ifdef SEQUENTIAL_BASELINE
+  seq_body_fct();
+  return;
+#endif
+#ifdef SEQUENTIAL_ELISION
+  par_body_fct();
+  return;
+#endif
+  multi_estimator_type& estimator = contr.get_estimator();
+  features_type x = features_fct();
+  execmode_type c;
+  if (x.is_tiny())
+    c = Sequential;
+  else
+    c = (estimator.predict(x) <= kappa) ? Sequential : Parallel;
+  if (c == Sequential)
+    cstmt_sequential_with_reporting(x, seq_body_fct, estimator);
+  else
+    cstmt_parallel(c, par_body_fct);
+}
+
+template <
+class Features_fct,
+class Par_body_fct
+>
+void cstmt(control_by_prediction_multi& contr,
+           const Features_fct& features_fct,
+           const Par_body_fct& par_body_fct) {
+  cstmt(contr, features_fct, par_body_fct, par_body_fct);
+}
+
 template <
 class Cutoff_fct,
 class Complexity_measure_fct,
@@ -368,8 +456,8 @@ void parallel_for(loop_by_eager_binary_splitting<Granularity_control_policy>& lp
                   const Loop_complexity_measure_fct& loop_compl_fct,
                   Number lo, Number hi, const Body& body) {
   auto seq_fct = [&] {
-    for (Number i = lo; i < hi; i++)
-      body(i);
+    // checks for steal requests every so many iterations
+    polling::for_each(lo, hi, body);
   };
   if (hi - lo < 2) {
     seq_fct();
@@ -395,6 +483,105 @@ void parallel_for(loop_by_eager_binary_splitting<Granularity_control_policy>& lp
   auto loop_compl_fct = [] (Number lo, Number hi) { return hi-lo; };
   parallel_for(lpalgo, loop_compl_fct, lo, hi, body);
 }
+
+/* Lazy binary splitting (Tzannes et al.): a loop that is predicted to
+ * be worth running in parallel runs its iterations by batches, as the
+ * loops of `polling::for_each` do, and splits its remaining range in
+ * two halves only when, between two batches, the deque of the worker
+ * is empty or a steal request is pending. When all the workers are
+ * busy, the deques are not empty, and the loop costs hardly more than
+ * a sequential one.
+ */
+template <class Granularity_control_policy>
+class loop_by_lazy_binary_splitting {
+public:
+  Granularity_control_policy gcpolicy;
+
+  loop_by_lazy_binary_splitting(std::string name = "anonloop"): gcpolicy(name) {}
+
+  void initialize(double init_cst) {
+    gcpolicy.initialize(init_cst);
+  }
+  void set(std::string policy_arg) {
+    gcpolicy.set(policy_arg);
+  }
+};
+
+// returns true if the calling worker has nothing that others may steal
+static inline bool lazy_split_needed() {
+#if defined(SEQUENTIAL_ELISION) || defined(SEQUENTIAL_BASELINE)
+  return false;
+#elif defined(USE_CILK_RUNTIME) && ! defined(__PASL_CILK_EXT)
+  // the deque is out of reach: splits at each batch
+  return true;
+#elif defined(USE_CILK_RUNTIME)
+  return native::my_deque_size() == 0;
+#else
+  return native::my_deque_size() == 0
+      || threaddag::my_sched()->has_pending_request();
+#endif
+}
+
+template <class Number, class Body>
+void lazy_binary_splitting(Number lo, Number hi, const Body& body) {
+  Number i = lo;
+  while (i < hi) {
+    if (hi - i > 1 && lazy_split_needed()) {
+      Number mid = i + (hi - i) / 2;
+      // the branches refer to `i`, `mid` and `hi` of this frame, which
+      // outlives them since `fork2` returns only after both complete
+      fork2([&] { lazy_binary_splitting(i, mid, body); },
+            [&] { lazy_binary_splitting(mid, hi, body); });
+      return;
+    }
+    // the body may fork: the loop may resume on another worker
+    long n = polling::nb_iters.mine();
+    Number last = (hi - i > (Number)n) ? i + (Number)n : hi;
+    bool full = (last - i == (Number)n);
+    util::ticks::ticks_t start = util::ticks::now();
+    for (Number j = i; j < last; j++)
+      body(j);
+    i = last;
+    if (full)
+      polling::nb_iters.mine() = polling::next_nb_iters(n, (uint64_t)(util::ticks::now() - start));
+    polling::poll();
+  }
+}
+
+template <
+  class Granularity_control_policy,
+  class Loop_complexity_measure_fct,
+  class Number,
+  class Body
+>
+void parallel_for(loop_by_lazy_binary_splitting<Granularity_control_policy>& lpalgo,
+                  const Loop_complexity_measure_fct& loop_compl_fct,
+                  Number lo, Number hi, const Body& body) {
+  auto seq_fct = [&] {
+    polling::for_each(lo, hi, body);
+  };
+  if (hi - lo < 2) {
+    seq_fct();
+  } else {
+    auto compl_fct = [&] {
+      return loop_compl_fct(lo, hi);
+    };
+    cstmt(lpalgo.gcpolicy, compl_fct,
+          [&] { lazy_binary_splitting(lo, hi, body); },
+          seq_fct);
+  }
+}
+
+template <
+  class Granularity_control_policy,
+  class Number,
+  class Body
+>
+void parallel_for(loop_by_lazy_binary_splitting<Granularity_control_policy>& lpalgo,
+                  Number lo, Number hi, const Body& body) {
+  auto loop_compl_fct = [] (Number lo, Number hi) { return hi-lo; };
+  parallel_for(lpalgo, loop_compl_fct, lo, hi, body);
+}
  
   //! \todo find a better place for this function
 template <class T>
@@ -0,0 +1,36 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file heartbeat.cpp
+ *
+ */
+
+#include "heartbeat.hpp"
+#include "cmdline.hpp"
+
+namespace pasl {
+namespace sched {
+namespace heartbeat {
+
+/***********************************************************************/
+
+bool enabled = false;
+double period_us = 100.;
+data::perworker::array<util::ticks::ticks_t> last_beat;
+
+void enable() {
+  enabled = true;
+  period_us = util::cmdline::parse_or_default_double("heartbeat_us", 100., false);
+  last_beat.init(util::ticks::now());
+}
+
+void destroy() {
+  enabled = false;
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
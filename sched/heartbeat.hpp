@@ -0,0 +1,72 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file heartbeat.hpp
+ * \brief Heartbeat scheduling: promotion of latent forks on a period
+ *
+ */
+
+#ifndef _PASL_SCHED_HEARTBEAT_H_
+#define _PASL_SCHED_HEARTBEAT_H_
+
+#include "worker.hpp"
+#include "perworker.hpp"
+#include "ticks.hpp"
+
+/***********************************************************************/
+
+namespace pasl {
+namespace sched {
+namespace heartbeat {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * In heartbeat mode, `fork2` creates no thread and exposes nothing to
+ * thieves: it records its right branch as a latent fork of the
+ * calling thread, runs its left branch, and then, most of the time,
+ * runs its right branch as an ordinary function call.
+ *
+ * Every `-heartbeat_us` microseconds (default 100), the worker that
+ * executes a `fork2` promotes the oldest latent fork of its current
+ * thread: the descriptor of the fork is pushed on the deque of the
+ * worker, from which thieves may take it, exactly as with a lazy
+ * `fork2` (see native.hpp). Since each promotion costs about one
+ * thread creation, and since promotions happen at most once per
+ * heartbeat, the scheduling overhead is bounded by a fixed fraction
+ * of the running time, whatever the granularity of the program.
+ * Promoting the oldest fork, which is the closest to the root of the
+ * computation, exposes the largest amount of parallelism.
+ *
+ * The mode is selected by `-threadset heartbeat`, which uses the
+ * deques and the steal protocol of `cas_ri`.
+ */
+
+extern bool enabled;
+extern double period_us;
+// date of the last promotion, for each worker
+extern data::perworker::array<util::ticks::ticks_t> last_beat;
+
+//! Turns on heartbeat mode; to be called before the workers are created
+void enable();
+void destroy();
+
+/*! \brief Returns true, once per heartbeat, if the calling worker
+ *  must promote a latent fork
+ */
+static inline bool beat() {
+  util::ticks::ticks_t& last = last_beat.mine();
+  if (util::ticks::microseconds_since(last) < period_us)
+    return false;
+  last = util::ticks::now();
+  return true;
+}
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+/***********************************************************************/
+
+#endif /*! _PASL_SCHED_HEARTBEAT_H_ */
@@ -0,0 +1,300 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file idle.cpp
+ *
+ */
+
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "idle.hpp"
+#include "machine.hpp"
+#include "microtime.hpp"
+#include "ticks.hpp"
+#include "perworker.hpp"
+#include "cmdline.hpp"
+#include "atomic.hpp"
+#include "stats.hpp"
+
+namespace pasl {
+namespace sched {
+namespace idle {
+
+/***********************************************************************/
+
+typedef enum { AWAKE = 0, PARKED = 1 } state_t;
+
+typedef util::microtime::microtime_t microtime_t;
+typedef util::machine::node_id_t node_id_t;
+
+class worker_t {
+public:
+
+  // written by the owner when it parks, and by notifiers to claim it
+  std::atomic<int> state;
+  // number of notifications issued by the worker, written by the owner
+  std::atomic<unsigned long> nb_notices;
+
+  // owned by the worker: sum of the notices when it entered the search
+  unsigned long notices_seen;
+
+  // owned by the worker
+  node_id_t node;
+  double spin_budget;
+  microtime_t date_enter_spin;
+
+  worker_t()
+    : state(AWAKE), nb_notices(0), notices_seen(0),
+      node(0), spin_budget(0.), date_enter_spin(0) { }
+
+};
+
+class node_t {
+public:
+
+  std::atomic<int> nb_parked;
+  char padding[64];
+  std::vector<worker_id_t> workers;
+
+  node_t() : nb_parked(0) { }
+
+};
+
+static bool enabled = false;
+static bool counting_active = false;
+// number of workers between `enter()` and `exit()`
+static std::atomic<int> nb_searching(0);
+// notifications issued by threads which are not workers
+static std::atomic<unsigned long> nb_external_notices(0);
+static double spin_budget_init;
+static double spin_budget_min;
+static double spin_budget_max;
+static long park_timeout_us;
+static int nb_nodes = 0;
+static node_t* nodes = nullptr;
+static data::perworker::array<worker_t> workers;
+
+/*---------------------------------------------------------------------*/
+
+static void futex_wait(std::atomic<int>* addr, int val, long timeout_us) {
+  struct timespec ts;
+  ts.tv_sec = timeout_us / 1000000;
+  ts.tv_nsec = (timeout_us % 1000000) * 1000;
+  syscall(SYS_futex, (int*)addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+static void futex_wake(std::atomic<int>* addr) {
+  syscall(SYS_futex, (int*)addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/*---------------------------------------------------------------------*/
+
+void init() {
+  std::string mode = util::cmdline::parse_or_default_string("idle", "park", false);
+  if (mode == "park")
+    enabled = true;
+  else if (mode == "spin")
+    enabled = false;
+  else
+    util::atomic::die("bad value for -idle: %s\n", mode.c_str());
+  spin_budget_init = util::cmdline::parse_or_default_double("idle_spin_us", 100., false);
+  spin_budget_min = spin_budget_init / 8.;
+  spin_budget_max = spin_budget_init * 8.;
+  park_timeout_us = util::cmdline::parse_or_default_int("idle_park_us", 1000, false);
+  nb_searching.store(0);
+  if (! enabled)
+    return;
+  int nb_workers = util::worker::get_nb();
+  nb_nodes = std::max(1, util::machine::the_numa.get_nb_nodes());
+  nodes = new node_t[nb_nodes];
+  for (worker_id_t id = 0; id < nb_workers; id++) {
+    node_id_t node = util::machine::the_numa.node_of_worker(id);
+    if (node < 0 || node >= nb_nodes)
+      node = 0;
+    nodes[node].workers.push_back(id);
+    workers[id].node = node;
+    workers[id].spin_budget = spin_budget_init;
+    workers[id].state.store(AWAKE);
+    workers[id].nb_notices.store(0);
+  }
+  nb_external_notices.store(0);
+}
+
+void destroy() {
+  if (! enabled)
+    return;
+  enabled = false;
+  delete [] nodes;
+  nodes = nullptr;
+  nb_nodes = 0;
+}
+
+/*---------------------------------------------------------------------*/
+
+void count_active_workers() {
+  counting_active = true;
+}
+
+int nb_active_workers() {
+  int nb_workers = util::worker::get_nb();
+  if (! counting_active)
+    return nb_workers;
+  return std::max(1, nb_workers - nb_searching.load(std::memory_order_relaxed));
+}
+
+/*---------------------------------------------------------------------*/
+
+/* The notices form an eventcount, distributed over the workers.
+ *
+ * A notifier publishes its work, then counts a notice and executes a
+ * full fence before it looks for parked workers. A worker takes a
+ * snapshot of the notices when it starts looking for work, that is,
+ * before its steal attempts; to park, it registers as parked, executes
+ * a full fence, and compares the notices with its snapshot. Either the
+ * notifier sees the registration and claims a parked worker, or the
+ * worker sees the notice and goes back to stealing instead of parking.
+ */
+
+static unsigned long sum_of_notices() {
+  unsigned long nb = nb_external_notices.load(std::memory_order_acquire);
+  int nb_workers = util::worker::get_nb();
+  for (worker_id_t id = 0; id < nb_workers; id++)
+    nb += workers[id].nb_notices.load(std::memory_order_acquire);
+  return nb;
+}
+
+static void count_notice() {
+  worker_id_t my_id = util::worker::the_group.get_my_id_or_undef();
+  if (my_id == util::worker::undef) {
+    nb_external_notices.fetch_add(1, std::memory_order_release);
+  } else {
+    std::atomic<unsigned long>& n = workers[my_id].nb_notices;
+    n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+/*---------------------------------------------------------------------*/
+
+void enter() {
+  worker_t& w = workers.mine();
+  w.date_enter_spin = util::microtime::now();
+  if (enabled)
+    w.notices_seen = sum_of_notices();
+  if (counting_active)
+    nb_searching++;
+}
+
+// returns true if the caller has used up its spin budget and may park
+static bool spin_phase_over(worker_t& w, bool may_park) {
+  if (! enabled || ! may_park)
+    return false;
+  double elapsed = (double)util::microtime::since(w.date_enter_spin);
+  return elapsed >= w.spin_budget;
+}
+
+static void park(worker_t& w) {
+  microtime_t date_park = util::microtime::now();
+  STAT_IDLE(add_to_spinning_time(util::microtime::seconds(util::microtime::diff(w.date_enter_spin, date_park))));
+  w.spin_budget = std::max(spin_budget_min, w.spin_budget / 2.);
+  node_t& node = nodes[w.node];
+  w.state.store(PARKED);
+  node.nb_parked++;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  unsigned long notices = sum_of_notices();
+  // sleeps only if no notice was counted since the snapshot; a later
+  // notifier sees the registration and wakes this worker up
+  if (notices == w.notices_seen)
+    futex_wait(&w.state, PARKED, park_timeout_us);
+  w.notices_seen = notices;
+  int s = PARKED;
+  // if no notifier claimed this worker, retracts its registration
+  if (w.state.compare_exchange_strong(s, AWAKE))
+    node.nb_parked--;
+  w.date_enter_spin = util::microtime::now();
+  STAT_IDLE(add_to_parked_time(util::microtime::seconds(util::microtime::diff(date_park, w.date_enter_spin))));
+}
+
+void pause(bool may_park) {
+  worker_t& w = workers.mine();
+  if (spin_phase_over(w, may_park))
+    park(w);
+  else
+    util::ticks::microseconds_sleep(1);
+}
+
+void exit(bool found) {
+  worker_t& w = workers.mine();
+  if (counting_active)
+    nb_searching--;
+  microtime_t elapsed = util::microtime::since(w.date_enter_spin);
+  STAT_IDLE(add_to_spinning_time(util::microtime::seconds(elapsed)));
+  if (enabled && found && (double)elapsed > w.spin_budget / 2.)
+    w.spin_budget = std::min(spin_budget_max, w.spin_budget * 2.);
+}
+
+/*---------------------------------------------------------------------*/
+
+static bool claim(worker_id_t id) {
+  worker_t& w = workers[id];
+  int s = PARKED;
+  if (w.state.load() != PARKED || ! w.state.compare_exchange_strong(s, AWAKE))
+    return false;
+  nodes[w.node].nb_parked--;
+  futex_wake(&w.state);
+  return true;
+}
+
+static bool notify_in_node(node_id_t node, worker_id_t start) {
+  node_t& n = nodes[node];
+  if (n.nb_parked.load() == 0)
+    return false;
+  size_t nb = n.workers.size();
+  for (size_t k = 0; k < nb; k++)
+    if (claim(n.workers[(start + k) % nb]))
+      return true;
+  return false;
+}
+
+void notify_one() {
+  if (! enabled)
+    return;
+  count_notice();
+  worker_id_t my_id = util::worker::the_group.get_my_id_or_undef();
+  node_id_t my_node = (my_id == util::worker::undef) ? 0 : workers[my_id].node;
+  worker_id_t start = (my_id == util::worker::undef) ? 0 : my_id + 1;
+  if (notify_in_node(my_node, start))
+    return;
+  for (node_id_t k = 1; k < nb_nodes; k++)
+    if (notify_in_node((my_node + k) % nb_nodes, start))
+      return;
+}
+
+void notify(worker_id_t id) {
+  if (! enabled)
+    return;
+  count_notice();
+  claim(id);
+}
+
+void notify_all() {
+  if (! enabled)
+    return;
+  count_notice();
+  int nb_workers = util::worker::get_nb();
+  for (worker_id_t id = 0; id < nb_workers; id++)
+    claim(id);
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
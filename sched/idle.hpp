@@ -0,0 +1,93 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file idle.hpp
+ * \brief Spin-then-park idling for workers that run out of work
+ *
+ */
+
+#ifndef _PASL_SCHED_IDLE_H_
+#define _PASL_SCHED_IDLE_H_
+
+#include "worker.hpp"
+
+/***********************************************************************/
+
+namespace pasl {
+namespace sched {
+namespace idle {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * A worker that fails to obtain work first spins, polling for work
+ * as the scheduler always did, for an adaptive amount of time. When
+ * this spin budget runs out, the worker parks: it sleeps in the kernel
+ * on a futex until another worker wakes it up, or until a timeout
+ * expires.
+ *
+ * Each worker owns a futex word, which is either `AWAKE` or `PARKED`,
+ * and the workers are grouped by NUMA node, each node counting its
+ * parked workers. A worker that makes work available calls
+ * `notify_one()`, which, when some worker is parked, claims exactly
+ * one parked worker (of the node of the caller if possible) by
+ * switching its word back to `AWAKE` and wakes it. When no worker is
+ * parked, `notify_one()` costs one load.
+ *
+ * Each notification is counted. A worker parks only if no
+ * notification was counted since it started looking for work (or
+ * since it last woke up); otherwise, it spins again. Together with
+ * the fences executed on both sides, this ensures that work published
+ * before a notification is never left to a parked worker. Parking is
+ * nevertheless bounded by `-idle_park_us` microseconds, for work
+ * published without a notification.
+ *
+ * The spin budget starts at `-idle_spin_us` microseconds. It doubles
+ * (up to 8 times the initial value) when work is found late in the
+ * spin phase, and halves (down to 1/8 of the initial value) each time
+ * the worker parks.
+ *
+ * The mode is selected by the command line:
+ * - `-idle park` (default): spin then park, as described above;
+ * - `-idle spin`: spin, as long as needed.
+ */
+
+void init();
+void destroy();
+
+/*! \brief Makes the module count the workers looking for work, which
+ *  costs an atomic update on a shared counter each time a worker starts
+ *  or stops looking for work; to be called before `init`
+ */
+void count_active_workers();
+
+/*! \brief Number of workers not looking for work (at least one), or
+ *  the number of workers if they are not counted
+ */
+int nb_active_workers();
+
+//! Called by a worker which starts looking for work
+void enter();
+/*! \brief Called by a worker after each failed attempt to obtain work
+ *  \param may_park false if the worker must keep polling (e.g., it
+ *  has periodic checks to run)
+ */
+void pause(bool may_park);
+//! Called by a worker which stops looking for work
+void exit(bool found);
+
+//! Wakes up one parked worker, if any
+void notify_one();
+//! Wakes up the worker `id`, if it is parked
+void notify(worker_id_t id);
+//! Wakes up all the parked workers
+void notify_all();
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+/***********************************************************************/
+
+#endif /*! _PASL_SCHED_IDLE_H_ */
@@ -0,0 +1,119 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file injection.cpp
+ *
+ */
+
+#include <atomic>
+#include <algorithm>
+
+#include "injection.hpp"
+#include "threaddag.hpp"
+#include "machine.hpp"
+#include "worker.hpp"
+#include "stats.hpp"
+
+namespace pasl {
+namespace sched {
+namespace injection {
+
+/***********************************************************************/
+
+typedef util::machine::node_id_t node_id_t;
+
+typedef struct item_s {
+  thread_p thread;
+  struct item_s* next;
+} item_t;
+
+typedef item_t* item_p;
+
+class queue_t {
+public:
+
+  std::atomic<item_p> head;
+  char padding[64];
+
+  queue_t() : head(nullptr) { }
+
+};
+
+static int nb_nodes = 0;
+static queue_t* queues = nullptr;
+// node that receives the next thread submitted from outside the group
+static std::atomic<unsigned> next_node;
+
+/*---------------------------------------------------------------------*/
+
+static node_id_t node_of_worker(worker_id_t id) {
+  node_id_t node = util::machine::the_numa.node_of_worker(id);
+  return (node < 0 || node >= nb_nodes) ? 0 : node;
+}
+
+void init() {
+  nb_nodes = std::max(1, util::machine::the_numa.get_nb_nodes());
+  queues = new queue_t[nb_nodes];
+  next_node.store(0);
+}
+
+void destroy() {
+  // threads still in the queues were never run; only the items are freed
+  for (int node = 0; node < nb_nodes; node++) {
+    item_p item = queues[node].head.exchange(nullptr);
+    while (item != nullptr) {
+      item_p next = item->next;
+      delete item;
+      item = next;
+    }
+  }
+  delete [] queues;
+  queues = nullptr;
+  nb_nodes = 0;
+}
+
+void push(thread_p t) {
+  worker_id_t my_id = util::worker::get_my_id();
+  node_id_t node = (my_id == util::worker::undef)
+    ? (node_id_t)(next_node++ % nb_nodes)
+    : node_of_worker(my_id);
+  queue_t& queue = queues[node];
+  item_p item = new item_t;
+  item->thread = t;
+  item_p head = queue.head.load();
+  do {
+    item->next = head;
+  } while (! queue.head.compare_exchange_weak(head, item));
+}
+
+// the last thread added is the oldest one, so that the worker runs it first
+static bool poll_queue(queue_t& queue) {
+  if (queue.head.load(std::memory_order_relaxed) == nullptr)
+    return false;
+  item_p item = queue.head.exchange(nullptr);
+  if (item == nullptr)
+    return false;
+  while (item != nullptr) {
+    item_p next = item->next;
+    STAT_COUNT(THREAD_INJECT);
+    threaddag::add_thread(item->thread);
+    delete item;
+    item = next;
+  }
+  return true;
+}
+
+bool poll() {
+  node_id_t my_node = node_of_worker(util::worker::get_my_id());
+  for (int k = 0; k < nb_nodes; k++)
+    if (poll_queue(queues[(my_node + k) % nb_nodes]))
+      return true;
+  return false;
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
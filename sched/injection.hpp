@@ -0,0 +1,59 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file injection.hpp
+ * \brief Queues of threads submitted from outside the worker group
+ *
+ */
+
+#ifndef _PASL_SCHED_INJECTION_H_
+#define _PASL_SCHED_INJECTION_H_
+
+#include "classes.hpp"
+
+/***********************************************************************/
+
+namespace pasl {
+namespace sched {
+namespace injection {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * Threads submitted by `threaddag::submit` go to one injection queue
+ * per NUMA node: the queue of the node of the calling worker, or, for
+ * a thread which is not a worker, the queues of all the nodes in
+ * turn.
+ *
+ * Each queue is a lock-free stack to which any number of threads may
+ * push. A worker which runs out of work polls the queue of its node,
+ * then the ones of the other nodes; it takes all the threads of a
+ * queue at once, with a single atomic exchange, and adds them to its
+ * own ready threads, from which the other workers may steal them.
+ * Polling an empty queue costs one load.
+ *
+ * Only workers which are in their scheduling loop poll the queues:
+ * between two launches, worker 0 (the main thread) does not, so the
+ * submitted threads are run by the other workers.
+ */
+
+void init();
+void destroy();
+
+//! Pushes a ready thread; may be called by any thread
+void push(thread_p t);
+
+/*! \brief Adds the threads found in the injection queues to the
+ *  ready threads of the calling worker
+ *  \return true if some thread was found
+ */
+bool poll();
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+/***********************************************************************/
+
+#endif /*! _PASL_SCHED_INJECTION_H_ */
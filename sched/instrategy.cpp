@@ -7,16 +7,220 @@
  */
 
 #include <set>
+#include <vector>
+#include <new>
 #include <iostream>
+#include <stdlib.h>
 
 #include "instrategy.hpp"
+#include "worker.hpp"
+#include "cmdline.hpp"
 
 namespace pasl {
 namespace sched {
 namespace instrategy {
 
 /***********************************************************************/
-  
+
+/*---------------------------------------------------------------------*/
+/* SNZI */
+
+// a node word packs twice the surplus of the node in its high half,
+// so that the intermediate state is 1, and a version number in its
+// low half
+static inline uint64_t snzi_word(uint64_t halves, uint64_t version) {
+  return (halves << 32) | (version & 0xffffffffull);
+}
+
+static inline uint64_t snzi_halves(uint64_t x) {
+  return x >> 32;
+}
+
+static inline uint64_t snzi_version(uint64_t x) {
+  return x & 0xffffffffull;
+}
+
+// number of leaves of the trees, set by `init_pool`
+static int nb_leaves_of_trees = 1;
+// maximum number of trees cached by one worker
+static size_t nb_max_trees;
+// trees that are not in use, by worker that released them
+static data::perworker::extra<std::vector<void*>> free_trees;
+
+void snzi::init_pool() {
+  nb_leaves_of_trees = 1;
+  while (nb_leaves_of_trees < util::worker::get_nb())
+    nb_leaves_of_trees *= 2;
+  nb_max_trees = (size_t)util::cmdline::parse_or_default_int("snzi_pool_max", 64, false);
+}
+
+void snzi::destroy_pool() {
+  free_trees.for_each([] (worker_id_t, std::vector<void*>& trees) {
+    for (size_t i = 0; i < trees.size(); i++)
+      free(trees[i]);
+    trees.clear();
+  });
+}
+
+/* The nodes of a tree whose counter dropped to zero all have a zero
+ * surplus, so that a cached tree is reused as is. The cache of the
+ * undefined worker is shared by all outside threads, and is thus left
+ * unused. */
+snzi::node_t* snzi::alloc_tree() {
+  if (util::worker::get_my_id() != util::worker::undef) {
+    std::vector<void*>& trees = free_trees.mine();
+    if (! trees.empty()) {
+      node_t* nodes = (node_t*)trees.back();
+      trees.pop_back();
+      return nodes;
+    }
+  }
+  // a plain `new` does not align on cache lines before C++17
+  void* p;
+  size_t nb_nodes = 2 * nb_leaves_of_trees;
+  if (posix_memalign(&p, alignof(node_t), nb_nodes * sizeof(node_t)) != 0)
+    throw std::bad_alloc();
+  node_t* nodes = (node_t*)p;
+  for (size_t i = 0; i < nb_nodes; i++)
+    new (&nodes[i]) node_t();
+  return nodes;
+}
+
+void snzi::release_tree(node_t* nodes) {
+  if (util::worker::get_my_id() != util::worker::undef) {
+    std::vector<void*>& trees = free_trees.mine();
+    if (trees.size() < nb_max_trees) {
+      trees.push_back(nodes);
+      return;
+    }
+  }
+  free(nodes);
+}
+
+snzi::snzi() : root(0), nodes(nullptr), nb_leaves(nb_leaves_of_trees) {
+  if (nb_leaves > 1)
+    nodes = alloc_tree();
+}
+
+snzi::~snzi() {
+  if (nodes != nullptr)
+    release_tree(nodes);
+}
+
+int snzi::my_leaf() {
+  worker_id_t my_id = util::worker::get_my_id();
+  if (my_id < 0)
+    my_id = 0;
+  return nb_leaves + (int)(my_id % nb_leaves);
+}
+
+void snzi::arrive(int i) {
+  if (i == 1) {
+    root++;
+    return;
+  }
+  std::atomic<uint64_t>& x = nodes[i].x;
+  bool success = false;
+  int nb_undo = 0;
+  while (! success) {
+    uint64_t v = x.load();
+    if (snzi_halves(v) >= 2) {
+      uint64_t w = snzi_word(snzi_halves(v) + 2, snzi_version(v));
+      if (x.compare_exchange_strong(v, w))
+        success = true;
+      continue;
+    }
+    if (snzi_halves(v) == 0) {
+      uint64_t w = snzi_word(1, snzi_version(v) + 1);
+      if (! x.compare_exchange_strong(v, w))
+        continue;
+      success = true;
+      v = w;
+    }
+    // intermediate state: completes the arrival, possibly on behalf of
+    // another worker
+    arrive(i / 2);
+    if (! x.compare_exchange_strong(v, snzi_word(2, snzi_version(v))))
+      nb_undo++;
+  }
+  // the surplus of the parent is at least one, owing to this node
+  for (; nb_undo > 0; nb_undo--)
+    depart(i / 2);
+}
+
+bool snzi::depart(int i) {
+  if (i == 1)
+    return root.fetch_sub(1) == 1l;
+  std::atomic<uint64_t>& x = nodes[i].x;
+  while (true) {
+    uint64_t v = x.load();
+    assert(snzi_halves(v) >= 2);
+    uint64_t w = snzi_word(snzi_halves(v) - 2, snzi_version(v));
+    if (x.compare_exchange_strong(v, w))
+      return (snzi_halves(v) == 2) ? depart(i / 2) : false;
+  }
+}
+
+snzi::depart_result_t snzi::try_depart(int i) {
+  std::atomic<uint64_t>& x = nodes[i].x;
+  while (true) {
+    uint64_t v = x.load();
+    if (snzi_halves(v) < 2)
+      return DEPART_FAILED;
+    uint64_t w = snzi_word(snzi_halves(v) - 2, snzi_version(v));
+    if (! x.compare_exchange_strong(v, w))
+      continue;
+    if (snzi_halves(v) == 2 && depart(i / 2))
+      return DEPART_ZERO;
+    return DEPART_DONE;
+  }
+}
+
+snzi::depart_result_t snzi::try_depart_below(int i) {
+  if (snzi_halves(nodes[i].x.load()) == 0)
+    return DEPART_FAILED;
+  while (i < nb_leaves) {
+    if (snzi_halves(nodes[2 * i].x.load()) != 0)
+      i = 2 * i;
+    else if (snzi_halves(nodes[2 * i + 1].x.load()) != 0)
+      i = 2 * i + 1;
+    else
+      return DEPART_FAILED;
+  }
+  return try_depart(i);
+}
+
+snzi::depart_result_t snzi::depart_near(int leaf) {
+  while (true) {
+    depart_result_t r = try_depart(leaf);
+    if (r != DEPART_FAILED)
+      return r;
+    // the dependency was not necessarily added at this leaf: some leaf
+    // is non-empty, or about to be
+    for (int i = leaf; i > 1 && r == DEPART_FAILED; i /= 2)
+      r = try_depart_below(i ^ 1);
+    if (r != DEPART_FAILED)
+      return r;
+  }
+}
+
+void snzi::delta(thread_p t, int64_t d) {
+  if (nb_leaves == 1) {
+    if (root.fetch_add(d) + d == 0l)
+      start(t);
+    return;
+  }
+  int leaf = my_leaf();
+  for (; d > 0; d--)
+    arrive(leaf);
+  for (; d < 0; d++) {
+    if (depart_near(leaf) == DEPART_ZERO) {
+      start(t);
+      return;
+    }
+  }
+}
+
 /***********************************************************************/
 
 } // end namespace
@@ -10,6 +10,8 @@
 #ifndef _INSTRATEGY_H_
 #define _INSTRATEGY_H_
 
+#include <atomic>
+
 #include "thread.hpp"
 #include "tagged.hpp"
 #include "messagestrategy.hpp"
@@ -270,6 +272,95 @@ public:
   
 };
   
+/*---------------------------------------------------------------------*/
+
+/*! \class snzi
+ *  \brief Updates the join counter using a scalable non-zero
+ *  indicator (SNZI).
+ *
+ * The join counter is spread over a binary tree, with one leaf per
+ * worker. A worker adds a dependency by arriving at its own leaf, and
+ * removes one by departing from its own leaf, or, if its leaf is
+ * empty, from a non-empty leaf of the closest subtree that has one:
+ * the worker climbs from its leaf towards the root and, at each
+ * level, descends into the sibling subtree if it is non-empty, so
+ * that a depart visits O(log^2 P) nodes at most. A node arrives at
+ * its parent only when its surplus goes from zero to non-zero, and
+ * departs from it only when its surplus goes back to zero, so that
+ * most updates touch only the leaf of the calling worker. The root is
+ * a plain counter: the thread is scheduled as soon as it drops to
+ * zero, which, unlike with `distributed`, needs no polling.
+ *
+ * Concurrent arrivals at a node that is empty are resolved as in the
+ * hierarchical SNZI of Ellen et al. (PODC 2007): the first arrival
+ * moves the node to an intermediate state, from which any arrival
+ * may complete the arrival at the parent, extra arrivals at the
+ * parent being undone.
+ *
+ * The trees are allocated on cache lines and, once their counter has
+ * dropped to zero, cached by the worker that releases them (see
+ * `-snzi_pool_max`, default 64 trees per worker).
+ *
+ * \ingroup instrategy
+ */
+class snzi : public common {
+protected:
+
+  class alignas(64) node_t {
+  public:
+    // surplus of the node, counted in halves, and version number
+    std::atomic<uint64_t> x;
+    node_t() : x(0) { }
+  };
+
+  // root of the tree
+  std::atomic<int64_t> root;
+  char padding[64 - sizeof(std::atomic<int64_t>)];
+  // nodes `1` to `2 * nb_leaves - 1`, the children of node `i` being
+  // `2 * i` and `2 * i + 1`; node `1` is `root`
+  node_t* nodes;
+  int nb_leaves;
+
+  void arrive(int i);
+  // returns true if the counter dropped to zero
+  bool depart(int i);
+  // same as `depart`, but fails if leaf `i` is empty
+  typedef enum { DEPART_FAILED, DEPART_DONE, DEPART_ZERO } depart_result_t;
+  depart_result_t try_depart(int i);
+  // departs from some leaf of the subtree of node `i`, or fails if the
+  // subtree is empty
+  depart_result_t try_depart_below(int i);
+  // departs from the leaf `leaf`, or else from the closest non-empty leaf
+  depart_result_t depart_near(int leaf);
+  int my_leaf();
+
+  static node_t* alloc_tree();
+  static void release_tree(node_t* nodes);
+
+public:
+
+  snzi();
+  ~snzi();
+
+  //! Sets the shape of the trees; called once the workers are created
+  static void init_pool();
+  //! Deallocates the trees cached by the workers
+  static void destroy_pool();
+
+  void check(thread_p t) {
+    if (root.load() == 0l)
+      start(t);
+  }
+
+  void delta(thread_p t, int64_t d);
+
+  //! Returns the value of the join counter, which may be stale
+  int64_t get_diff() {
+    return root.load();
+  }
+
+};
+
 /*---------------------------------------------------------------------*/
  
 const long READY_TAG = 1;
@@ -5,8 +5,18 @@
  * \file logging.cpp
  */
 
+#include <queue>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "logging.hpp"
 #include "cmdline.hpp"
+#include "ticks.hpp"
+#include "atomic.hpp"
 
 namespace pasl {
 namespace util {
@@ -28,67 +38,63 @@ static inline void fwrite_int64 (FILE* f, int64_t v) {
 }
 
 /*---------------------------------------------------------------------*/
+/* Ring buffers */
 
-
-event_t::event_t() {}
-
-void event_t::print_byte_descr(FILE* f) { }
-
-void event_t::print_text_descr(FILE* f) { }
-
-void event_t::record (microtime_t basetime) {
-  id = (int64_t) worker::get_my_id();
-  time = microtime::now() - basetime; // or (double) ticks::now()
-// TEMP
-/*
-  if (microtime::seconds(time) > 0.01) {
-    output ();
-    atomic::die("interrupted");
+/* `head` is written only by the owner, `tail` only by whoever holds
+ * `flush_lock` (or by no one, when there is no flusher); both only
+ * grow, and index the items modulo the capacity. Without a flusher,
+ * the owner alone grows `items` and `capacity`.
+ */
+class recorder_t::buffer_t {
+public:
+  event_t* items;
+  uint64_t capacity;
+  std::atomic<uint64_t> head;
+  char padding[64];
+  std::atomic<uint64_t> tail;
+  std::mutex flush_lock;
+  uint64_t nb_dropped;
+  FILE* spill;
+  uint64_t nb_spilled;
+
+  buffer_t(uint64_t capacity)
+  : items(new event_t[capacity]), capacity(capacity), head(0), tail(0),
+    nb_dropped(0), spill(nullptr), nb_spilled(0) { }
+
+  // doubles the capacity, keeping the items at the same indices
+  void grow() {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_relaxed);
+    event_t* bigger = new event_t[2 * capacity];
+    for (uint64_t i = t; i != h; i++)
+      bigger[i & (2 * capacity - 1)] = items[i & (capacity - 1)];
+    delete [] items;
+    items = bigger;
+    capacity *= 2;
   }
-*/
-    
-}
 
-void event_t::print_byte_header (FILE* f) {
-  //fwrite_double (f, time);
-  fwrite_int64 (f, (int64_t) time);
-  fwrite_int64 (f, id);
-  fwrite_int64 (f, get_type());
-}
-
-void event_t::print_byte (FILE* f) { 
-  print_byte_header (f);
-  print_byte_descr (f);
-}
-
-void event_t::print_text_header (FILE* f) {
-  fprintf(f, "%lf\t%d\t%s\t", time, (int)id, get_name().c_str());
-}
-
-void event_t::print_text (FILE* f) { 
-  print_text_header (f);
-  print_text_descr (f); 
-  fprintf (f, "\n");
-}
-
-double event_t::get_time() {
-  return time;
-}
+  ~buffer_t() {
+    delete [] items;
+  }
+};
 
 /*---------------------------------------------------------------------*/
 
-
-recorder_t::recorder_t() {
+// the buffers of `the_recorder`, which has static storage, start null
+recorder_t::recorder_t()
+: capacity(0), dropping(false), flushing(false), stop_requested(false),
+  flusher(nullptr) {
 }
 
 recorder_t::~recorder_t() {
 }
 
 void recorder_t::init() {
-  basetime = microtime::now();
+  basetime = ticks::now();
   real_time = cmdline::parse_or_default_bool("log_stdout", false);
   text_mode = cmdline::parse_or_default_bool("log_text", real_time);
-  set_tracking_all(false); 
+  trace_mode = cmdline::parse_or_default_bool("log_trace", false, false);
+  set_tracking_all(false);
   bool pview = cmdline::parse_or_default_bool("pview", false);
   bool color_view = cmdline::parse_or_default_bool("color_view", false); // temporarily deprecated
   tracking[PHASES] = cmdline::parse_or_default_bool("log_phases", 0);
@@ -98,7 +104,7 @@ void recorder_t::init() {
   tracking[LOCALITY] = cmdline::parse_or_default_bool("log_locality", 0);
   // TEMP: accept log_estim instead of log_estims
   bool estim = cmdline::parse_or_default_bool("log_estim", 0);
-  if (estim) 
+  if (estim)
     tracking[ESTIMS] = true;
   tracking[CSTS] = cmdline::parse_or_default_bool("log_csts", tracking[ESTIMS]);
   tracking[TRANSFER] = cmdline::parse_or_default_bool("log_transfer", 0);
@@ -113,20 +119,54 @@ void recorder_t::init() {
   if (pview) {
     tracking[PHASES] = true;
   }
+  bool any = false;
+  for (int k = 0; k < NUM_KIND_IDS; k++)
+    any = any || tracking[k];
+  if (! any)
+    return;
+  uint64_t nb = (uint64_t) std::max(1, cmdline::parse_or_default_int("log_buffer", 1 << 16, false));
+  capacity = 1;
+  while (capacity < nb)
+    capacity *= 2;
+  buffers.for_each([&] (worker_id_t, buffer_t*& b) {
+    b = new buffer_t(capacity);
+  });
+  dropping = cmdline::parse_or_default_bool("log_drop", false, false);
+  flushing = cmdline::parse_or_default_bool("log_flush", false, false);
+  flush_period_us = cmdline::parse_or_default_double("log_flush_us", 10000., false);
+  if (flushing) {
+    buffers.for_each([&] (worker_id_t id, buffer_t*& b) {
+      std::string fname = byte_file_name() + "." + std::to_string(id);
+      b->spill = fopen(fname.c_str(), "w+");
+      if (b->spill == nullptr)
+        atomic::die("cannot open log file %s\n", fname.c_str());
+    });
+    stop_requested.store(false);
+    flusher = new std::thread([this] { flush_loop(); });
+  }
 }
 
 void recorder_t::destroy() {
+  stop_flusher();
+  buffers.for_each([&] (worker_id_t id, buffer_t*& b) {
+    if (b == nullptr)
+      return;
+    if (b->spill != nullptr) {
+      fclose(b->spill);
+      std::string fname = byte_file_name() + "." + std::to_string(id);
+      unlink(fname.c_str());
+    }
+    delete b;
+    b = nullptr;
+  });
+  estim_names.clear();
 }
 
 void recorder_t::set_tracking_all(bool state) {
-  for (int k = 0; k < NUM_KIND_IDS; k++) 
+  for (int k = 0; k < NUM_KIND_IDS; k++)
     tracking[k] = state;
 }
 
-events_t& recorder_t::get_my_events() {
-  return events_for[worker::the_group.get_my_id_or_undef()];
-}
-
 bool recorder_t::is_tracked_kind(event_kind_t kind) {
   return tracking[kind];
 }
@@ -135,160 +175,560 @@ bool recorder_t::is_tracked(event_type_t type) {
   return tracking[kind_of_type(type)];
 }
 
-void recorder_t::add_nocheck(event_p event) {
-  event->record(basetime);
+void recorder_t::add_nocheck(event_t event) {
+  worker_id_t my_id = worker::the_group.get_my_id_or_undef();
+  event.date = ticks::now();
+  event.id = (int32_t) my_id;
   if (real_time) {
     atomic::acquire_print_lock();
-    event->print_text(stdout);
+    print_text(stdout, event);
     atomic::release_print_lock();
   }
-  get_my_events().push_back (event);
+  buffer_t& b = *buffers[my_id];
+  uint64_t head = b.head.load(std::memory_order_relaxed);
+  if (head - b.tail.load(std::memory_order_acquire) == b.capacity) {
+    if (dropping) {
+      b.nb_dropped++;
+      return;
+    } else if (flushing) {
+      // does the work of the flusher, which is late
+      std::lock_guard<std::mutex> guard(b.flush_lock);
+      flush(b);
+    } else {
+      b.grow();
+    }
+  }
+  b.items[head & (b.capacity - 1)] = event;
+  b.head.store(head + 1, std::memory_order_release);
 }
 
-void recorder_t::add(event_p event) {
-  if (! is_tracked(event->get_type())) {
-    delete event;
+void recorder_t::add(event_t event) {
+  if (! is_tracked((event_type_t) event.type))
     return;
-  } else {  
-    add_nocheck(event);
-  }
+  add_nocheck(event);
 }
 
-static bool event_t_compare_time (event_p e1, event_p e2) {
-  return (e1->get_time() < e2->get_time());
+static std::mutex estim_names_mutex;
+
+int64_t recorder_t::intern_estim_name(std::string name) {
+  std::lock_guard<std::mutex> guard(estim_names_mutex);
+  estim_names.push_back(name);
+  return (int64_t) estim_names.size() - 1;
 }
 
-void recorder_t::merge_and_sort() {
-  all_events.clear();
-  for (int id = worker::undef; id < worker::get_nb(); id++) {
-    events_t events = events_for[id];
-    for (std::vector<event_p>::iterator it = events.begin(); it != events.end(); it++)
-      all_events.push_back(*it);
+/*---------------------------------------------------------------------*/
+/* Flusher */
+
+std::string recorder_t::byte_file_name() {
+  return cmdline::parse_or_default_string("byte_log_file", "LOG_BIN", false);
+}
+
+// to be called with `b.flush_lock` held
+void recorder_t::flush(buffer_t& b) {
+  uint64_t tail = b.tail.load(std::memory_order_relaxed);
+  uint64_t head = b.head.load(std::memory_order_acquire);
+  while (tail != head) {
+    uint64_t pos = tail & (b.capacity - 1);
+    uint64_t nb = std::min(head - tail, b.capacity - pos);
+    fwrite(&b.items[pos], sizeof(event_t), nb, b.spill);
+    b.nb_spilled += nb;
+    tail += nb;
   }
-  std::stable_sort (all_events.begin(), all_events.end(), event_t_compare_time);
+  b.tail.store(tail, std::memory_order_release);
 }
 
-void recorder_t::dump_byte_to (FILE* f) {
-  for (std::vector<event_p>::iterator it = all_events.begin(); it != all_events.end(); it++)
-    (*it)->print_byte (f);
+void recorder_t::flush_loop() {
+  while (! stop_requested.load()) {
+    buffers.for_each([&] (worker_id_t, buffer_t*& b) {
+      std::lock_guard<std::mutex> guard(b->flush_lock);
+      flush(*b);
+    });
+    ticks::microseconds_sleep(flush_period_us);
+  }
 }
 
-void recorder_t::dump_text_to (FILE* f) {
-  for (std::vector<event_p>::iterator it = all_events.begin(); it != all_events.end(); it++)
-    (*it)->print_text (f);
+void recorder_t::stop_flusher() {
+  if (flusher == nullptr)
+    return;
+  stop_requested.store(true);
+  flusher->join();
+  delete flusher;
+  flusher = nullptr;
 }
 
-void recorder_t::dump_byte () {
-  std::string fname = cmdline::parse_or_default_string ("byte_log_file", "LOG_BIN");
-  FILE* f = fopen(fname.c_str(), "w");
-  this->dump_byte_to (f);
-  fclose (f);
-}
+/*---------------------------------------------------------------------*/
+/* Merge */
 
-void recorder_t::dump_text () {
-  std::string fname = cmdline::parse_or_default_string ("text_log_file", "LOG");
-  FILE* f = fopen(fname.c_str(), "w");
-  this->dump_text_to (f);
-  fclose (f);    
-}
+/* the events of one worker: those spilled to its file, mapped in
+ * memory, then those still in its ring buffer
+ */
+class source_t {
+public:
+  event_t* spilled;
+  uint64_t nb_spilled;
+  event_t* items;
+  uint64_t mask;
+  uint64_t pos;     // in [0, nb_spilled + (head - tail))
+  uint64_t tail;
+  uint64_t end;
+
+  bool done() const {
+    return pos == end;
+  }
 
-void recorder_t::output () {
-  merge_and_sort();
-  dump_byte();
-  if (text_mode)
-    dump_text();
+  const event_t& peek() const {
+    if (pos < nb_spilled)
+      return spilled[pos];
+    return items[(tail + pos - nb_spilled) & mask];
+  }
+};
+
+template <class Visit>
+void recorder_t::merge(const Visit& visit) {
+  std::vector<source_t> sources;
+  std::vector<std::pair<void*, size_t>> mappings;
+  buffers.for_each([&] (worker_id_t id, buffer_t*& b) {
+    if (b == nullptr)
+      return;
+    source_t s;
+    s.spilled = nullptr;
+    s.nb_spilled = 0;
+    if (b->spill != nullptr && b->nb_spilled > 0) {
+      fflush(b->spill);
+      size_t szb = b->nb_spilled * sizeof(event_t);
+      void* p = mmap(nullptr, szb, PROT_READ, MAP_PRIVATE, fileno(b->spill), 0);
+      if (p == MAP_FAILED)
+        atomic::die("cannot map log file of worker %d\n", (int) id);
+      mappings.push_back(std::make_pair(p, szb));
+      s.spilled = (event_t*) p;
+      s.nb_spilled = b->nb_spilled;
+    }
+    s.items = b->items;
+    s.mask = b->capacity - 1;
+    s.tail = b->tail.load();
+    s.pos = 0;
+    s.end = s.nb_spilled + (b->head.load() - s.tail);
+    if (! s.done())
+      sources.push_back(s);
+  });
+  typedef std::pair<uint64_t, size_t> key_t;
+  std::priority_queue<key_t, std::vector<key_t>, std::greater<key_t>> heads;
+  for (size_t i = 0; i < sources.size(); i++)
+    heads.push(key_t(sources[i].peek().date, i));
+  while (! heads.empty()) {
+    source_t& s = sources[heads.top().second];
+    heads.pop();
+    visit(s.peek());
+    s.pos++;
+    if (! s.done())
+      heads.push(key_t(s.peek().date, &s - &sources[0]));
+  }
+  for (auto& m : mappings)
+    munmap(m.first, m.second);
 }
 
 /*---------------------------------------------------------------------*/
-
-void thread_event_t::print_byte_descr(FILE* f) {
-  fwrite_int64 (f, (int64_t) thread);
+/* Printing */
+
+void recorder_t::print_byte(FILE* f, const event_t& e) {
+  fwrite_int64 (f, (int64_t) ticks::microseconds(e.date - basetime));
+  fwrite_int64 (f, (int64_t) e.id);
+  fwrite_int64 (f, (int64_t) e.type);
+  const int64_t* d = e.descr;
+  switch (e.type) {
+    case THREAD_CREATE: case THREAD_POP: case THREAD_SCHEDULE:
+    case THREAD_SEND: case THREAD_EXEC: case THREAD_FINISH:
+    case LOCALITY_START: case LOCALITY_STOP:
+      fwrite_int64 (f, d[0]);
+      break;
+    case THREAD_FORK:
+      fwrite_int64 (f, d[0]);
+      fwrite_int64 (f, d[1]);
+      fwrite_int64 (f, d[2]);
+      break;
+    case INTERRUPT:
+      fwrite_double (f, double_of_word(d[0]));
+      break;
+    case ESTIM_NAME: {
+      std::string& name = estim_names[d[1]];
+      fwrite_int64 (f, d[0]);
+      int64_t len = (int64_t) name.length();
+      fwrite_int64 (f, len);
+      for (int64_t i = 0; i < len; i++)
+        fwrite_int64 (f, (int64_t) name[i]);
+      break;
+    }
+    case ESTIM_REPORT:
+      fwrite_int64 (f, d[0]);
+      fwrite_int64 (f, d[1]);
+      // TODO: fix double bits: fwrite_double (f, elapsed);
+      fwrite_int64 (f, (int64_t) (1000.0 * double_of_word(d[2])));
+      fwrite_double (f, double_of_word(d[3]));
+      break;
+    case ESTIM_UPDATE:
+      fwrite_int64 (f, d[0]);
+      fwrite_double (f, double_of_word(d[1]));
+      break;
+    case ESTIM_PREDICT:
+      fwrite_int64 (f, d[0]);
+      fwrite_int64 (f, d[1]);
+      fwrite_double (f, double_of_word(d[2]));
+      break;
+    default:
+      break;
+  }
 }
 
-void thread_event_t::print_text_descr(FILE* f) {  
-  fprintf(f, "%p", thread);
+void recorder_t::print_text(FILE* f, const event_t& e) {
+  event_type_t type = (event_type_t) e.type;
+  fprintf(f, "%lf\t%d\t%s\t", ticks::microseconds(e.date - basetime), (int) e.id,
+          name_of(type).c_str());
+  const int64_t* d = e.descr;
+  switch (type) {
+    case THREAD_CREATE: case THREAD_POP: case THREAD_SCHEDULE:
+    case THREAD_SEND: case THREAD_EXEC: case THREAD_FINISH:
+      fprintf(f, "%p", (void*) d[0]);
+      break;
+    case THREAD_FORK:
+      fprintf(f, "%p\t%p\t%p", (void*) d[0], (void*) d[1], (void*) d[2]);
+      break;
+    case LOCALITY_START: case LOCALITY_STOP:
+      fprintf(f, "%ld", (long) d[0]);
+      break;
+    case INTERRUPT:
+      fprintf(f,"%lf\t", double_of_word(d[0]));
+      break;
+    case ESTIM_NAME:
+      fprintf(f,"%p\t%s\t", (void*) d[0], estim_names[d[1]].c_str());
+      break;
+    case ESTIM_REPORT:
+      // warning: order switched
+      fprintf(f,"%p\t%ld\t%lf\t%lf\t", (void*) d[0], (long) d[1],
+              double_of_word(d[3]), double_of_word(d[2]));
+      break;
+    case ESTIM_UPDATE:
+      fprintf(f,"%p\t%lf\t", (void*) d[0], double_of_word(d[1]));
+      break;
+    case ESTIM_PREDICT: {
+      // warning: extra info printed
+      double time = double_of_word(d[2]);
+      double cst = time / d[1];
+      fprintf(f,"%p\t%ld\t                     \t%lf\t%lf\t", (void*) d[0], (long) d[1], cst, time);
+      break;
+    }
+    default:
+      break;
+  }
+  fprintf (f, "\n");
 }
 
 /*---------------------------------------------------------------------*/
+/* Export to the trace-event format */
 
-void thread_fork_event_t::print_byte_descr(FILE* f) {
-  fwrite_int64 (f, (int64_t) thread);
-  fwrite_int64 (f, (int64_t) threadL);
-  fwrite_int64 (f, (int64_t) threadR);
-}
+/* state needed to pair the events of a slice and to draw the flow
+ * arrows; everything else is written as soon as it is visited
+ */
+// names of event types without the padding of `name_of`
+static std::string trace_name_of(event_type_t type) {
+  std::string name = name_of(type);
+  return name.substr(0, name.find_last_not_of(' ') + 1);
+}
+
+class trace_writer_t {
+private:
+  typedef std::pair<double, int64_t> open_t;   // date, argument
+  typedef std::vector<open_t> stack_t;
+
+  // where a thread was forked or created
+  class origin_t {
+  public:
+    double date;
+    int32_t id;
+    bool forked;
+  };
+
+  FILE* f;
+  bool first;
+  uint64_t nb_flows;
+  std::map<int32_t, stack_t> open_slices[NUM_TYPE_IDS];
+  std::map<int64_t, origin_t> origins;
+  std::map<int64_t, std::string> estim_names;
+
+  void begin_event(const char* ph, const char* name, const char* cat, int32_t id, double date) {
+    fprintf(f, "%s\n{\"ph\":\"%s\",\"name\":\"%s\",\"cat\":\"%s\",\"pid\":0,\"tid\":%d,\"ts\":%.3f",
+            first ? "" : ",", ph, name, cat, (int) id, date);
+    first = false;
+  }
 
-void thread_fork_event_t::print_text_descr(FILE* f) {  
-  fprintf(f, "%p\t%p\t%p", thread, threadL, threadR);
-}
+  void end_event() {
+    fprintf(f, "}");
+  }
 
-/*---------------------------------------------------------------------*/
+  void instant(const char* name, const char* cat, int32_t id, double date) {
+    begin_event("i", name, cat, id, date);
+    fprintf(f, ",\"s\":\"t\"");
+    end_event();
+  }
 
-void interrupt_event_t::print_byte_descr(FILE* f) {
-  fwrite_double (f, elapsed);
-}
-void interrupt_event_t::print_text_descr(FILE* f) {  
-  fprintf(f,"%lf\t", elapsed);
-}
+  void open(event_type_t type, int32_t id, double date, int64_t arg) {
+    open_slices[type][id].push_back(open_t(date, arg));
+  }
 
-/*---------------------------------------------------------------------*/
+  /* closes the slice opened by the last event of type `type` on the
+   * same track, if any; a stop without start is dropped
+   */
+  bool close(event_type_t type, int32_t id, open_t& o) {
+    stack_t& stack = open_slices[type][id];
+    if (stack.empty())
+      return false;
+    o = stack.back();
+    stack.pop_back();
+    return true;
+  }
 
-void locality_event_t::print_byte_descr(FILE* f) {
-  //! \todo only works if thread::locality_t is int64_t
-  fwrite_int64 (f, (int64_t) pos);
-}
+  void slice(const char* name, const char* cat, int32_t id, double start, double stop) {
+    begin_event("X", name, cat, id, start);
+    fprintf(f, ",\"dur\":%.3f", stop - start);
+  }
 
-void locality_event_t::print_text_descr(FILE* f) {  
-  fprintf(f, "%ld", pos);
-}
+  void close_slice(event_type_t start_type, const char* name, const char* cat,
+                   int32_t id, double date) {
+    open_t o;
+    if (! close(start_type, id, o))
+      return;
+    slice(name, cat, id, o.first, date);
+    end_event();
+  }
 
-/*---------------------------------------------------------------------*/
+  std::string estim_name(int64_t estim) {
+    auto it = estim_names.find(estim);
+    if (it != estim_names.end())
+      return it->second;
+    char buf[32];
+    sprintf(buf, "%p", (void*) estim);
+    return std::string(buf);
+  }
 
-void estim_name_event_t::print_byte_descr(FILE* f) {
-  fwrite_int64 (f, (int64_t) estim);
-  int64_t len = (int64_t) name.length();
-  fwrite_int64 (f, len);
-  for (int64_t i = 0; i < len; i++)
-    fwrite_int64 (f, (int64_t) name[i]);
-}
+  void counter(const std::string& name, int32_t id, double date, double value) {
+    begin_event("C", name.c_str(), "estim", id, date);
+    fprintf(f, ",\"args\":{\"value\":%lf}", value);
+    end_event();
+  }
+
+  void flow(const char* name, int64_t thread, const origin_t& o, int32_t id, double date) {
+    uint64_t flow_id = nb_flows++;
+    begin_event("s", name, name, o.id, o.date);
+    fprintf(f, ",\"id\":%lu", (unsigned long) flow_id);
+    end_event();
+    begin_event("f", name, name, id, date);
+    fprintf(f, ",\"id\":%lu,\"bp\":\"e\",\"args\":{\"thread\":\"%p\"}",
+            (unsigned long) flow_id, (void*) thread);
+    end_event();
+  }
+
+public:
+
+  trace_writer_t(FILE* f) : f(f), first(true), nb_flows(0) { }
+
+  void header(const std::vector<int32_t>& ids) {
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    begin_event("M", "process_name", "", 0, 0.);
+    fprintf(f, ",\"args\":{\"name\":\"pasl\"}");
+    end_event();
+    for (int32_t id : ids) {
+      begin_event("M", "thread_name", "", id, 0.);
+      if (id == worker::undef)
+        fprintf(f, ",\"args\":{\"name\":\"other threads\"}");
+      else
+        fprintf(f, ",\"args\":{\"name\":\"worker %d\"}", (int) id);
+      end_event();
+    }
+  }
+
+  void footer() {
+    fprintf(f, "\n]}\n");
+  }
+
+  void visit(const event_t& e, double date, const std::vector<std::string>& names) {
+    event_type_t type = (event_type_t) e.type;
+    int32_t id = e.id;
+    const int64_t* d = e.descr;
+    switch (type) {
+      case ENTER_LAUNCH: case ENTER_ALGO: case ENTER_WAIT:
+        open(type, id, date, 0);
+        break;
+      case EXIT_LAUNCH:
+        close_slice(ENTER_LAUNCH, "launch", "phase", id, date);
+        break;
+      case EXIT_ALGO:
+        close_slice(ENTER_ALGO, "algo", "phase", id, date);
+        break;
+      case EXIT_WAIT:
+        close_slice(ENTER_WAIT, "idle", "phase", id, date);
+        break;
+      case ALGO_PHASE:
+        instant("algo_phase", "phase", id, date);
+        break;
+      case COMMUNICATE:
+        instant("communicate", "comm", id, date);
+        break;
+      case INTERRUPT:
+        begin_event("i", "interrupt", "comm", id, date);
+        fprintf(f, ",\"s\":\"t\",\"args\":{\"elapsed\":%lf}", double_of_word(d[0]));
+        end_event();
+        break;
+      case STEAL_SUCCESS: case STEAL_FAIL: case STEAL_ABORT:
+        instant(trace_name_of(type).c_str(), "stdws", id, date);
+        break;
+      case LOCALITY_START:
+        open(type, id, date, d[0]);
+        break;
+      case LOCALITY_STOP: {
+        open_t o;
+        if (! close(LOCALITY_START, id, o))
+          break;
+        slice("locality", "locality", id, o.first, date);
+        fprintf(f, ",\"args\":{\"low\":%ld,\"hi\":%ld}", (long) o.second, (long) d[0]);
+        end_event();
+        break;
+      }
+      case THREAD_FORK: {
+        begin_event("i", "thread_fork", "thread", id, date);
+        fprintf(f, ",\"s\":\"t\",\"args\":{\"thread\":\"%p\",\"left\":\"%p\",\"right\":\"%p\"}",
+                (void*) d[0], (void*) d[1], (void*) d[2]);
+        end_event();
+        origins[d[1]] = origin_t{date, id, true};
+        origins[d[2]] = origin_t{date, id, true};
+        break;
+      }
+      case THREAD_CREATE: case THREAD_SCHEDULE: case THREAD_POP: case THREAD_SEND: {
+        begin_event("i", trace_name_of(type).c_str(), "thread", id, date);
+        fprintf(f, ",\"s\":\"t\",\"args\":{\"thread\":\"%p\"}", (void*) d[0]);
+        end_event();
+        // the fork, when logged, comes first and is the better origin
+        if (type == THREAD_CREATE && origins.find(d[0]) == origins.end())
+          origins[d[0]] = origin_t{date, id, false};
+        break;
+      }
+      case THREAD_EXEC: {
+        auto it = origins.find(d[0]);
+        if (it != origins.end()) {
+          if (it->second.id != id)
+            flow("steal", d[0], it->second, id, date);
+          else if (it->second.forked)
+            flow("fork", d[0], it->second, id, date);
+          // the address may be reused by a later thread
+          origins.erase(it);
+        }
+        open(type, id, date, d[0]);
+        break;
+      }
+      case THREAD_FINISH: {
+        open_t o;
+        if (! close(THREAD_EXEC, id, o))
+          break;
+        slice("thread", "thread", id, o.first, date);
+        fprintf(f, ",\"args\":{\"thread\":\"%p\"}", (void*) o.second);
+        end_event();
+        break;
+      }
+      case ESTIM_NAME:
+        estim_names[d[0]] = names[d[1]];
+        break;
+      case ESTIM_REPORT:
+        counter(estim_name(d[0]) + " measured", id, date, double_of_word(d[3]));
+        break;
+      case ESTIM_UPDATE:
+        counter(estim_name(d[0]), id, date, double_of_word(d[1]));
+        break;
+      case ESTIM_PREDICT:
+        begin_event("i", "estim_predict", "estim", id, date);
+        fprintf(f, ",\"s\":\"t\",\"args\":{\"estim\":\"%s\",\"comp\":%ld,\"time\":%lf}",
+                estim_name(d[0]).c_str(), (long) d[1], double_of_word(d[2]));
+        end_event();
+        break;
+      default:
+        break;
+    }
+  }
+
+};
 
-void estim_name_event_t::print_text_descr(FILE* f) {  
-  fprintf(f,"%p\t%s\t", estim, name.c_str());
+void recorder_t::dump_trace_to (FILE* f) {
+  trace_writer_t writer(f);
+  std::vector<int32_t> ids;
+  buffers.for_each([&] (worker_id_t id, buffer_t*& b) {
+    if (b != nullptr)
+      ids.push_back((int32_t) id);
+  });
+  writer.header(ids);
+  merge([&] (const event_t& e) {
+    writer.visit(e, ticks::microseconds(e.date - basetime), estim_names);
+  });
+  writer.footer();
 }
 
-void estim_report_event_t::print_byte_descr(FILE* f) {
-  fwrite_int64 (f, (int64_t) estim);
-  fwrite_int64 (f, (int64_t) comp);
-  // TODO: fix double bits: fwrite_double (f, elapsed); 
-  fwrite_int64 (f, (int64_t) (1000.0 * elapsed));
-  fwrite_double (f, newcst);
+void recorder_t::dump_trace () {
+  std::string fname = cmdline::parse_or_default_string ("trace_log_file", "LOG.json", false);
+  FILE* f = fopen(fname.c_str(), "w");
+  this->dump_trace_to (f);
+  fclose (f);
 }
 
-void estim_report_event_t::print_text_descr(FILE* f) {  
-  // warning: order switched
-  fprintf(f,"%p\t%ld\t%lf\t%lf\t", estim, (long)comp, newcst, elapsed);
+/*---------------------------------------------------------------------*/
+/* Output */
+
+void recorder_t::dump_byte_to (FILE* f) {
+  merge([&] (const event_t& e) {
+    print_byte(f, e);
+  });
 }
 
-void estim_update_event_t::print_byte_descr(FILE* f) {
-  fwrite_int64 (f, (int64_t) estim);
-  fwrite_double (f, newcst);
+void recorder_t::dump_text_to (FILE* f) {
+  merge([&] (const event_t& e) {
+    print_text(f, e);
+  });
 }
-void estim_update_event_t::print_text_descr(FILE* f) {  
-  fprintf(f,"%p\t%lf\t", estim, newcst);
+
+void recorder_t::dump_byte () {
+  std::string fname = byte_file_name();
+  FILE* f = fopen(fname.c_str(), "w");
+  this->dump_byte_to (f);
+  fclose (f);
 }
 
-void estim_predict_event_t::print_byte_descr(FILE* f) {
-  fwrite_int64 (f, (int64_t) estim);
-  fwrite_int64 (f, (int64_t) comp);
-  fwrite_double (f, time);
+void recorder_t::dump_text () {
+  std::string fname = cmdline::parse_or_default_string ("text_log_file", "LOG");
+  FILE* f = fopen(fname.c_str(), "w");
+  this->dump_text_to (f);
+  fclose (f);
 }
-void estim_predict_event_t::print_text_descr(FILE* f) {  
-  // warning: extra info printed
-  double cst = time / comp;
-  fprintf(f,"%p\t%ld\t                     \t%lf\t%lf\t", estim, (long)comp, cst, time);
+
+void recorder_t::output () {
+  stop_flusher();
+  dump_byte();
+  if (text_mode)
+    dump_text();
+  if (trace_mode)
+    dump_trace();
+  uint64_t nb_dropped = 0;
+  buffers.for_each([&] (worker_id_t, buffer_t*& b) {
+    if (b != nullptr)
+      nb_dropped += b->nb_dropped;
+  });
+  if (nb_dropped > 0)
+    printf("log_dropped_events\t%ld\n", (long) nb_dropped);
 }
 
 /*---------------------------------------------------------------------*/
 
+event_t estim_name_event(void* estim, std::string name) {
+  event_t e = basic_event(ESTIM_NAME);
+  e.descr[0] = (int64_t) estim;
+  e.descr[1] = the_recorder.intern_estim_name(name);
+  return e;
+}
+
 void output () {
   the_recorder.output();
 }
@@ -297,32 +737,28 @@ bool is_tracked_kind(event_kind_t kind) {
   return the_recorder.is_tracked_kind(kind);
 }
 
-void log_event(event_p event) {
+void log_event(event_t event) {
   the_recorder.add(event);
 }
 
 void log_basic(event_type_t type) {
   if (! the_recorder.is_tracked(type))
     return;
-  // I don't think we want to be calling "new" here; it'd be more efficient
-  // to push the raw event value on the event buffer -- Mike
-  the_recorder.add_nocheck(new basic_event_t(type));
+  the_recorder.add_nocheck(basic_event(type));
 }
 
 void log_thread(event_type_t type, sched::thread_p thread) {
   if (! the_recorder.is_tracked(type))
     return;
-  the_recorder.add_nocheck(new thread_event_t(type, thread));
+  the_recorder.add_nocheck(thread_event(type, thread));
 }
 
 void log_thread_fork(event_type_t type, sched::thread_p thread, sched::thread_p threadL, sched::thread_p threadR) {
   if (! the_recorder.is_tracked(type))
     return;
-  the_recorder.add_nocheck(new thread_fork_event_t(type, thread, threadL, threadR));
+  the_recorder.add_nocheck(thread_fork_event(type, thread, threadL, threadR));
 }
 
-
-
 /*---------------------------------------------------------------------*/
 
 
@@ -15,7 +15,10 @@
 #include <string>
 #include <cstdlib>
 #include <cstdio>
+#include <cstring>
 #include <vector>
+#include <atomic>
+#include <thread>
 #include <algorithm>
 #include <assert.h>
 
@@ -74,6 +77,7 @@ typedef enum {
   STEAL_SUCCESS,
   STEAL_FAIL,
   STEAL_ABORT,
+  STEAL_DECISION,
   NUM_TYPE_IDS,
 } event_type_t;
 
@@ -104,6 +108,7 @@ static inline std::string name_of(event_type_t type) {
     case STEAL_SUCCESS: return std::string("steal_success");
     case STEAL_FAIL:    return std::string("steal_fail   ");
     case STEAL_ABORT:   return std::string("steal_abort  ");
+    case STEAL_DECISION:return std::string("steal_decision");
     default: assert(false);
   }
   return "noname"; // never happens
@@ -136,65 +141,179 @@ static inline event_kind_t kind_of_type(event_type_t type) {
     case STEAL_SUCCESS: return STDWS;
     case STEAL_FAIL: return STDWS;
     case STEAL_ABORT: return STDWS;
+    case STEAL_DECISION: return STDWS;
     default: assert(false);
   }
   return PHASES; // never happens
 }
 
 /*---------------------------------------------------------------------*/
-class event_t_comparison_t;
-
-class event_t {
-private:
-  int64_t id;
-  double time;
-
-public:
-
-  event_t();
-
-  virtual event_type_t get_type () = 0;
-
-  virtual std::string get_name () = 0;
-
-  virtual void print_byte_descr(FILE* f);
+/*! \brief Logged event
+ *
+ * Events are plain values of fixed size, so that logging one costs a
+ * copy into a buffer. The description of an event consists of up to
+ * four words, whose meaning depends on the type of the event (see
+ * the functions that build events below); doubles are stored bitwise.
+ */
+typedef struct {
+  uint64_t date;            // in ticks
+  int32_t id;               // worker id, or `worker::undef`
+  int32_t type;             // event_type_t
+  int64_t descr[4];
+} event_t;
+
+static inline int64_t word_of_double(double d) {
+  int64_t w;
+  memcpy(&w, &d, sizeof(w));
+  return w;
+}
 
-  virtual void print_text_descr(FILE* f);
+static inline double double_of_word(int64_t w) {
+  double d;
+  memcpy(&d, &w, sizeof(d));
+  return d;
+}
 
-  virtual void record (microtime_t basetime);
+static inline event_t basic_event(event_type_t type) {
+  event_t e;
+  e.type = (int32_t) type;
+  return e;
+}
 
-  virtual void print_byte_header (FILE* f);
+static inline event_t thread_event(event_type_t type, sched::thread_p thread) {
+  event_t e = basic_event(type);
+  e.descr[0] = (int64_t) thread;
+  return e;
+}
 
-  virtual void print_byte (FILE* f);
+static inline event_t thread_fork_event(event_type_t type, sched::thread_p thread,
+                                        sched::thread_p threadL, sched::thread_p threadR) {
+  event_t e = thread_event(type, thread);
+  e.descr[1] = (int64_t) threadL;
+  e.descr[2] = (int64_t) threadR;
+  return e;
+}
 
-  virtual void print_text_header (FILE* f);
+//! type should be LOCALITY_START or LOCALITY_STOP
+static inline event_t locality_event(event_type_t type, pasl::data::locality_t pos) {
+  event_t e = basic_event(type);
+  //! \todo only works if thread::locality_t is int64_t
+  e.descr[0] = (int64_t) pos;
+  return e;
+}
 
-  virtual void print_text (FILE* f);
+static inline event_t interrupt_event(double elapsed) {
+  event_t e = basic_event(INTERRUPT);
+  e.descr[0] = word_of_double(elapsed);
+  return e;
+}
 
-  double get_time();
-};
+/* estimator names are interned in a table of the recorder, since
+ * they do not fit in an event; they are logged once per estimator
+ */
+event_t estim_name_event(void* estim, std::string name);
+
+static inline event_t estim_report_event(void* estim, uint64_t comp, double elapsed, double newcst) {
+  event_t e = basic_event(ESTIM_REPORT);
+  e.descr[0] = (int64_t) estim;
+  e.descr[1] = (int64_t) comp;
+  e.descr[2] = word_of_double(elapsed);
+  e.descr[3] = word_of_double(newcst);
+  return e;
+}
 
-typedef event_t* event_p;
+static inline event_t estim_update_event(void* estim, double newcst) {
+  event_t e = basic_event(ESTIM_UPDATE);
+  e.descr[0] = (int64_t) estim;
+  e.descr[1] = word_of_double(newcst);
+  return e;
+}
 
-typedef std::vector<event_p> events_t;
+static inline event_t estim_predict_event(void* estim, int64_t comp, double time) {
+  event_t e = basic_event(ESTIM_PREDICT);
+  e.descr[0] = (int64_t) estim;
+  e.descr[1] = comp;
+  e.descr[2] = word_of_double(time);
+  return e;
+}
 
 /*---------------------------------------------------------------------*/
 
+/*! \class recorder_t
+ *  \brief Per-worker event buffers
+ *
+ * Each worker (and, for all the threads which are not workers, one
+ * more slot) owns a ring buffer of `-log_buffer` events (default
+ * 65536, rounded up to a power of two), allocated at initialization
+ * when some kind of event is tracked. Only the owner writes events in
+ * its buffer; when the buffer is full, the owner doubles its size, so
+ * that no event is lost.
+ *
+ * With `-log_flush 1`, a background thread moves, every
+ * `-log_flush_us` microseconds (default 10000), the contents of each
+ * buffer to a file `<byte_log_file>.<id>`, so that long runs need no
+ * larger buffers; the owner and the flusher synchronize through the
+ * two indices of the ring, and, when the owner finds its buffer full,
+ * through a lock per buffer, the owner then flushing the buffer
+ * itself. The flusher does not log any event.
+ *
+ * With `-log_drop 1`, a full buffer neither grows nor is flushed by its
+ * owner: new events are dropped, and their number is reported as
+ * `log_dropped_events`. This bounds the memory and the time taken by
+ * logging, at the price of truncated traces.
+ *
+ * At the end of the run, the events of each worker, which are sorted
+ * by date, are merged in a single pass: each spilled file is mapped
+ * in memory and read in place, followed by the contents left in the
+ * ring buffer of its worker.
+ *
+ * Besides the byte format (`-byte_log_file`, read by `pview`) and the
+ * text format (`-log_text 1`), the events can be exported, with
+ * `-log_trace 1`, in the JSON trace-event format of Chrome and
+ * Perfetto, to `-trace_log_file` (default `LOG.json`). The file is
+ * written while merging, with one track per worker:
+ * - phases, idle periods (`ENTER_WAIT` to `EXIT_WAIT`), executions
+ *   of threads (`THREAD_EXEC` to `THREAD_FINISH`) and locality ranges
+ *   become slices;
+ * - the other thread events and the communication events become
+ *   instant events, and the estimator reports and updates become
+ *   counters named after the estimators;
+ * - a thread executed by another worker than the one which forked or
+ *   created it gets a "steal" flow arrow from its creation to its
+ *   execution, and a forked thread executed by its creator, a "fork"
+ *   one.
+ */
 class recorder_t {
 private:
   bool real_time;
   bool text_mode;
+  bool trace_mode;
   bool tracking[NUM_KIND_IDS];
 
-  // LATER: this vector should use the local_allocator
-  
-  typedef data::perworker::extra<events_t> wi_events_t;
-  wi_events_t events_for; 
-  events_t all_events;
-  microtime_t basetime;
+  class buffer_t;
+  typedef data::perworker::extra<buffer_t*> buffers_t;
+  buffers_t buffers;
+  uint64_t capacity;
+  uint64_t basetime;
+  bool dropping;
 
-private:
-  events_t& get_my_events();
+  std::vector<std::string> estim_names;
+
+  bool flushing;
+  double flush_period_us;
+  std::atomic<bool> stop_requested;
+  std::thread* flusher;
+
+  std::string byte_file_name();
+  void flush(buffer_t& b);
+  void flush_loop();
+  void stop_flusher();
+  void print_byte(FILE* f, const event_t& e);
+  void print_text(FILE* f, const event_t& e);
+
+  //! Calls `visit` on the events of all the workers, by increasing dates
+  template <class Visit>
+  void merge(const Visit& visit);
 
 public:
 
@@ -212,11 +331,11 @@ public:
 
   bool is_tracked(event_type_t type);
 
-  void add_nocheck(event_p event);
+  void add_nocheck(event_t event);
 
-  void add(event_p event);
+  void add(event_t event);
 
-  void merge_and_sort();
+  int64_t intern_estim_name(std::string name);
 
   void dump_byte_to (FILE* f);
 
@@ -226,141 +345,20 @@ public:
 
   void dump_text ();
 
-  void output ();
-
-};
-
+  void dump_trace_to (FILE* f);
 
-/*---------------------------------------------------------------------*/
-// LATER: move definitions below into the CPP file.
+  void dump_trace ();
 
-class basic_event_t : public event_t {
-protected:
-  event_type_t type;
-public:
-  basic_event_t() {} // need to initialize type
-  basic_event_t(event_type_t type) : type(type) {}
-  virtual event_type_t get_type () { return type; }
-  virtual std::string get_name () { return name_of(type); }
-};
-
-/*---------------------------------------------------------------------*/
-
-class thread_event_t : public basic_event_t {
-protected:
-  sched::thread_p thread;
-public:
-  thread_event_t(event_type_t type, sched::thread_p thread) 
-    : basic_event_t(type), thread(thread) {}
-  void print_byte_descr(FILE* f);
-  virtual void print_text_descr(FILE* f);
-};
-
-/*---------------------------------------------------------------------*/
-
-class thread_fork_event_t : public thread_event_t {
-protected:
-  sched::thread_p threadL, threadR;
-public:
-  thread_fork_event_t(event_type_t type, sched::thread_p thread, sched::thread_p threadL, sched::thread_p threadR) 
-    : thread_event_t(type, thread), threadL(threadL), threadR(threadR) {}
-  void print_byte_descr(FILE* f);
-  virtual void print_text_descr(FILE* f);
-};
-
-/*---------------------------------------------------------------------*/
-
-class locality_event_t : public basic_event_t {
-protected:
-  pasl::data::locality_t pos;
-public:
-  //! type should be LOCALITY_START or LOCALITY_STOP
-  locality_event_t(event_type_t type, pasl::data::locality_t pos)
-    : basic_event_t(type), pos(pos) {}
-  void print_byte_descr(FILE* f);
-  virtual void print_text_descr(FILE* f);
-};
-
-/*---------------------------------------------------------------------*/
-
-class interrupt_event_t : public basic_event_t {
-protected:
-  double elapsed;
-public:
-  interrupt_event_t(double elapsed) 
-    : basic_event_t(INTERRUPT), elapsed(elapsed) {}
-  void print_byte_descr(FILE* f);
-  void print_text_descr(FILE* f);
-};
-
-/*---------------------------------------------------------------------*/
-
-class estim_event_t : public basic_event_t {
-protected:
-  void* estim;
-public:
-  estim_event_t(void* estim, event_type_t type) 
-    : // basic_event_t(type),  // TODO: why are we not setting the type here??
-    estim(estim) {
-  }
-};
-
-class estim_name_event_t : public estim_event_t {
-private:
-  std::string name;
-public:
-  estim_name_event_t(void* estim, std::string name) 
-    : estim_event_t(estim, ESTIM_NAME), name(name) {
-    this->type = ESTIM_NAME; }
-  void print_byte_descr(FILE* f);
-  void print_text_descr(FILE* f);
-};
-
-class estim_report_event_t : public estim_event_t {
-private:
-  uint64_t comp;
-  double elapsed;
-  double newcst;
-public:
-  estim_report_event_t(void* estim, uint64_t comp, double elapsed, double newcst) 
-    : estim_event_t(estim, ESTIM_REPORT), 
-      comp(comp), elapsed(elapsed), newcst(newcst) {
-    this->type = ESTIM_REPORT; }
-  void print_byte_descr(FILE* f);
-  void print_text_descr(FILE* f);
-};
-
-class estim_update_event_t : public estim_event_t {
-private:
-  double newcst;
-public:
-  estim_update_event_t(void* estim, double newcst) 
-    : estim_event_t(estim, ESTIM_UPDATE), newcst(newcst) {
-      this->type = ESTIM_UPDATE;}
-  void print_byte_descr(FILE* f);
-  void print_text_descr(FILE* f);
-};
+  void output ();
 
-class estim_predict_event_t : public estim_event_t {
-private:
-  int64_t comp;
-  double time;
-public:
-  estim_predict_event_t(void* estim, int64_t comp, double time) 
-    : estim_event_t(estim, ESTIM_PREDICT), comp(comp), time(time) {
-    this->type = ESTIM_PREDICT;}
-  void print_byte_descr(FILE* f);
-  void print_text_descr(FILE* f);
 };
 
 
-/*---------------------------------------------------------------------*/
-
 extern recorder_t the_recorder;
 
 void output ();
 
-void log_event(event_p event);
+void log_event(event_t event);
 
 bool is_tracked_kind(event_kind_t kind);
 
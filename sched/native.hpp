@@ -9,6 +9,9 @@
 
 #include <utility>
 #include <functional>
+#include <atomic>
+#include <future>
+#include <memory>
 
 #if defined(USE_CILK_RUNTIME)
 #include <cilk/cilk.h>
@@ -18,7 +21,11 @@
 #include "thread.hpp"
 #include "threaddag.hpp"
 #include "control.hpp"
+#include "stackpool.hpp"
+#include "polling.hpp"
+#include "heartbeat.hpp"
 #include "atomic.hpp"
+#include "workspan.hpp"
 
 #ifndef _PASL_NATIVE_H_
 #define _PASL_NATIVE_H_
@@ -33,6 +40,8 @@ namespace ucxt = util::control;
 
 /*---------------------------------------------------------------------*/
 
+class lazy_branch;
+
 class multishot : public thread {
 protected:
 
@@ -53,6 +62,16 @@ protected:
   char* stack;
   //! CPU context of this thread
   context_type cxt;
+  //! latent forks of this thread, in heartbeat mode, oldest first
+  lazy_branch* latent_oldest;
+  lazy_branch* latent_newest;
+
+  void latent_push(lazy_branch* b);
+  void latent_remove(lazy_branch* b);
+  void promote_oldest_latent(scheduler_p sched);
+
+  template <class Exp2>
+  void join_lazy_branch(lazy_branch& branch, const Exp2& exp2);
 
   void swap_with_scheduler() {
     context::swap(context::addr(cxt), ucxt::my_cxt(), notaptr);
@@ -76,12 +95,15 @@ protected:
   void exec() {
     if (stack == nullptr)
       // initial entry by the scheduler into the body of this thread
-      stack = context::spawn(context::addr(cxt), this);
+      stack = context::spawn(context::addr(cxt), this, stackpool::alloc());
     // jump into body of this thread
     context::swap(ucxt::my_cxt(), context::addr(cxt), this);
   }
 
   // point of entry to this thread to be called by the `context::spawn` routine
+  // must not be inlined: `spawn` calls it with the stack pointer at the
+  // very top of the new stack, where the frame of the caller does not exist
+  __attribute__((noinline))
   static void enter(multishot* t) {
     assert(t != nullptr);
     assert(t != (multishot_p)notaptr);
@@ -92,15 +114,22 @@ protected:
 
 public:
 
+#ifdef WORKSPAN
+  //! strand run by this thread, or null if the thread is not measured
+  workspan::strand_t* strand;
+#endif
+
   multishot()
-  : thread(), stack(nullptr)  { }
+  : thread(), stack(nullptr), latent_oldest(nullptr), latent_newest(nullptr) {
+    WORKSPAN_ONLY(strand = nullptr);
+  }
 
   ~multishot() {
     if (stack == nullptr)
       return;
     if (stack == notownstackptr)
       return;
-    free(stack);
+    stackpool::release(stack);
     stack = nullptr;
   }
 
@@ -118,8 +147,7 @@ public:
   }
 
   void finish(multishot_p thread) {
-    instrategy::distributed* dist = new instrategy::distributed(this);
-    threaddag::unary_fork_join(thread, this, dist);
+    threaddag::unary_fork_join(thread, this, threaddag::new_finish_instrategy(this));
     prepare_and_swap_with_scheduler();
   }
 
@@ -163,6 +191,38 @@ public:
     // run end of sched->exec() starting after thread1->exec()
   }
 
+  /* the two threads get their own stacks: unlike in `fork2`, the
+   * scheduler may pop another thread before `thread0`, since the
+   * priority of the two threads may differ from the one of the caller
+   */
+  void fork2_with_priority(priority_t p, multishot_p thread0, multishot_p thread1) {
+    LOG_THREAD_FORK(this, thread0, thread1);
+    thread0->set_priority(p);
+    thread1->set_priority(p);
+    prepare();
+    threaddag::binary_fork_join(thread0, thread1, this);
+    swap_with_scheduler();
+  }
+
+  template <class Exp1, class Exp2>
+  void fork2_lazy(const Exp1& exp1, const Exp2& exp2);
+
+  template <class Exp1, class Exp2>
+  void fork2_heartbeat(const Exp1& exp1, const Exp2& exp2);
+
+  /*! \brief Suspends this thread until it gets one dependency satisfied
+   *
+   * `waiter` becomes the outstrategy finished by the scheduler once
+   * this thread has left its stack; it is responsible for eventually
+   * satisfying the dependency, e.g., by registering this thread with
+   * the thread that it waits for.
+   */
+  void suspend_with(outstrategy_p waiter) {
+    threaddag::join_with(this, instrategy::unary_new());
+    threaddag::my_sched()->set_current_outstrategy(waiter);
+    prepare_and_swap_with_scheduler();
+  }
+
   friend class sched::scheduler::_private;
   friend class ucxt::context;
 };
@@ -191,6 +251,213 @@ multishot_by_lambda<Function>* new_multishot_by_lambda(const Function& f) {
   return new multishot_by_lambda<Function>(f);
 }
 
+/*---------------------------------------------------------------------*/
+/* Lazy fork2
+ *
+ * When `LAZY_FORK2` is defined, `fork2` allocates no thread unless
+ * its right branch gets stolen. The calling thread pushes on its
+ * deque a descriptor of the right branch, which lives in the frame
+ * of the call to `fork2`, and then runs the left branch on its own
+ * stack. If, after the left branch returns, the descriptor is still
+ * at the top of the deque, the calling thread pops the descriptor
+ * and runs the right branch as an ordinary function call.
+ *
+ * Otherwise, the descriptor was taken by a scheduler, either by a
+ * thief or by the owner of the deque after the calling thread got
+ * suspended. Taking the descriptor promotes it to a `multishot`
+ * with ready instrategy, whose outstrategy is the join point of the
+ * descriptor. The calling thread then suspends itself until both
+ * the promoted thread and the calling thread have reached the join
+ * point.
+ */
+
+/*! \class lazy_join
+ *  \brief Join point between the right branch of a lazy fork2 and
+ *  the continuation of the fork2.
+ *
+ * The join point is finished twice, in any order: by the scheduler
+ * that executes the promoted right branch, and by the scheduler that
+ * the calling thread returns control to. The second call schedules
+ * the calling thread. In both cases, the call is made after the
+ * thread has left its stack.
+ */
+class lazy_join : public outstrategy::common {
+private:
+
+  std::atomic<int> nb_pending;
+  thread_p cont;
+
+public:
+
+  lazy_join(thread_p cont)
+  : nb_pending(2), cont(cont) { }
+
+  void add(thread_p) {
+    assert(false);
+  }
+
+  void finished() {
+    thread_p t = cont;
+    if (nb_pending.fetch_sub(1) == 1)
+      outstrategy::decr_dependencies(t);
+    // lives in the frame of fork2, hence no deallocation
+  }
+
+};
+
+/*! \class lazy_branch
+ *  \brief Descriptor of the right branch of a lazy fork2.
+ */
+class lazy_branch : public thread {
+public:
+
+  lazy_join join;
+  // links in the list of latent forks of the calling thread
+  bool latent;
+  lazy_branch* latent_prev;
+  lazy_branch* latent_next;
+
+  lazy_branch(multishot* cont)
+  : thread(true), join(cont),
+    latent(false), latent_prev(nullptr), latent_next(nullptr) {
+    set_outstrategy(outstrategy::noop_new());
+    // scheduled without `add_thread`
+    set_priority(cont->get_priority());
+    stack_resident = true;
+  }
+
+  virtual multishot* promote() = 0;
+
+  /* called by the scheduler that takes the descriptor from a deque;
+   * once the promoted thread is published, the caller of the fork2 may
+   * return and free the descriptor, which is not accessed anymore
+   */
+  void exec() {
+    STAT_COUNT(THREAD_PROMOTE);
+    multishot* t = promote();
+    t->set_instrategy(instrategy::ready_new());
+    t->set_outstrategy(&join);
+    threaddag::add_thread(t);
+  }
+
+  void run() {
+    assert(false);
+  }
+
+  THREAD_COST_UNKNOWN
+};
+
+template <class Function>
+class lazy_branch_by_lambda : public lazy_branch {
+private:
+
+  const Function& f;
+
+public:
+
+  lazy_branch_by_lambda(multishot* cont, const Function& f)
+  : lazy_branch(cont), f(f) { }
+
+  multishot* promote() {
+    return new_multishot_by_lambda(f);
+  }
+
+};
+
+// to be called once the left branch returned, with `branch` in a deque
+template <class Exp2>
+void multishot::join_lazy_branch(lazy_branch& branch, const Exp2& exp2) {
+  // the left branch may have migrated this thread to another worker
+  scheduler_p sched = threaddag::my_sched();
+  if (sched->local_has() && sched->local_peek() == &branch) {
+    sched->local_pop();
+    exp2();
+    return;
+  }
+  // the descriptor was promoted: wait for the right branch
+  threaddag::join_with(this, instrategy::unary_new());
+  sched->set_current_outstrategy(&branch.join);
+  prepare_and_swap_with_scheduler();
+}
+
+template <class Exp1, class Exp2>
+void multishot::fork2_lazy(const Exp1& exp1, const Exp2& exp2) {
+  lazy_branch_by_lambda<Exp2> branch(this, exp2);
+  scheduler_p sched = threaddag::my_sched();
+  sched->schedule(&branch);
+  // the scheduler loop is not reentered, so steal requests get served here
+  if (sched->should_call_communicate())
+    sched->communicate();
+  exp1();
+  join_lazy_branch(branch, exp2);
+}
+
+/*---------------------------------------------------------------------*/
+/* Heartbeat fork2
+ *
+ * In heartbeat mode (see heartbeat.hpp), `fork2` links the descriptor
+ * of its right branch at the end of the list of latent forks of the
+ * calling thread instead of pushing it on the deque. The latent forks
+ * of a thread follow the thread when it migrates. On a heartbeat, the
+ * oldest latent fork is unlinked and pushed on the deque, after which
+ * it behaves as the descriptor of a lazy fork2. A fork that is still
+ * latent when its left branch returns is the newest of the list: the
+ * right branch then runs as an ordinary function call.
+ */
+
+inline void multishot::latent_push(lazy_branch* b) {
+  b->latent = true;
+  b->latent_prev = latent_newest;
+  b->latent_next = nullptr;
+  if (latent_newest == nullptr)
+    latent_oldest = b;
+  else
+    latent_newest->latent_next = b;
+  latent_newest = b;
+}
+
+inline void multishot::latent_remove(lazy_branch* b) {
+  assert(b->latent);
+  b->latent = false;
+  if (b->latent_prev == nullptr)
+    latent_oldest = b->latent_next;
+  else
+    b->latent_prev->latent_next = b->latent_next;
+  if (b->latent_next == nullptr)
+    latent_newest = b->latent_prev;
+  else
+    b->latent_next->latent_prev = b->latent_prev;
+}
+
+inline void multishot::promote_oldest_latent(scheduler_p sched) {
+  lazy_branch* b = latent_oldest;
+  if (b == nullptr)
+    return;
+  latent_remove(b);
+  STAT_COUNT(THREAD_HEARTBEAT);
+  sched->schedule(b);
+}
+
+template <class Exp1, class Exp2>
+void multishot::fork2_heartbeat(const Exp1& exp1, const Exp2& exp2) {
+  lazy_branch_by_lambda<Exp2> branch(this, exp2);
+  latent_push(&branch);
+  scheduler_p sched = threaddag::my_sched();
+  if (heartbeat::beat())
+    promote_oldest_latent(sched);
+  if (sched->should_call_communicate())
+    sched->communicate();
+  exp1();
+  if (branch.latent) {
+    latent_remove(&branch);
+    exp2();
+    return;
+  }
+  join_lazy_branch(branch, exp2);
+}
+
+/*---------------------------------------------------------------------*/
+
 static inline multishot* my_thread() {
   multishot* t = (multishot*)threaddag::my_sched()->get_current_thread();
   assert(t != nullptr);
@@ -211,8 +478,61 @@ static inline int my_deque_size() {
 
 /*---------------------------------------------------------------------*/
 
+/*---------------------------------------------------------------------*/
+/* Work and span (see workspan.hpp) */
+
+#ifdef WORKSPAN
+
+template <class Exp>
+void run_strand(workspan::strand_t& strand, const Exp& exp) {
+  // with a lazy fork2, both branches may run in the thread of the caller
+  multishot* t = my_thread();
+  workspan::strand_t* caller = t->strand;
+  t->strand = &strand;
+  strand.open();
+  exp();
+  strand.close();
+  t->strand = caller;
+}
+
+//! `fork(exp1, exp2)` runs the two branches in parallel
+template <class Fork, class Exp1, class Exp2>
+void fork2_measured(const Fork& fork, const Exp1& exp1, const Exp2& exp2) {
+  multishot* t = my_thread();
+  workspan::strand_t* strand = t->strand;
+  if (strand == nullptr) {
+    fork(exp1, exp2);
+    return;
+  }
+  strand->close();
+  workspan::strand_t strand1 = strand->branch();
+  workspan::strand_t strand2 = strand->branch();
+  fork([&] { run_strand(strand1, exp1); },
+       [&] { run_strand(strand2, exp2); });
+  strand->join(strand1, strand2);
+  strand->open();
+}
+
+#endif
+
+/*! \brief Measures the work and the span of `body`, which is run by
+ *  the calling thread; see `workspan::print`
+ */
+template <class Body>
+void measure_workspan(const Body& body) {
+#ifdef WORKSPAN
+  workspan::strand_t root;
+  run_strand(root, body);
+  workspan::report(root);
+#else
+  body();
+#endif
+}
+
+/*---------------------------------------------------------------------*/
+
 template <class Exp1, class Exp2>
-void fork2(const Exp1& exp1, const Exp2& exp2) {
+void fork2_unmeasured(const Exp1& exp1, const Exp2& exp2) {
 #if defined(SEQUENTIAL_ELISION)
   exp1();
   exp2();
@@ -221,8 +541,50 @@ void fork2(const Exp1& exp1, const Exp2& exp2) {
   exp2();
   cilk_sync;
 #else
-  my_thread()->fork2(new_multishot_by_lambda(exp1),
-                     new_multishot_by_lambda(exp2));
+  multishot* t = my_thread();
+  if (heartbeat::enabled)
+    t->fork2_heartbeat(exp1, exp2);
+  else
+#if defined(LAZY_FORK2)
+    t->fork2_lazy(exp1, exp2);
+#else
+    t->fork2(new_multishot_by_lambda(exp1),
+             new_multishot_by_lambda(exp2));
+#endif
+#endif
+}
+
+template <class Exp1, class Exp2>
+void fork2(const Exp1& exp1, const Exp2& exp2) {
+#ifdef WORKSPAN
+  fork2_measured([] (const auto& e1, const auto& e2) {
+    fork2_unmeasured(e1, e2);
+  }, exp1, exp2);
+#else
+  fork2_unmeasured(exp1, exp2);
+#endif
+}
+
+/*! \brief Runs `exp1` and `exp2` in parallel at priority `p`
+ *
+ * The threads created by `exp1` and `exp2` inherit the priority `p`;
+ * the caller keeps its own priority after the join.
+ */
+template <class Exp1, class Exp2>
+void fork2_with_priority(priority_t p, const Exp1& exp1, const Exp2& exp2) {
+#if defined(SEQUENTIAL_ELISION)
+  exp1();
+  exp2();
+#elif defined(USE_CILK_RUNTIME)
+  fork2(exp1, exp2);
+#elif defined(WORKSPAN)
+  fork2_measured([p] (const auto& e1, const auto& e2) {
+    my_thread()->fork2_with_priority(p, new_multishot_by_lambda(e1),
+                                     new_multishot_by_lambda(e2));
+  }, exp1, exp2);
+#else
+  my_thread()->fork2_with_priority(p, new_multishot_by_lambda(exp1),
+                                   new_multishot_by_lambda(exp2));
 #endif
 }
 
@@ -239,6 +601,285 @@ void finish(const Body& body) {
   join->finish(thread);
 }
 
+/*---------------------------------------------------------------------*/
+/* Futures
+ *
+ * `spawn_future(f)` creates a thread that computes `f()` and returns
+ * a handle on its result. The thread that computes the result stores
+ * it inline, and serves as the shared state of the future: no other
+ * allocation takes place.
+ *
+ * A thread that calls `get()` on a future whose result is not yet
+ * available suspends itself. Once it has left its stack, the
+ * scheduler registers it in the lock-free list of the waiters of the
+ * future, whose nodes live in the frames of the calls to `get()`.
+ * When the result is available, the list is closed, and all of its
+ * threads are scheduled.
+ */
+
+template <class T>
+class future_thread;
+
+/*! \class future_waiter
+ *  \brief Registration of a thread suspended on a future
+ */
+class future_waiter : public outstrategy::common {
+public:
+
+  typedef std::atomic<future_waiter*> list_type;
+
+  // marks the list of a future whose result is available
+  static future_waiter* closed() {
+    return (future_waiter*)1;
+  }
+
+  thread_p cont;
+  list_type* list;
+  future_waiter* next;
+
+  future_waiter(thread_p cont, list_type* list)
+  : cont(cont), list(list), next(nullptr) { }
+
+  void add(thread_p) {
+    assert(false);
+  }
+
+  // called by the scheduler once `cont` has left its stack
+  void finished() {
+    future_waiter* head = list->load();
+    while (head != closed()) {
+      next = head;
+      // this node may be released as soon as it is in the list
+      if (list->compare_exchange_weak(head, this))
+        return;
+    }
+    outstrategy::decr_dependencies(cont);
+    // lives in the frame of `get`, hence no deallocation
+  }
+
+  // schedules the threads of a list that was just closed
+  static void wake_all(future_waiter* w) {
+    while (w != nullptr) {
+      future_waiter* next = w->next;
+      outstrategy::decr_dependencies(w->cont);
+      w = next;
+    }
+  }
+
+};
+
+/*! \class future_thread
+ *  \brief Thread computing the result of a future, and holding it
+ *
+ * Owned jointly by the handle of the future and by the execution of
+ * the thread; the last one to release it deallocates it.
+ */
+template <class T>
+class future_thread : public multishot {
+private:
+
+  class completion : public outstrategy::common {
+  public:
+    future_thread* f;
+    void add(thread_p) {
+      assert(false);
+    }
+    // called by the scheduler after the body of the thread
+    void finished() {
+      f->complete();
+    }
+  };
+
+  future_waiter::list_type waiters;
+  std::atomic<int> nb_refs;
+  completion out;
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type result;
+
+protected:
+
+  void set_result(T&& r) {
+    new (&result) T(std::move(r));
+  }
+
+public:
+
+  future_thread()
+  : multishot(), waiters(nullptr), nb_refs(2) {
+    out.f = this;
+    // deallocated by `release`
+    set_should_not_deallocate(true);
+  }
+
+  ~future_thread() {
+    if (ready())
+      get_result().~T();
+  }
+
+  void start() {
+    set_instrategy(instrategy::ready_new());
+    set_outstrategy(&out);
+    threaddag::add_thread(this);
+  }
+
+  bool ready() {
+    return waiters.load() == future_waiter::closed();
+  }
+
+  T& get_result() {
+    return *(T*)&result;
+  }
+
+  void wait() {
+    if (ready())
+      return;
+    multishot* cont = (multishot*)threaddag::my_sched()->get_current_thread();
+    assert(cont != nullptr);
+    future_waiter w(cont, &waiters);
+    cont->suspend_with(&w);
+    assert(ready());
+  }
+
+  // to be called once the result is stored
+  void complete() {
+    future_waiter* ws = waiters.exchange(future_waiter::closed());
+    future_waiter::wake_all(ws);
+    release();
+  }
+
+  void release() {
+    if (nb_refs.fetch_sub(1) == 1)
+      delete this;
+  }
+
+};
+
+template <class T, class Function>
+class future_thread_by_lambda : public future_thread<T> {
+private:
+
+  Function f;
+
+public:
+
+  future_thread_by_lambda(const Function& f) : f(f) { }
+
+  void run() {
+    this->set_result(f());
+  }
+
+  THREAD_COST_UNKNOWN
+};
+
+/*! \class future
+ *  \brief Handle on the result of a call to `spawn_future`
+ *
+ * Handles can be moved but not copied.
+ */
+template <class T>
+class future {
+private:
+
+  future_thread<T>* t;
+
+public:
+
+  future() : t(nullptr) { }
+
+  future(future_thread<T>* t) : t(t) { }
+
+  future(future&& other) : t(other.t) {
+    other.t = nullptr;
+  }
+
+  future& operator=(future&& other) {
+    std::swap(t, other.t);
+    return *this;
+  }
+
+  future(const future&) = delete;
+  future& operator=(const future&) = delete;
+
+  ~future() {
+    if (t != nullptr)
+      t->release();
+  }
+
+  //! Returns true if the result is available
+  bool ready() const {
+    return t->ready();
+  }
+
+  /*! \brief Returns the result, suspending the calling thread until it
+   *  is available
+   *
+   *  \pre to be called from a multishot thread
+   */
+  T& get() {
+    t->wait();
+    return t->get_result();
+  }
+
+};
+
+/*! \brief Creates a thread that computes `f()` and returns a future
+ *  on its result
+ */
+template <class Function>
+future<typename std::decay<decltype(std::declval<Function>()())>::type>
+spawn_future(const Function& f) {
+  typedef typename std::decay<decltype(std::declval<Function>()())>::type T;
+  future_thread<T>* t = new future_thread_by_lambda<T, Function>(f);
+#if defined(SEQUENTIAL_ELISION) || defined(USE_CILK_RUNTIME)
+  t->run();
+  t->complete();
+#else
+  t->start();
+#endif
+  return future<T>(t);
+}
+
+/*---------------------------------------------------------------------*/
+/* Submission from outside the worker group */
+
+// stores the result of a submitted function into its promise
+template <class Result>
+class submit_body {
+public:
+  template <class Function>
+  static void run(std::promise<Result>& promise, const Function& f) {
+    promise.set_value(f());
+  }
+};
+
+template <>
+class submit_body<void> {
+public:
+  template <class Function>
+  static void run(std::promise<void>& promise, const Function& f) {
+    f();
+    promise.set_value();
+  }
+};
+
+/*! \brief Runs `f` as an independent root computation, which may
+ *  use `fork2` and the other operations of this namespace
+ *
+ * May be called from any thread (see `threaddag::submit`); the
+ * result of `f` is delivered through the returned future. A worker
+ * must not wait on the future, since it would stop serving steal
+ * requests.
+ */
+template <class Function>
+std::future<decltype(std::declval<Function>()())> submit(const Function& f) {
+  typedef decltype(std::declval<Function>()()) result_type;
+  auto promise = std::make_shared<std::promise<result_type>>();
+  std::future<result_type> future = promise->get_future();
+  threaddag::submit(new_multishot_by_lambda([promise, f] {
+    submit_body<result_type>::run(*promise, f);
+  }));
+  return future;
+}
+
 static inline void yield() {
   multishot* thread = my_thread();
   assert(thread != nullptr);
@@ -593,10 +1234,10 @@ void combine(Number lo, Number hi, Output& out, const Join_output& join,
     src.second = mid;
   };
   auto _body = [&body] (range_type r, Output& out) {
-    Number lo = r.first;
-    Number hi = r.second;
-    for (Number i = lo; i < hi; i++)
+    // checks for steal requests every so many iterations
+    polling::for_each(r.first, r.second, [&] (Number i) {
       body(i, out);
+    });
   };
   forkjoin(in, out, cutoff, fork, join, _body);
 }
@@ -16,6 +16,7 @@
 #include "thread.hpp"
 #include "messagestrategy.hpp"
 #include "tagged.hpp"
+#include "idle.hpp"
 
 namespace pasl {
 namespace sched {
@@ -140,6 +141,8 @@ public:
   virtual void finished () {
     STAT_IDLE(finished_launch());
     util::worker::the_group.request_exit_worker0();
+    // worker 0 may be parked
+    idle::notify(0);
     noop::finished();
   }
 
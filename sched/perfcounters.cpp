@@ -0,0 +1,152 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file perfcounters.cpp
+ *
+ */
+
+#include <unistd.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfcounters.hpp"
+#include "perworker.hpp"
+#include "cmdline.hpp"
+#include "atomic.hpp"
+
+namespace pasl {
+namespace util {
+namespace perfcounters {
+
+/***********************************************************************/
+
+bool enabled = false;
+
+/*---------------------------------------------------------------------*/
+
+// the counters of a worker, read at once through the group leader
+class group_t {
+public:
+  int leader;
+  int fds[NB_COUNTERS];
+  // position of each counter in the values read from the leader, or -1
+  int slot[NB_COUNTERS];
+  int nb;
+  group_t() : leader(-1), nb(0) {
+    for (int c = 0; c < NB_COUNTERS; c++) {
+      fds[c] = -1;
+      slot[c] = -1;
+    }
+  }
+};
+
+static data::perworker::array<group_t> groups;
+static bool available[NB_COUNTERS];
+
+static uint64_t config_of_counter(counter_t c) {
+  switch (c) {
+    case CYCLES: return PERF_COUNT_HW_CPU_CYCLES;
+    case INSTRUCTIONS: return PERF_COUNT_HW_INSTRUCTIONS;
+    case CACHE_MISSES: return PERF_COUNT_HW_CACHE_MISSES;
+    case BRANCH_MISSES: return PERF_COUNT_HW_BRANCH_MISSES;
+    case STALLED_CYCLES: return PERF_COUNT_HW_STALLED_CYCLES_BACKEND;
+    default: assert(false); return 0;
+  }
+}
+
+static int open_counter(counter_t c, int group_fd) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config_of_counter(c);
+  attr.read_format = PERF_FORMAT_GROUP
+    | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  // the group starts when its leader is enabled
+  attr.disabled = (group_fd == -1) ? 1 : 0;
+  // the calling thread, on any cpu
+  return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+void init() {
+  enabled = cmdline::parse_or_default_bool("perf_counters", false, false);
+  for (int c = 0; c < NB_COUNTERS; c++)
+    available[c] = false;
+}
+
+void open_mine() {
+  if (! enabled)
+    return;
+  group_t& g = groups.mine();
+  g = group_t();
+  for (int c = 0; c < NB_COUNTERS; c++) {
+    int fd = open_counter((counter_t) c, g.leader);
+    if (fd == -1)
+      continue;
+    if (g.leader == -1)
+      g.leader = fd;
+    g.fds[c] = fd;
+    g.slot[c] = g.nb++;
+    available[c] = true;
+  }
+  if (g.leader == -1) {
+    if (worker::get_my_id() == 0)
+      atomic::aprintf("warning: no hardware performance counter available\n");
+    return;
+  }
+  ioctl(g.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(g.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void close_mine() {
+  if (! enabled)
+    return;
+  group_t& g = groups.mine();
+  for (int c = 0; c < NB_COUNTERS; c++)
+    if (g.fds[c] != -1)
+      close(g.fds[c]);
+  g = group_t();
+}
+
+bool is_available(counter_t c) {
+  return enabled && available[c];
+}
+
+bool read(worker_id_t id, sample_t& s) {
+  group_t& g = groups[id];
+  if (g.leader == -1)
+    return false;
+  // nr, time_enabled, time_running, then one value per counter
+  uint64_t buf[3 + NB_COUNTERS];
+  ssize_t szb = ::read(g.leader, buf, sizeof(buf));
+  if (szb < (ssize_t) (3 * sizeof(uint64_t)))
+    return false;
+  s.time_enabled = buf[1];
+  s.time_running = buf[2];
+  for (int c = 0; c < NB_COUNTERS; c++)
+    s.values[c] = (g.slot[c] == -1) ? 0 : buf[3 + g.slot[c]];
+  return true;
+}
+
+/*---------------------------------------------------------------------*/
+
+void counts_t::add(const sample_t& start, const sample_t& stop) {
+  uint64_t nb_enabled = stop.time_enabled - start.time_enabled;
+  uint64_t nb_running = stop.time_running - start.time_running;
+  // the group was not always on the pmu: extrapolate
+  double scale = (nb_running > 0 && nb_running < nb_enabled)
+    ? (double) nb_enabled / (double) nb_running : 1.;
+  for (int c = 0; c < NB_COUNTERS; c++)
+    values[c] += (uint64_t) (scale * (double) (stop.values[c] - start.values[c]));
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
@@ -0,0 +1,118 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file perfcounters.hpp
+ * \brief Hardware performance counters of the workers
+ *
+ */
+
+#ifndef _PASL_PERFCOUNTERS_H_
+#define _PASL_PERFCOUNTERS_H_
+
+#include <string>
+#include <stdint.h>
+
+#include "worker.hpp"
+
+/***********************************************************************/
+
+namespace pasl {
+namespace util {
+namespace perfcounters {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * With `-perf_counters 1`, each worker opens, when it starts, a group of
+ * hardware counters (`perf_event_open`) which count the events of its
+ * own thread in user space. The statistics module samples them around
+ * each launch and around each measured sequential run of the
+ * granularity controller, so as to split the events of each worker
+ * between sequential code and everything else (scheduling, idling,
+ * parallel code not run under a controller).
+ *
+ * Counters which the machine or the kernel do not support (e.g. in a
+ * virtual machine, or with a restrictive `perf_event_paranoid`) are
+ * left out; a warning is printed if none is available.
+ */
+
+typedef enum {
+  CYCLES = 0,
+  INSTRUCTIONS,
+  CACHE_MISSES,
+  BRANCH_MISSES,
+  STALLED_CYCLES,
+  NB_COUNTERS
+} counter_t;
+
+static inline std::string name_of_counter(counter_t c) {
+  switch (c) {
+    case CYCLES: return std::string("cycles");
+    case INSTRUCTIONS: return std::string("instructions");
+    case CACHE_MISSES: return std::string("cache_misses");
+    case BRANCH_MISSES: return std::string("branch_misses");
+    case STALLED_CYCLES: return std::string("stalled_cycles");
+    default: return std::string("unknown");
+  }
+}
+
+//! Values of the counters of one worker at a point in time
+class sample_t {
+public:
+  uint64_t time_enabled;
+  uint64_t time_running;
+  uint64_t values[NB_COUNTERS];
+  sample_t() : time_enabled(0), time_running(0) {
+    for (int c = 0; c < NB_COUNTERS; c++)
+      values[c] = 0;
+  }
+};
+
+//! Events counted between two samples, scaled if the group was multiplexed
+class counts_t {
+public:
+  uint64_t values[NB_COUNTERS];
+  counts_t() {
+    reset();
+  }
+  void reset() {
+    for (int c = 0; c < NB_COUNTERS; c++)
+      values[c] = 0;
+  }
+  void add(const sample_t& start, const sample_t& stop);
+  void add(const counts_t& other) {
+    for (int c = 0; c < NB_COUNTERS; c++)
+      values[c] += other.values[c];
+  }
+  //! `values[c] - other.values[c]`, or zero if negative
+  uint64_t minus(const counts_t& other, counter_t c) const {
+    return (values[c] > other.values[c]) ? values[c] - other.values[c] : 0;
+  }
+};
+
+extern bool enabled;
+
+void init();
+
+//! To be called by each worker thread, when it starts and stops
+void open_mine();
+void close_mine();
+
+//! Returns true if counter `c` could be opened by some worker
+bool is_available(counter_t c);
+
+//! Reads the counters of worker `id`; returns false if it has none
+bool read(worker_id_t id, sample_t& s);
+
+static inline bool read_mine(sample_t& s) {
+  return enabled && read(worker::get_my_id(), s);
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+#endif /*! _PASL_PERFCOUNTERS_H_ */
@@ -0,0 +1,132 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file polling.cpp
+ *
+ */
+
+#include "polling.hpp"
+#include "threaddag.hpp"
+#include "cmdline.hpp"
+#include "stats.hpp"
+
+namespace pasl {
+namespace sched {
+namespace polling {
+
+/***********************************************************************/
+
+// bucket `k` counts the latencies in [2^(k-1), 2^k) cycles
+static const int nb_buckets = 64;
+
+class histogram_t {
+public:
+  long buckets[nb_buckets];
+  long nb_requests;
+  double total_cycles;
+
+  histogram_t() {
+    reset();
+  }
+
+  void reset() {
+    for (int k = 0; k < nb_buckets; k++)
+      buckets[k] = 0;
+    nb_requests = 0;
+    total_cycles = 0.;
+  }
+
+  void add(uint64_t cycles) {
+    int k = (cycles == 0) ? 0 : 64 - __builtin_clzll(cycles);
+    buckets[std::min(k, nb_buckets - 1)]++;
+    nb_requests++;
+    total_cycles += (double)cycles;
+  }
+};
+
+bool enabled = false;
+data::perworker::array<flag_t> flags;
+data::perworker::array<long> nb_iters;
+uint64_t target_cycles;
+
+static data::perworker::array<histogram_t> histograms;
+
+/*---------------------------------------------------------------------*/
+
+void init() {
+  target_cycles = (uint64_t)util::cmdline::parse_or_default_int("poll_cycles", 20000, false);
+  target_cycles = std::max(target_cycles, (uint64_t)2);
+  nb_iters.init(1);
+  flags.for_each([] (worker_id_t, flag_t& f) {
+    f.pending.store(0);
+    f.date.store(0);
+  });
+  histograms.for_each([] (worker_id_t, histogram_t& h) {
+    h.reset();
+  });
+}
+
+void enable() {
+  enabled = true;
+}
+
+void destroy() {
+  enabled = false;
+}
+
+void output(FILE* f) {
+  if (! enabled)
+    return;
+  histogram_t total;
+  histograms.for_each([&] (worker_id_t, histogram_t& h) {
+    for (int k = 0; k < nb_buckets; k++)
+      total.buckets[k] += h.buckets[k];
+    total.nb_requests += h.nb_requests;
+    total.total_cycles += h.total_cycles;
+  });
+  fprintf(f, "poll_requests\t%ld\n", total.nb_requests);
+  double mean = (total.nb_requests == 0) ? 0. : total.total_cycles / total.nb_requests;
+  fprintf(f, "poll_latency_mean\t%.0lf\n", mean);
+  for (int k = 0; k < nb_buckets; k++)
+    if (total.buckets[k] > 0)
+      fprintf(f, "poll_latency_lt_%llu\t%ld\n", 1ull << k, total.buckets[k]);
+}
+
+/*---------------------------------------------------------------------*/
+
+void request(worker_id_t victim) {
+  flag_t& f = flags[victim];
+  f.date.store(util::ticks::now(), std::memory_order_relaxed);
+  f.pending.store(1, std::memory_order_release);
+}
+
+void acknowledge() {
+  flag_t& f = flags.mine();
+  if (f.pending.load(std::memory_order_acquire) == 0)
+    return;
+  uint64_t date = f.date.load(std::memory_order_relaxed);
+  f.pending.store(0, std::memory_order_relaxed);
+  uint64_t now = util::ticks::now();
+  histograms.mine().add((now > date) ? now - date : 0);
+}
+
+void handle() {
+  scheduler_p sched = threaddag::my_sched();
+  if (sched->should_call_communicate()) {
+    // calls `acknowledge()`
+    sched->communicate();
+    return;
+  }
+  /* the flag was raised after the request got answered elsewhere
+   * (e.g., at a fork); lowering it may lose the flag of a newer
+   * request, which then waits for the next call to `communicate()`
+   */
+  flags.mine().pending.store(0, std::memory_order_relaxed);
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
@@ -0,0 +1,137 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file polling.hpp
+ * \brief Polling for steal requests in running threads
+ *
+ */
+
+#ifndef _PASL_SCHED_POLLING_H_
+#define _PASL_SCHED_POLLING_H_
+
+#include <atomic>
+#include <algorithm>
+#include <stdio.h>
+
+#include "worker.hpp"
+#include "perworker.hpp"
+#include "ticks.hpp"
+
+/***********************************************************************/
+
+namespace pasl {
+namespace sched {
+namespace polling {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * With the receiver-initiated schedulers, a steal request gets
+ * answered only when its victim calls `communicate()`, which happens
+ * in the scheduler loop, at forks, or, with `cas_ri_interrupt`, from a
+ * signal handler triggered by the `ping_loop` thread. Polling replaces
+ * the signals: the thief raises a flag, which sits in a cache line of
+ * its own, in the record of the victim, and the victim checks this
+ * flag at the points where the granularity controller runs code
+ * sequentially, namely around the sequential bodies of `cstmt` and
+ * inside the sequential loops of `parallel_for`. A raised flag makes
+ * the victim call `communicate()` right away.
+ *
+ * Checking the flag is one load, but `parallel_for` loops, whose
+ * iterations may be very short, check it only every so many
+ * iterations. Each worker adapts this number so that two checks are
+ * about `-poll_cycles` cycles apart (default 20000): it doubles when
+ * a batch of iterations runs in less than half of this delay, and
+ * halves when it takes more than twice as much.
+ *
+ * For each steal request, the delay between the raising of the flag
+ * and the answer of the victim is recorded in a histogram of
+ * power-of-two buckets of cycles, printed by `output()`.
+ *
+ * Polling is enabled by `-threadset cas_ri_polling`; otherwise, all
+ * the functions below return right away.
+ */
+
+// the cells of `perworker::array` are padded: each flag sits in a
+// cache line of its own
+class flag_t {
+public:
+  std::atomic<int> pending;
+  // date of the steal request, in cycles
+  std::atomic<uint64_t> date;
+  flag_t() : pending(0), date(0) { }
+};
+
+extern bool enabled;
+extern data::perworker::array<flag_t> flags;
+// number of loop iterations between two checks, for each worker
+extern data::perworker::array<long> nb_iters;
+extern uint64_t target_cycles;
+
+void init();
+//! Turns on polling; to be called before the workers are created
+void enable();
+void destroy();
+//! Prints the histogram of the latencies to answer steal requests
+void output(FILE* f);
+
+//! Raises the flag of worker `victim`; called by a thief
+void request(worker_id_t victim);
+
+/*! \brief Lowers the flag of the calling worker, and records the
+ *  latency of the request; called by the victim when it answers
+ */
+void acknowledge();
+
+//! Answers the pending steal request of the calling worker, if any
+void handle();
+
+//! Checks the flag of the calling worker
+static inline void poll() {
+  if (enabled && flags.mine().pending.load(std::memory_order_relaxed))
+    handle();
+}
+
+// adapts `n`, the size of a batch that took `elapsed` cycles
+static inline long next_nb_iters(long n, uint64_t elapsed) {
+  if (elapsed < target_cycles / 2)
+    return std::min(n * 2, 1l << 30);
+  if (elapsed > target_cycles * 2)
+    return std::max(n / 2, 1l);
+  return n;
+}
+
+/*! \brief Runs `body(i)` for each `i` in `[lo, hi)`, checking the
+ *  flag of the calling worker between batches of iterations
+ */
+template <class Number, class Body>
+void for_each(Number lo, Number hi, const Body& body) {
+  if (! enabled) {
+    for (Number i = lo; i < hi; i++)
+      body(i);
+    return;
+  }
+  Number i = lo;
+  while (i < hi) {
+    // `body` may migrate the calling thread to another worker, hence
+    // the cell of the worker is looked up again for each access
+    long n = nb_iters.mine();
+    Number last = (hi - i > (Number)n) ? i + (Number)n : hi;
+    bool full = (last - i == (Number)n);
+    util::ticks::ticks_t start = util::ticks::now();
+    for (; i < last; i++)
+      body(i);
+    if (full)
+      nb_iters.mine() = next_nb_iters(n, (uint64_t)(util::ticks::now() - start));
+    poll();
+  }
+}
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+/***********************************************************************/
+
+#endif /*! _PASL_SCHED_POLLING_H_ */
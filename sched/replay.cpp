@@ -0,0 +1,342 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file replay.cpp
+ *
+ */
+
+#include <atomic>
+#include <vector>
+#include <queue>
+#include <string>
+#include <stdio.h>
+
+#include "replay.hpp"
+#include "cmdline.hpp"
+#include "ticks.hpp"
+#include "atomic.hpp"
+#include "logging.hpp"
+#include "idle.hpp"
+
+namespace pasl {
+namespace sched {
+namespace replay {
+
+/***********************************************************************/
+
+bool recording = false;
+bool replaying = false;
+data::perworker::array<long> nb_started;
+
+/*---------------------------------------------------------------------*/
+/* Recording */
+
+typedef struct {
+  util::ticks::ticks_t date;
+  worker_id_t victim;
+  worker_id_t thief;
+  thread_p thread;
+  long progress;
+} decision_t;
+
+class buffer_t {
+public:
+  decision_t* items;
+  long nb;
+  long nb_dropped;
+  buffer_t() : items(nullptr), nb(0), nb_dropped(0) { }
+};
+
+static std::string record_file;
+static long capacity = 1l << 20;
+static util::ticks::ticks_t basetime;
+static data::perworker::array<buffer_t> buffers;
+// progress of the victim of the transfer to each thief, if set by the victim
+static data::perworker::array<long> progress_given;
+
+void record(worker_id_t victim, worker_id_t thief, thread_p thread) {
+  buffer_t& b = buffers.mine();
+  if (b.nb == capacity) {
+    b.nb_dropped++;
+    return;
+  }
+  decision_t& d = b.items[b.nb++];
+  d.date = util::ticks::now();
+  d.victim = victim;
+  d.thief = thief;
+  d.thread = thread;
+  long& given = progress_given[thief];
+  if (given >= 0) {
+    d.progress = given;
+    given = -1;
+  } else
+    d.progress = nb_started[victim];
+}
+
+void gave(worker_id_t thief) {
+  progress_given[thief] = nb_started.mine();
+}
+
+static inline void fwrite_int64(FILE* f, int64_t v) {
+  fwrite(&v, sizeof(v), 1, f);
+}
+
+/* the buffers are each sorted by date; the k-way merge keeps in a heap
+ * the position of the next decision of each worker
+ */
+static void write_records() {
+  FILE* f = fopen(record_file.c_str(), "w");
+  if (f == nullptr)
+    util::atomic::die("cannot open steal record file %s\n", record_file.c_str());
+  typedef std::pair<util::ticks::ticks_t, worker_id_t> head_t;
+  std::priority_queue<head_t, std::vector<head_t>, std::greater<head_t>> heads;
+  int nb_workers = util::worker::get_nb();
+  std::vector<long> pos(nb_workers, 0);
+  long nb_dropped = 0;
+  for (worker_id_t id = 0; id < nb_workers; id++) {
+    nb_dropped += buffers[id].nb_dropped;
+    if (buffers[id].nb > 0)
+      heads.push(head_t(buffers[id].items[0].date, id));
+  }
+  long nb = 0;
+  while (! heads.empty()) {
+    worker_id_t id = heads.top().second;
+    heads.pop();
+    buffer_t& b = buffers[id];
+    decision_t& d = b.items[pos[id]++];
+    fwrite_int64(f, (int64_t) util::ticks::microseconds(d.date - basetime));
+    fwrite_int64(f, (int64_t) id);
+    fwrite_int64(f, (int64_t) util::logging::STEAL_DECISION);
+    fwrite_int64(f, (int64_t) d.victim);
+    fwrite_int64(f, (int64_t) d.thief);
+    fwrite_int64(f, (int64_t) d.thread);
+    fwrite_int64(f, (int64_t) d.progress);
+    nb++;
+    if (pos[id] < b.nb)
+      heads.push(head_t(b.items[pos[id]].date, id));
+  }
+  fclose(f);
+  printf("steal_decisions\t%ld\n", nb);
+  if (nb_dropped > 0)
+    printf("steal_decisions_dropped\t%ld\n", nb_dropped);
+}
+
+/*---------------------------------------------------------------------*/
+/* Replay */
+
+class step_t {
+public:
+  long index;           // position in the global order
+  worker_id_t target;
+  step_t(long index, worker_id_t target) : index(index), target(target) { }
+};
+
+// a transfer from the worker, due once it has started `progress` threads
+class hold_t {
+public:
+  long index;
+  long progress;
+  hold_t(long index, long progress) : index(index), progress(progress) { }
+};
+
+class cursor_t {
+public:
+  std::vector<step_t> steps;
+  size_t next;
+  std::vector<hold_t> holds;
+  size_t next_hold;
+  cursor_t() : next(0), next_hold(0) { }
+};
+
+static double timeout_us = 100000.;
+static data::perworker::array<cursor_t> cursors;
+// for each step of the global order, its picker and its recorded date
+static std::vector<worker_id_t> picker_of_step;
+static std::vector<int64_t> date_of_step;
+static std::atomic<long> turn;
+static std::atomic<util::ticks::ticks_t> last_step_date;
+static std::atomic<bool> diverged;
+
+static bool read_int64(FILE* f, int64_t& v) {
+  return fread(&v, sizeof(v), 1, f) == 1;
+}
+
+static void load(std::string fname) {
+  FILE* f = fopen(fname.c_str(), "r");
+  if (f == nullptr)
+    util::atomic::die("cannot open steal record file %s\n", fname.c_str());
+  int nb_workers = util::worker::get_nb();
+  int64_t date, picker, type, victim, thief, thread, progress;
+  while (read_int64(f, date) && read_int64(f, picker) && read_int64(f, type)) {
+    if (type != util::logging::STEAL_DECISION)
+      util::atomic::die("bad event type %ld in steal record file\n", (long) type);
+    if (! (read_int64(f, victim) && read_int64(f, thief) && read_int64(f, thread)
+           && read_int64(f, progress)))
+      util::atomic::die("truncated steal record file\n");
+    if (picker < 0 || picker >= nb_workers || victim < 0 || victim >= nb_workers
+        || thief < 0 || thief >= nb_workers)
+      util::atomic::die("steal record file needs more than %d workers\n", nb_workers);
+    worker_id_t target = (worker_id_t) ((victim == picker) ? thief : victim);
+    long index = (long) picker_of_step.size();
+    cursors[(worker_id_t) picker].steps.push_back(step_t(index, target));
+    cursors[(worker_id_t) victim].holds.push_back(hold_t(index, (long) progress));
+    picker_of_step.push_back((worker_id_t) picker);
+    date_of_step.push_back(date);
+  }
+  fclose(f);
+}
+
+static inline bool is_constrained() {
+  return replaying && ! diverged.load(std::memory_order_relaxed);
+}
+
+static void diverge() {
+  bool orig = false;
+  if (! diverged.compare_exchange_strong(orig, true))
+    return;
+  long t = turn.load();
+  if (t >= (long) picker_of_step.size())
+    util::atomic::aprintf("warning: schedule diverged from steal record after its %ld decisions\n",
+                          t);
+  else
+    util::atomic::aprintf("warning: schedule diverged from steal record at decision %ld\n", t);
+}
+
+/* a worker gives up on its turn if no decision was made for longer
+ * than the timeout, or than twice the recorded gap before the next
+ * decision, so that long sequential phases are not taken for a
+ * divergence
+ */
+static bool is_timed_out(long t) {
+  double gap_us = 0.;
+  if (t < (long) date_of_step.size())
+    gap_us = (double) (date_of_step[t] - ((t > 0) ? date_of_step[t - 1] : 0));
+  double limit_us = std::max(timeout_us, 2. * gap_us);
+  return util::ticks::microseconds_since(last_step_date.load()) > limit_us;
+}
+
+// skips the transfers from the calling worker which are done
+static inline hold_t* next_hold(cursor_t& c, long t) {
+  while (c.next_hold < c.holds.size() && c.holds[c.next_hold].index < t)
+    c.next_hold++;
+  return (c.next_hold < c.holds.size()) ? &c.holds[c.next_hold] : nullptr;
+}
+
+bool may_decide() {
+  if (! is_constrained())
+    return true;
+  cursor_t& c = cursors.mine();
+  long t = turn.load(std::memory_order_acquire);
+  if (c.next < c.steps.size() && c.steps[c.next].index == t) {
+    // a victim that picks its thief waits until it has the same threads
+    hold_t* h = next_hold(c, t);
+    return h == nullptr || h->index != t || h->progress <= nb_started.mine();
+  }
+  if (t >= (long) picker_of_step.size()) {
+    // past the end of the record, attempts are left to the victim
+    // selection policy; one that succeeds is reported by `decided()`
+    return true;
+  }
+  if (is_timed_out(t)) {
+    diverge();
+    return true;
+  }
+  return false;
+}
+
+worker_id_t next_target() {
+  if (! is_constrained())
+    return util::worker::undef;
+  cursor_t& c = cursors.mine();
+  if (c.next >= c.steps.size())
+    return util::worker::undef;
+  return c.steps[c.next].target;
+}
+
+void decided(worker_id_t target) {
+  if (! is_constrained())
+    return;
+  cursor_t& c = cursors.mine();
+  if (c.next >= c.steps.size() || c.steps[c.next].index != turn.load()
+      || c.steps[c.next].target != target) {
+    diverge();
+    return;
+  }
+  c.next++;
+  last_step_date.store(util::ticks::now());
+  long t = turn.load() + 1;
+  turn.store(t, std::memory_order_release);
+  if (t < (long) picker_of_step.size())
+    idle::notify(picker_of_step[t]);
+}
+
+bool must_hold() {
+  if (! is_constrained())
+    return false;
+  cursor_t& c = cursors.mine();
+  long t = turn.load(std::memory_order_acquire);
+  hold_t* h = next_hold(c, t);
+  if (h == nullptr || h->progress > nb_started.mine())
+    return false;
+  // the worker has to take threads before it gives some away
+  if (c.next < c.steps.size() && c.steps[c.next].index < h->index)
+    return false;
+  if (is_timed_out(t)) {
+    diverge();
+    return false;
+  }
+  return true;
+}
+
+/*---------------------------------------------------------------------*/
+
+void init() {
+  record_file = util::cmdline::parse_or_default_string("steal_record", "", false);
+  std::string replay_file = util::cmdline::parse_or_default_string("steal_replay", "", false);
+  recording = ! record_file.empty();
+  replaying = ! replay_file.empty();
+  capacity = std::max(1l, (long) util::cmdline::parse_or_default_int("steal_record_capacity", 1 << 20, false));
+  timeout_us = util::cmdline::parse_or_default_double("steal_replay_timeout_us", 100000., false);
+  basetime = util::ticks::now();
+  if (recording)
+    buffers.for_each([&] (worker_id_t, buffer_t& b) {
+      b.items = new decision_t[capacity];
+      b.nb = 0;
+      b.nb_dropped = 0;
+    });
+  picker_of_step.clear();
+  date_of_step.clear();
+  cursors.for_each([&] (worker_id_t, cursor_t& c) {
+    c = cursor_t();
+  });
+  nb_started.init(0);
+  progress_given.init(-1);
+  turn.store(0);
+  last_step_date.store(util::ticks::now());
+  diverged.store(false);
+  if (replaying)
+    load(replay_file);
+}
+
+void destroy() {
+  if (recording) {
+    write_records();
+    buffers.for_each([&] (worker_id_t, buffer_t& b) {
+      delete [] b.items;
+      b = buffer_t();
+    });
+  }
+  if (replaying) {
+    printf("steal_replay_followed\t%ld/%ld\n", turn.load(), (long) picker_of_step.size());
+    printf("steal_replay_diverged\t%d\n", diverged.load() ? 1 : 0);
+  }
+  recording = false;
+  replaying = false;
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
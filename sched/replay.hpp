@@ -0,0 +1,113 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file replay.hpp
+ * \brief Record and replay of the steal decisions of work stealing
+ *
+ */
+
+#ifndef _PASL_SCHED_REPLAY_H_
+#define _PASL_SCHED_REPLAY_H_
+
+#include "perworker.hpp"
+#include "thread.hpp"
+
+/***********************************************************************/
+
+namespace pasl {
+namespace sched {
+namespace replay {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * A steal decision is made by the worker that picks the other party
+ * of a transfer of threads: the thief in receiver-initiated work
+ * stealing and with shared deques, the victim in sender-initiated
+ * work stealing.
+ *
+ * With `-steal_record <file>`, each successful transfer is recorded,
+ * by the worker that made the decision, as the victim, the thief, the
+ * transferred thread, the number of threads started so far by the
+ * victim, and the date of the transfer. The records go to a buffer
+ * owned by the worker, preallocated with room for
+ * `-steal_record_capacity` records (default 1048576); records that do
+ * not fit are dropped, and counted. When the worker group is
+ * destroyed, the buffers are merged by date and written to the file
+ * in the binary format of `logging::recorder_t::dump_byte`, as events
+ * of type `STEAL_DECISION` whose description consists of the victim,
+ * the thief, the address of the thread and the count of threads of
+ * the victim; `pview` shows them.
+ *
+ * With `-steal_replay <file>`, the workers follow a recorded file:
+ * - the `k`-th decision of a worker targets the worker recorded for
+ *   its `k`-th decision;
+ * - decisions are taken in the recorded global order: a worker whose
+ *   next decision is not the next one in this order does not attempt
+ *   any transfer;
+ * - a victim that has started as many threads as it had when one of
+ *   its recorded transfers took place does not pop another one from
+ *   its scheduling loop before this transfer is done (`must_hold()`),
+ *   so that it has the same threads to give away as in the recording.
+ *
+ * The replay is thus exact for deterministic programs run with the
+ * same arguments, up to transfers which, in the recording, took place
+ * in the middle of the execution of a thread. Threads submitted from
+ * outside of the workers are not covered. If no decision is made for
+ * more than `-steal_replay_timeout_us` microseconds (default 100000),
+ * or than twice the recorded delay before the next decision, the
+ * schedule has diverged from the recording: a warning is printed and
+ * the workers go back to their victim selection policy. Once all the
+ * recorded decisions are made, the workers also follow their policy;
+ * a transfer taking place then is reported as a divergence.
+ */
+
+void init();
+void destroy();
+
+extern bool recording;
+extern bool replaying;
+
+//! Number of threads started by each worker, when recording or replaying
+extern data::perworker::array<long> nb_started;
+
+//! To be called each time the calling worker starts a thread
+static inline void started() {
+  if (recording || replaying)
+    nb_started.mine()++;
+}
+
+//! Records a transfer of `thread` from `victim` to `thief`
+void record(worker_id_t victim, worker_id_t thief, thread_p thread);
+
+/*! \brief To be called by a victim which gives threads to `thief`, when
+ *  the thief is the one recording the transfer
+ */
+void gave(worker_id_t thief);
+
+/*! \brief Returns false if the calling worker must not make a steal
+ *  decision yet, because some other worker is due to make the next one
+ */
+bool may_decide();
+
+/*! \brief Returns the target of the next decision of the calling
+ *  worker, or `undef` if the replay does not constrain it
+ */
+worker_id_t next_target();
+
+//! Advances the replay after a successful decision targeting `target`
+void decided(worker_id_t target);
+
+/*! \brief Returns true if the calling worker must not start its next
+ *  thread yet, because a recorded transfer from it is still due
+ */
+bool must_hold();
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+/***********************************************************************/
+
+#endif /*! _PASL_SCHED_REPLAY_H_ */
@@ -2,6 +2,10 @@
 #include "tls.hpp"
 #include "scheduler.hpp"
 #include "messagestrategy.hpp"
+#include "stackpool.hpp"
+#include "alloc.hpp"
+#include "replay.hpp"
+#include "perfcounters.hpp"
 
 namespace pasl {
 namespace sched {
@@ -21,12 +25,14 @@ bool _private::stay() {
 
 void _private::init() { 
   controller_t::init();
+  util::perfcounters::open_mine();
   //add_periodic(messagestrategy::the_messagestrategy);
   current_thread = nullptr;
   should_communicate = false;
 }
 
 void _private::destroy() {
+  util::perfcounters::close_mine();
   controller_t::destroy();
   //rem_periodic(messagestrategy::the_messagestrategy);
 }
@@ -39,6 +45,9 @@ void _private::new_launch() {
 void _private::enter_wait() {
   LOG_BASIC(ENTER_WAIT);
   STAT_COUNT(ENTER_WAIT);
+  stackpool::trim();
+  // returns the blocks freed on behalf of other workers
+  alloc::flush();
  // STAT_IDLE_ONLY(date_enter_wait = ticks::now());
    STAT_IDLE_ONLY(date_enter_wait = util::microtime::now());
   util::worker::controller_t::enter_wait();
@@ -66,10 +75,12 @@ void _private::exec(thread_p t) {
   assert(t != nullptr);
   LOG_THREAD(THREAD_EXEC, t);
   STAT_COUNT(THREAD_EXEC);
+  replay::started();
 #ifdef TRACK_LOCALITY
-  LOG_EVENT(LOCALITY, new util::logging::locality_event_t(logging::LOCALITY_START, t->locality.low));
+  LOG_EVENT(LOCALITY, util::logging::locality_event(logging::LOCALITY_START, t->locality.low));
 #endif
   bool should_not_deallocate = t->should_not_deallocate;
+  bool stack_resident = t->stack_resident;
   reuse_thread_requested = false;
   current_thread = t;
   current_outstrategy = t->out;
@@ -80,14 +91,18 @@ void _private::exec(thread_p t) {
   allow_interrupt = true;
   t->exec();
   allow_interrupt = false;
+  // the frame holding a stack-resident thread may be gone by now: from
+  // here on, only its address is used
+  if (! stack_resident) {
 #ifdef TRACK_LOCALITY
-  LOG_EVENT(LOCALITY, new util::logging::locality_event_t(logging::LOCALITY_STOP, t->locality.hi));
+    LOG_EVENT(LOCALITY, util::logging::locality_event(logging::LOCALITY_STOP, t->locality.hi));
 #endif
-  //! \todo could handle interrupt_was_blocked
-  if (should_not_deallocate || reuse_thread_requested)
-    t->reset_caches();
-  else
-    pasl_delete(t);
+    //! \todo could handle interrupt_was_blocked
+    if (should_not_deallocate || reuse_thread_requested)
+      t->reset_caches();
+    else
+      pasl_delete(t);
+  }
   LOG_THREAD(THREAD_FINISH, t);
   outstrategy::finished(t, current_outstrategy);
   current_outstrategy = nullptr; // optional
@@ -95,6 +110,8 @@ void _private::exec(thread_p t) {
 }
 
 void _private::add_thread(thread_p t) {
+  if (t->priority == PRIORITY_INHERIT)
+    t->priority = (current_thread == nullptr) ? PRIORITY_NORMAL : current_thread->priority;
   instrategy::init(t->in, t);
   LOG_THREAD(THREAD_CREATE, t);
   STAT_COUNT(THREAD_CREATE);
@@ -114,6 +131,11 @@ outstrategy_p _private::capture_outstrategy() {
   return out;
 }
 
+void _private::set_current_outstrategy(outstrategy_p out) {
+  assert (current_outstrategy != nullptr);
+  current_outstrategy = out;
+}
+
 void _private::decr_dependencies(thread_p t) {
   instrategy::delta(t->in, t, -1l);
 }
@@ -128,6 +150,8 @@ thread_p _private::get_current_thread() const {
 
 void _private::schedule(thread_p t) {
   t->in = nullptr;
+  if (t->priority == PRIORITY_INHERIT)
+    t->priority = PRIORITY_NORMAL;
   assert (t->out != nullptr);
   LOG_THREAD(THREAD_SCHEDULE, t);
   if (! allow_interrupt)
@@ -63,6 +63,7 @@ public:
   void add_dependency(thread_p t1, thread_p t2);
 
   outstrategy_p capture_outstrategy();
+  void set_current_outstrategy(outstrategy_p out);
   void decr_dependencies(thread_p t);
   void reuse_calling_thread();
   thread_p get_current_thread() const;
@@ -84,6 +85,10 @@ public:
     return false;
   }
  
+  virtual bool has_pending_request() {
+    return false;
+  }
+
   virtual  // TODO: why was the virtual missing?                    
   size_t nb_threads() {
     return 0;
@@ -0,0 +1,134 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file stackpool.cpp
+ *
+ */
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stackpool.hpp"
+#include "control.hpp"
+#include "cmdline.hpp"
+#include "atomic.hpp"
+#include "stats.hpp"
+
+namespace pasl {
+namespace sched {
+namespace stackpool {
+
+/***********************************************************************/
+
+// number of recently released stacks whose pages are left untouched by trim()
+static size_t nb_hot;
+// maximum number of stacks cached by one worker
+static size_t nb_max;
+// size of the guard region
+static size_t guard_szb;
+
+static data::perworker::extra<pool_t> pools;
+
+/*---------------------------------------------------------------------*/
+
+static size_t region_szb() {
+  return guard_szb + util::control::thread_stack_szb;
+}
+
+static char* map_stack() {
+  void* region = mmap(NULL, region_szb(), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (region == MAP_FAILED)
+    util::atomic::die("stackpool: failed to map call stack\n");
+  // stacks grow downwards: the guard page goes at the lowest address
+  if (mprotect(region, guard_szb, PROT_NONE) != 0)
+    util::atomic::die("stackpool: failed to protect guard page\n");
+  return (char*)region + guard_szb;
+}
+
+static void unmap_stack(char* stack) {
+  munmap(stack - guard_szb, region_szb());
+}
+
+/*---------------------------------------------------------------------*/
+
+void pool_t::report() {
+  STAT(report_stack_pool(stacks.size()));
+}
+
+char* pool_t::alloc() {
+  if (stacks.empty()) {
+    STAT_COUNT(STACK_ALLOC);
+    return map_stack();
+  }
+  STAT_COUNT(STACK_REUSE);
+  char* stack = stacks.back();
+  stacks.pop_back();
+  if (nb_dirty > 0)
+    nb_dirty--;
+  report();
+  return stack;
+}
+
+void pool_t::release(char* stack) {
+  if (stacks.size() >= nb_max) {
+    unmap_stack(stack);
+    return;
+  }
+  stacks.push_back(stack);
+  nb_dirty++;
+  report();
+}
+
+void pool_t::trim() {
+  if (nb_dirty <= nb_hot)
+    return;
+  // stacks in [first, last) were released before the hot ones
+  size_t last = stacks.size() - nb_hot;
+  size_t first = stacks.size() - nb_dirty;
+  for (size_t i = first; i < last; i++) {
+    madvise(stacks[i], util::control::thread_stack_szb, MADV_DONTNEED);
+    STAT_COUNT(STACK_TRIM);
+  }
+  nb_dirty = nb_hot;
+}
+
+void pool_t::destroy() {
+  for (size_t i = 0; i < stacks.size(); i++)
+    unmap_stack(stacks[i]);
+  stacks.clear();
+  nb_dirty = 0;
+}
+
+/*---------------------------------------------------------------------*/
+
+void init() {
+  nb_hot = (size_t)util::cmdline::parse_or_default_int("stackpool_hot", 4, false);
+  nb_max = (size_t)util::cmdline::parse_or_default_int("stackpool_max", 64, false);
+  guard_szb = (size_t)sysconf(_SC_PAGESIZE);
+}
+
+void destroy() {
+  pools.for_each([] (worker_id_t, pool_t& pool) {
+    pool.destroy();
+  });
+}
+
+char* alloc() {
+  return pools.mine().alloc();
+}
+
+void release(char* stack) {
+  pools.mine().release(stack);
+}
+
+void trim() {
+  pools.mine().trim();
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
@@ -0,0 +1,94 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file stackpool.hpp
+ * \brief Per-worker pools of call stacks for native threads
+ *
+ */
+
+#ifndef _PASL_SCHED_STACKPOOL_H_
+#define _PASL_SCHED_STACKPOOL_H_
+
+#include <vector>
+
+#include "perworker.hpp"
+
+/***********************************************************************/
+
+namespace pasl {
+namespace sched {
+namespace stackpool {
+
+/*---------------------------------------------------------------------*/
+
+/*! \class pool_t
+ *  \brief A cache of call stacks owned by one worker.
+ *
+ * Each stack is an anonymous `mmap` region of `thread_stack_szb`
+ * usable bytes, preceded by a guard page which is protected against
+ * reads and writes, so that a stack overflow faults instead of
+ * silently corrupting a neighbouring stack.
+ *
+ * Stacks released by a worker go back to the pool of that worker,
+ * regardless of which worker allocated them. A stack returned to the
+ * pool keeps its physical pages until the next call to `trim()`,
+ * which gives back to the OS the pages of all the cached stacks
+ * except the `nb_hot` most recently released ones.
+ *
+ * Access to a pool is not synchronized: only the owning worker may
+ * call `alloc()`, `release()` and `trim()`.
+ */
+class pool_t {
+private:
+
+  // stacks, most recently released last
+  std::vector<char*> stacks;
+  // number of stacks at the end of `stacks` whose pages may be resident
+  size_t nb_dirty;
+
+  void report();
+
+public:
+
+  pool_t() : nb_dirty(0) { }
+
+  //! Returns a stack, taken from the pool if it is non empty
+  char* alloc();
+
+  //! Puts a stack back into the pool
+  void release(char* stack);
+
+  //! Gives back to the OS the pages of the cold stacks of the pool
+  void trim();
+
+  //! Unmaps all the stacks of the pool
+  void destroy();
+
+  size_t size() const {
+    return stacks.size();
+  }
+
+};
+
+/*---------------------------------------------------------------------*/
+
+void init();
+void destroy();
+
+//! Returns a stack of `thread_stack_szb` bytes (lowest address)
+char* alloc();
+
+//! Releases a stack obtained by a call to `alloc()`
+void release(char* stack);
+
+//! Trims the pool of the calling worker
+void trim();
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+/***********************************************************************/
+
+#endif /*! _PASL_SCHED_STACKPOOL_H_ */
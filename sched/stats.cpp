@@ -6,6 +6,8 @@
  *
  */
 
+#include <functional>
+
 #include "stats.hpp"
 #include "cmdline.hpp"
 
@@ -27,6 +29,11 @@ void stats_data_t::reset() {
   waiting_time = 0.0;
   sequential_time = 0.0;
   spinning_time = 0.0;
+  parked_time = 0.0;
+  stack_pool_size = 0;
+  stack_pool_high_water = 0;
+  perf_launch.reset();
+  perf_sequential.reset();
   for (int i = 0; i < NB_STATS; i++)
     counters[i] = 0;
 }
@@ -52,6 +59,20 @@ void stats_private_t::add_to_spinning_time(double elapsed) {
   data.spinning_time += elapsed;
 }
 
+void stats_private_t::add_to_parked_time(double elapsed) {
+  data.parked_time += elapsed;
+}
+
+void stats_private_t::report_stack_pool(uint64_t size) {
+  data.stack_pool_size = size;
+  data.stack_pool_high_water = std::max(data.stack_pool_high_water, size);
+}
+
+void stats_private_t::add_to_sequential_perf(const perfcounters::sample_t& start,
+                                             const perfcounters::sample_t& stop) {
+  data.perf_sequential.add(start, stop);
+}
+
 /*---------------------------------------------------------------------*/
 
 stats_t::stats_t() { 
@@ -83,10 +104,18 @@ void stats_t::sum() {
     for (/*stat_type_t*/ int stat_type = 0; stat_type < NB_STATS; stat_type++)
       total_data.counters[stat_type] += local_data.counters[stat_type];
     total_data.spinning_time += local_data.spinning_time;
+    total_data.parked_time += local_data.parked_time;
+    total_data.stack_pool_size += local_data.stack_pool_size;
+    total_data.stack_pool_high_water += local_data.stack_pool_high_water;
+    total_data.perf_launch.add(local_data.perf_launch);
+    total_data.perf_sequential.add(local_data.perf_sequential);
   }
   double cumulated_time = launch_duration * nb_workers;
   total_idle_time = total_data.waiting_time;
   total_spinning_time = total_data.spinning_time;
+  total_parked_time = total_data.parked_time;
+  total_stack_pool_size = total_data.stack_pool_size;
+  total_stack_pool_high_water = total_data.stack_pool_high_water;
   relative_idle = total_idle_time / cumulated_time; 
   utilization = 1.0 - relative_idle;
   relative_non_seq = 1.0 - total_data.sequential_time / cumulated_time; 
@@ -103,16 +132,70 @@ void stats_t::print_idle(FILE* f) {
   fprintf(f, "utilization %.4lf\n", utilization);
 }
 
+/* the events of a worker outside of its measured sequential runs are
+ * attributed to the scheduler
+ */
+void stats_t::print_perf(FILE* f, bool per_worker) {
+  int nb_workers = worker::get_nb();
+  auto print_line = [&] (std::string name, std::function<uint64_t(stats_data_t&)> value_of) {
+    fprintf(f, "%s\t%ld\n", name.c_str(), (long)value_of(total_data));
+    if (! per_worker)
+      return;
+    fprintf(f, "%s_by_worker\t", name.c_str());
+    for (worker_id_t id = 0; id < nb_workers; id++)
+      fprintf(f, "%ld%s", (long)value_of(stats[id].data), (id + 1 < nb_workers) ? " " : "\n");
+  };
+  for (int i = 0; i < perfcounters::NB_COUNTERS; i++) {
+    perfcounters::counter_t c = (perfcounters::counter_t)i;
+    if (! perfcounters::is_available(c))
+      continue;
+    std::string name = "perf_" + perfcounters::name_of_counter(c);
+    print_line(name, [&] (stats_data_t& d) {
+      return d.perf_launch.values[c];
+    });
+    print_line(name + "_seq", [&] (stats_data_t& d) {
+      return d.perf_sequential.values[c];
+    });
+    print_line(name + "_sched", [&] (stats_data_t& d) {
+      return d.perf_launch.minus(d.perf_sequential, c);
+    });
+  }
+  if (perfcounters::is_available(perfcounters::CYCLES)
+      && perfcounters::is_available(perfcounters::INSTRUCTIONS)) {
+    auto ipc = [] (uint64_t instructions, uint64_t cycles) {
+      return (cycles == 0) ? 0. : (double)instructions / (double)cycles;
+    };
+    perfcounters::counts_t& l = total_data.perf_launch;
+    perfcounters::counts_t& s = total_data.perf_sequential;
+    fprintf(f, "perf_ipc_seq\t%.3lf\n",
+            ipc(s.values[perfcounters::INSTRUCTIONS], s.values[perfcounters::CYCLES]));
+    fprintf(f, "perf_ipc_sched\t%.3lf\n",
+            ipc(l.minus(s, perfcounters::INSTRUCTIONS), l.minus(s, perfcounters::CYCLES)));
+  }
+}
+
 void stats_t::print(FILE* f) {
   fprintf(f, "launch_duration\t%.3lf\n", launch_duration);
   // fprintf(f, "relative_idle_time\t%.4lf\n", relative_idle);
   fprintf(f, "utilization\t%.4lf\n", utilization);
   bool stats_light = cmdline::parse_or_default_bool("stats_light", true, false);
+  if (perfcounters::enabled)
+    print_perf(f, ! stats_light);
   if (! stats_light) {
     fprintf(f, "total_sequential\t%.3lf\n", total_data.sequential_time);
     fprintf(f, "average_sequential\t%.3lf\n", average_sequentialized);
     fprintf(f, "relative_non_seq\t%.4lf\n", relative_non_seq);
+    fprintf(f, "total_idle_time\t%lf\n", total_idle_time);
     fprintf(f, "total_spinning_time\t%lf\n", total_spinning_time);
+    fprintf(f, "total_parked_time\t%lf\n", total_parked_time);
+    fprintf(f, "stack_pool_size\t%ld\n", (long)total_stack_pool_size);
+    fprintf(f, "stack_pool_high_water\t%ld\n", (long)total_stack_pool_high_water);
+    uint64_t nb_steals = 0;
+    for (int i = STEAL_CORE; i <= STEAL_REMOTE; i++)
+      nb_steals += total_data.counters[i];
+    double remote_fraction = (nb_steals == 0) ? 0. :
+      (double)total_data.counters[STEAL_REMOTE] / (double)nb_steals;
+    fprintf(f, "steal_remote_fraction\t%.4lf\n", remote_fraction);
     for (int i = 0; i < NB_STATS; i++)
       fprintf(f, "%s\t%ld\n", 
               name_of_type((stat_type_t) i).c_str(),
@@ -142,6 +225,10 @@ stats_private_t& stats_t::get_my_stats() {
 
 void stats_t::enter_launch() {
   launch_finished = false;
+  if (perfcounters::enabled)
+    perf_launch_start.for_each([&] (worker_id_t id, perfcounters::sample_t& s) {
+      perfcounters::read(id, s);
+    });
   launch_enter_time = microtime::now();
 }
 
@@ -156,6 +243,12 @@ void stats_t::exit_launch() {
   launch_exit_time = microtime::now();
   launch_duration = microtime::seconds(microtime::diff(launch_enter_time, launch_exit_time));
   launch_enter_time = never;
+  if (perfcounters::enabled)
+    perf_launch_start.for_each([&] (worker_id_t id, perfcounters::sample_t& start) {
+      perfcounters::sample_t stop;
+      if (perfcounters::read(id, stop))
+        stats[id].data.perf_launch.add(start, stop);
+    });
 }
 
 //! \todo: deprecated function
@@ -173,6 +266,12 @@ void stats_t::add_to_sequential_time(double value) {
   get_my_stats().add_to_sequential_time(value);
 }
 
+void stats_t::add_to_sequential_perf(const perfcounters::sample_t& start) {
+  perfcounters::sample_t stop;
+  if (perfcounters::read_mine(stop))
+    get_my_stats().add_to_sequential_perf(start, stop);
+}
+
 void stats_t::add_to_idle_time(double elapsed) {
   //if (!is_launched()) return;
   if (launch_finished) return; // TODO: should count idle time of processors still in wait phases (they should all be)
@@ -180,9 +279,23 @@ void stats_t::add_to_idle_time(double elapsed) {
 }
 
 void stats_t::add_to_spinning_time(double elapsed) {
+  if (! is_launched() || launch_finished) return;
   get_my_stats().add_to_spinning_time(elapsed);
 }
 
+void stats_t::add_to_parked_time(double elapsed) {
+  if (! is_launched() || launch_finished) return;
+  get_my_stats().add_to_parked_time(elapsed);
+}
+
+void stats_t::report_stack_pool(uint64_t size) {
+  get_my_stats().report_stack_pool(size);
+}
+
+void stats_t::report_steal(int locality) {
+  count((stat_type_t)(STEAL_CORE + locality));
+}
+
 /*---------------------------------------------------------------------*/
 
 stats_t the_stats;
@@ -19,6 +19,7 @@
 
 #include "classes.hpp"
 #include "perworker.hpp"
+#include "perfcounters.hpp"
 
 namespace pasl {
 namespace util {
@@ -46,6 +47,18 @@ typedef enum {
   MEASURED_RUN,
   ESTIM_UPDATE,
   ESTIM_REPORT,
+  STACK_ALLOC,
+  STACK_REUSE,
+  STACK_TRIM,
+  THREAD_PROMOTE,
+  THREAD_HEARTBEAT,
+  // steals, by level of the machine hierarchy shared with the victim
+  STEAL_CORE,
+  STEAL_L3,
+  STEAL_NODE,
+  STEAL_REMOTE,
+  THREAD_BATCHED,
+  THREAD_INJECT,
   // begin fencefree
   RESOLVE_JOIN,
   TRANSFER_ALL,
@@ -76,6 +89,17 @@ static inline std::string name_of_type(stat_type_t type) {
     case MEASURED_RUN: return std::string("measured_run");
     case ESTIM_UPDATE: return std::string("estim_update");
     case ESTIM_REPORT: return std::string("estim_report");
+    case STACK_ALLOC: return std::string("stack_alloc");
+    case STACK_REUSE: return std::string("stack_reuse");
+    case STACK_TRIM: return std::string("stack_trim");
+    case THREAD_PROMOTE: return std::string("thread_promote");
+    case THREAD_HEARTBEAT: return std::string("thread_heartbeat");
+    case STEAL_CORE: return std::string("steal_core");
+    case STEAL_L3: return std::string("steal_l3");
+    case STEAL_NODE: return std::string("steal_node");
+    case STEAL_REMOTE: return std::string("steal_remote");
+    case THREAD_BATCHED: return std::string("thread_batched");
+    case THREAD_INJECT: return std::string("thread_inject");
     case RESOLVE_JOIN: return std::string("resolve_join");
     case TRANSFER_ALL: return std::string("transfer_all");
     case ADD_WATCHLIST: return std::string("add_watchlist");
@@ -94,7 +118,17 @@ public:
   uint64_t counters[NB_STATS];
   double waiting_time;
   double sequential_time;
+  // time spent looking for work without sleeping
   double spinning_time;
+  // time spent parked (see `sched::idle`)
+  double parked_time;
+  // number of call stacks cached in the stack pool
+  uint64_t stack_pool_size;
+  // maximal value reached by `stack_pool_size`
+  uint64_t stack_pool_high_water;
+  // hardware events during the launch, and during measured sequential runs
+  perfcounters::counts_t perf_launch;
+  perfcounters::counts_t perf_sequential;
 
 public:
   stats_data_t();
@@ -117,6 +151,10 @@ public:
   void add_to_sequential_time(double elapsed);
   void add_to_idle_time(double elapsed);
   void add_to_spinning_time(double elapsed);
+  void add_to_parked_time(double elapsed);
+  void report_stack_pool(uint64_t size);
+  void add_to_sequential_perf(const perfcounters::sample_t& start,
+                              const perfcounters::sample_t& stop);
 };
 
 /*---------------------------------------------------------------------*/
@@ -139,6 +177,14 @@ private:
   double relative_non_seq;
   double average_sequentialized;
   double total_spinning_time;
+  double total_parked_time;
+  uint64_t total_stack_pool_size;
+  uint64_t total_stack_pool_high_water;
+
+  // samples of the hardware counters of the workers at `enter_launch`
+  pasl::data::perworker::array<perfcounters::sample_t> perf_launch_start;
+
+  void print_perf(FILE* f, bool per_worker);
 
 public:
   stats_t();
@@ -157,10 +203,16 @@ public:
 
   void add_to_idle_time(double elapsed);
   void add_to_spinning_time(double elapsed);
+  void add_to_parked_time(double elapsed);
+  void report_stack_pool(uint64_t size);
+  //! `locality` is a `util::machine::locality_t`
+  void report_steal(int locality);
 
   // TODO: get rid of these functions by having the STAT macros to call get_my_stat
   void count(stat_type_t type);
   void add_to_sequential_time(double elapsed);
+  //! `start` is a sample of the counters of the calling worker
+  void add_to_sequential_perf(const perfcounters::sample_t& start);
 };
 
 /*---------------------------------------------------------------------*/
@@ -10,6 +10,7 @@
 #include "classes.hpp"
 #include "localityrange.hpp"
 #include "stats.hpp"
+#include "framearena.hpp"
 #include "atomic.hpp"
 
 #ifndef _PASL_SCHED_THREAD_H_
@@ -19,6 +20,28 @@
 
 namespace pasl {
 namespace sched {
+
+/*---------------------------------------------------------------------*/
+
+/*! \brief Priority levels of threads
+ *
+ * A worker runs its ready threads of the highest priority first, and
+ * idle workers steal threads of priority above `PRIORITY_NORMAL`
+ * before any other ones.
+ *
+ * A thread created with `PRIORITY_INHERIT` takes the priority of the
+ * thread which creates it (or `PRIORITY_NORMAL` if there is none)
+ * when it is added to the DAG.
+ */
+typedef enum {
+  PRIORITY_INHERIT = -1,
+  PRIORITY_LOW = 0,
+  PRIORITY_NORMAL,
+  PRIORITY_HIGH,
+  NB_PRIORITIES
+} priority_t;
+
+/*---------------------------------------------------------------------*/
   
 /*! \class signature
  *  \brief The basic interface of a thread.
@@ -35,6 +58,14 @@ public: //! \todo ideally, would be protected
   
   //! true, if this thread should not be deallocated
   bool should_not_deallocate;
+
+  /*! true, if this thread lives in the frame of a call which may return
+   *  as soon as the `exec` of the thread published its work
+   */
+  bool stack_resident;
+
+  //! priority level of the thread
+  priority_t priority;
   
 #ifdef TRACK_LOCALITY
   //! index representing the locality of the thread in the DAG
@@ -49,7 +80,9 @@ public:
   
   thread(bool should_not_deallocate = false)
   : in(NULL), out(NULL),
-  should_not_deallocate(should_not_deallocate) { }
+  should_not_deallocate(should_not_deallocate),
+  stack_resident(false),
+  priority(PRIORITY_INHERIT) { }
   
   virtual ~thread() { }
   
@@ -109,6 +142,19 @@ public:
     
   }
   ///@}
+
+  /** @name Priority  */
+
+  ///@{
+  //! Assigns a priority to the thread
+  void set_priority(priority_t priority) {
+    this->priority = priority;
+  }
+
+  priority_t get_priority() const {
+    return priority;
+  }
+  ///@}
   
   /** @name Miscellaneous  */
   
@@ -119,7 +165,12 @@ public:
   //! Replaces the default "new" operator with ours
   void* operator new (size_t size) {
     STAT_COUNT(THREAD_ALLOC);
-    return ::operator new(size);
+    return framearena::alloc(size);
+  }
+  
+  //! Returns the thread object to the arena it was allocated from
+  void operator delete (void* p) {
+    framearena::dealloc(p);
   }
   
   virtual void set_should_not_deallocate(bool should_not_deallocate) {
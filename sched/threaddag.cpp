@@ -7,6 +7,7 @@
  */
 
 #include <deque>
+#include <algorithm>
 
 #include "cmdline.hpp"
 #include "callback.hpp"
@@ -15,6 +16,15 @@
 #include "scheduler.hpp"
 #include "workstealing.hpp"
 #include "native.hpp"
+#include "stackpool.hpp"
+#include "framearena.hpp"
+#include "alloc.hpp"
+#include "idle.hpp"
+#include "injection.hpp"
+#include "polling.hpp"
+#include "heartbeat.hpp"
+#include "replay.hpp"
+#include "perfcounters.hpp"
 #include "instrategy.hpp"
 #include "outstrategy.hpp"
 
@@ -63,8 +73,9 @@ namespace threaddag {
 /*---------------------------------------------------------------------*/
 /* Defaults for in- and out-strategies */
 
-typedef enum { FETCH_ADD, OPTIMISIC, MESSAGE /*, FENCEFREE_INSTRATEGY */ } instrategy_class_t;
+typedef enum { FETCH_ADD, OPTIMISIC, MESSAGE, DISTRIBUTED, SNZI /*, FENCEFREE_INSTRATEGY */ } instrategy_class_t;
 instrategy_class_t instrategy_class_forkjoin;
+instrategy_class_t instrategy_class_finish;
 
 instrategy_p new_forkjoin_instrategy() {
   instrategy_p in = NULL;
@@ -72,12 +83,36 @@ instrategy_p new_forkjoin_instrategy() {
     //case OPTIMISIC: in = new instrategy::optimistic(); break;
     case FETCH_ADD: in = instrategy::fetch_add_new(); break;
     case MESSAGE: in = new instrategy::message(); break;
+    case SNZI: in = new instrategy::snzi(); break;
     //case FENCEFREE_INSTRATEGY: in = fencefree::select_instrategy(); break;
     default: util::atomic::die("bogus instrategy");
   }
   return in;
 }
 
+instrategy_p new_finish_instrategy(thread_p cont) {
+  instrategy_p in = NULL;
+  switch (instrategy_class_finish) {
+    case FETCH_ADD: in = instrategy::fetch_add_new(); break;
+    case DISTRIBUTED: in = new instrategy::distributed(cont); break;
+    case SNZI: in = new instrategy::snzi(); break;
+    default: util::atomic::die("bogus instrategy");
+  }
+  return in;
+}
+
+static instrategy_class_t parse_instrategy_class(const char* name, const char* dflt) {
+  std::string s = util::cmdline::parse_or_default_string(name, dflt, false);
+  if (s.compare("fetch_add") == 0)
+    return FETCH_ADD;
+  else if (s.compare("distributed") == 0)
+    return DISTRIBUTED;
+  else if (s.compare("snzi") == 0)
+    return SNZI;
+  util::atomic::die("bad value for -%s: %s\n", name, s.c_str());
+  return FETCH_ADD;
+}
+
 typedef enum { UNARY, FENCEFREE_OUTSTRATEGY } outstrategy_class_t;
 static outstrategy_class_t outstrategy_class_forkjoin;
 
@@ -91,29 +126,43 @@ outstrategy_p new_forkjoin_outstrategy(branch_t branch = UNDEFINED) {
   return out;
 }
 
+static int parse_nb_workers() {
+#if defined(SEQUENTIAL_ELISION) || defined(USE_CILK_RUNTIME)
+  return util::cmdline::parse_or_default_int("proc", 1, false);
+#else
+  return util::cmdline::parse_or_default_int("proc", 1, true);
+#endif
+}
+
 // all parameters that are not specific to pasl should be initialized here
-static int init_general_purpose() {
+static int init_general_purpose(int nb_workers) {
   util::atomic::verbose = util::cmdline::parse_or_default_bool("verbose", false, false);
 #ifdef SEQUENTIAL_ELISION
-  int nb_workers = util::cmdline::parse_or_default_int("proc", 1, false);
   if (nb_workers > 1)
     util::atomic::die("Tried to use > 1 processors in sequential-elision mode");
 #elif defined(USE_CILK_RUNTIME)
-  int nb_workers = util::cmdline::parse_or_default_int("proc", 1, false);
   std::string nb_workers_str = std::to_string(nb_workers);
   __cilkrts_set_param("nworkers", nb_workers_str.c_str());
-#else
-  int nb_workers = util::cmdline::parse_or_default_int("proc", 1, true);
 #endif
   native::loop_cutoff = util::cmdline::parse_or_default_int("loop_cutoff", 10000);
   std::string htmodestr =
     util::cmdline::parse_or_default_string("hyperthreading", "useall", false);
   util::machine::hyperthreading_mode_t htmode = util::machine::htmode_of_string(htmodestr);
   util::machine::init(htmode);
-  data::estimator::init();
+  data::estimator::init(nb_workers);
   return nb_workers;
 }
 
+static void init_binding(int nb_workers) {
+  std::string nbpstr =
+    util::cmdline::parse_or_default_string("numa_binding_policy", "none", false);
+  util::machine::binding_policy::policy_t nbpe =
+    util::machine::binding_policy::policy_of_string(nbpstr);
+  bool no0 = util::cmdline::parse_or_default_bool("no0", false, false);
+  util::machine::the_bindpolicy.init(nbpe, no0, nb_workers);
+  util::machine::the_numa.init(nb_workers);
+}
+
 static void init_basic(int nb_workers) {
   util::atomic::init_print_lock();
   kappa = 1.33 * util::cmdline::parse_or_default_double("kappa", 500.0, false); //LATER: improve
@@ -125,19 +174,30 @@ static void init_basic(int nb_workers) {
   if (nb_workers == 0)
     nb_workers = 1;
   assert (nb_workers >= 1);
-  std::string nbpstr =
-    util::cmdline::parse_or_default_string("numa_binding_policy", "none", false);
-  util::machine::binding_policy::policy_t nbpe =
-    util::machine::binding_policy::policy_of_string(nbpstr);
-  bool no0 = util::cmdline::parse_or_default_bool("no0", false, false);
-  util::machine::the_bindpolicy.init(nbpe, no0, nb_workers);
-  util::machine::the_numa.init(nb_workers);
+  init_binding(nb_workers);
   util::worker::the_group.init(nb_workers, &util::machine::the_bindpolicy);
+  stackpool::init();
+  alloc::init();
+  framearena::init();
+  instrategy::snzi::init_pool();
+  idle::init();
+  injection::init();
+  polling::init();
+  replay::init();
+  util::perfcounters::init();
   LOG_ONLY(util::logging::the_recorder.init());
   STAT_IDLE_ONLY(util::stats::the_stats.init());
 }
 
 static void destroy_basic() {
+  stackpool::destroy();
+  framearena::destroy();
+  alloc::destroy();
+  instrategy::snzi::destroy_pool();
+  idle::destroy();
+  injection::destroy();
+  polling::destroy();
+  replay::destroy();
   LOG_ONLY(util::logging::output());
   LOG_ONLY(util::logging::the_recorder.destroy());
   data::estimator::destroy();
@@ -148,7 +208,10 @@ static void destroy_basic() {
 static void init_scheduler() {
   std::string schedulerstr =
   util::cmdline::parse_or_default_string("scheduler", "workstealing", false);
-  instrategy_class_forkjoin = FETCH_ADD;
+  instrategy_class_forkjoin = parse_instrategy_class("forkjoin_instrategy", "fetch_add");
+  if (instrategy_class_forkjoin == DISTRIBUTED)
+    util::atomic::die("-forkjoin_instrategy distributed is not supported\n");
+  instrategy_class_finish = parse_instrategy_class("finish_instrategy", "distributed");
   outstrategy_class_forkjoin = UNARY;
   if (schedulerstr.compare("workstealing") == 0) {
     std::string tsetstr = util::cmdline::parse_or_default_string("threadset", "cas_ri", false);
@@ -160,7 +223,22 @@ static void init_scheduler() {
       scheduler::the_factory =
         new scheduler::factory<workstealing::cas_ri_shared,
                                workstealing::cas_ri_private>();
+    } else if (tsetstr.compare("cas_ri_polling") == 0) {
+      polling::enable();
+      scheduler::the_factory =
+        new scheduler::factory<workstealing::cas_ri_shared,
+                               workstealing::cas_ri_polling_private>();
+    } else if (tsetstr.compare("heartbeat") == 0) {
+      // fork2 exposes its latent forks on a period, see heartbeat.hpp
+      heartbeat::enable();
+      scheduler::the_factory =
+        new scheduler::factory<workstealing::cas_ri_shared,
+                               workstealing::cas_ri_private>();
     } else if (tsetstr.compare("cas_ri_interrupt") == 0) {
+#ifdef LAZY_FORK2
+      // lazy fork2 pops from the deque outside of the scheduler loop
+      util::atomic::die("cas_ri_interrupt is not supported with LAZY_FORK2\n");
+#endif
       scheduler::the_factory =
         new scheduler::factory<workstealing::cas_ri_interrupt_shared,
                               workstealing::cas_ri_interrupt_private>();
@@ -175,6 +253,7 @@ static void init_scheduler() {
 }
 
 static void destroy_scheduler() {
+  heartbeat::destroy();
   delete scheduler::the_factory;
 }
 
@@ -188,8 +267,16 @@ static void destroy_messagestrategy() {
   delete messagestrategy::the_messagestrategy;
 }
 
+// the largest number of workers for which the per-worker state is set
+static int max_nb_workers = 1;
+
 void init() {
-  int nb_workers = init_general_purpose();
+  init(parse_nb_workers());
+}
+
+void init(int nb_workers) {
+  nb_workers = init_general_purpose(nb_workers);
+  max_nb_workers = std::max(1, nb_workers);
   init_basic(nb_workers);
 #ifndef USE_CILK_RUNTIME
   init_scheduler();
@@ -209,6 +296,39 @@ void change_factory(util::worker::controller_factory_t* factory) {
   util::worker::the_group.create_threads();
 }
 
+void resize(int nb_workers) {
+#if defined(SEQUENTIAL_ELISION) || defined(USE_CILK_RUNTIME)
+  if (nb_workers > 1)
+    util::atomic::die("cannot resize the worker group in this build mode\n");
+  return;
+#endif
+  if (nb_workers < 1)
+    nb_workers = 1;
+  // the per-worker state is set up by `init`, for its workers only
+  if (nb_workers > max_nb_workers)
+    util::atomic::die("cannot resize to %d workers, more than the %d given to init\n",
+                      nb_workers, max_nb_workers);
+  if (nb_workers == util::worker::get_nb())
+    return;
+  util::worker::the_group.destroy_threads();
+  destroy_scheduler();
+  // the memory held by the workers that leave would not be reclaimed
+  instrategy::snzi::destroy_pool();
+  alloc::shrink(nb_workers);
+  // the idle and injection modules are laid out by numa node
+  idle::destroy();
+  injection::destroy();
+  util::machine::the_numa.destroy();
+  util::machine::the_bindpolicy.destroy();
+  init_binding(nb_workers);
+  util::worker::the_group.init(nb_workers, &util::machine::the_bindpolicy);
+  idle::init();
+  injection::init();
+  init_scheduler();
+  util::worker::the_group.set_factory(scheduler::the_factory);
+  util::worker::the_group.create_threads();
+}
+
 void launch(thread_p t) {
 #ifdef USE_CILK_RUNTIME
   t->run();
@@ -230,6 +350,14 @@ void launch(thread_p t) {
   LOG_BASIC(EXIT_LAUNCH);
 }
 
+void submit(thread_p t) {
+  t->set_instrategy(instrategy::ready_new());
+  if (t->out == nullptr)
+    t->set_outstrategy(outstrategy::noop_new());
+  injection::push(t);
+  idle::notify_one();
+}
+
 void destroy() {
   util::callback::output();
 #ifndef USE_CILK_RUNTIME
@@ -375,8 +503,7 @@ void finish(thread_p thread, thread_p cont, instrategy_p in) {
 }
 
 void finish(thread_p thread, thread_p cont) {
-  instrategy_p in = new instrategy::distributed(cont);
-  finish(thread, cont, in);
+  finish(thread, cont, new_finish_instrategy(cont));
 }
 
 /*---------------------------------------------------------------------*/
@@ -44,8 +44,21 @@ int get_my_id();
  */
   
 void init();  
+//! Same as `init`, with `nb_workers` workers instead of the value of `-proc`
+void init(int nb_workers);
 void launch(thread_p thread);
 void destroy();
+/*! \brief Replaces the worker group by a group of `nb_workers` workers
+ *
+ * To be called between two calls to `launch`, by the thread that
+ * called `init`. The scheduler is rebuilt with the same command-line
+ * options. The per-worker state (e.g., stack pools, allocator heaps and
+ * the constants of the estimators) is set up by `init` for the workers
+ * it creates, and is not set up again: `nb_workers` must be at most the
+ * number of workers given to `init`. A smaller group uses the state of
+ * its workers as they left it.
+ */
+void resize(int nb_workers);
 
 /** @} */
 /*---------------------------------------------------------------------*/
@@ -168,7 +181,7 @@ void unary_fork_join(thread_p thread, thread_p cont);
 void binary_fork_join(thread_p thread1, thread_p thread2, thread_p cont, 
                                                   instrategy_p in);
 void binary_fork_join(thread_p thread1, thread_p thread2, thread_p cont);
-/**! @} */
+/** @} */
 
 /** @} */
 /*---------------------------------------------------------------------*/
@@ -195,6 +208,10 @@ void binary_fork_join(thread_p thread1, thread_p thread2, thread_p cont);
  * edges
  * 3. instrategy of `cont` is `unary`
  * 4. outstrategy of `cont` is a capture of current outstrategy
+ *
+ * Multishot threads may instead use the typed futures of the native
+ * interface (`native::spawn_future`), which suspend the caller of
+ * `get()` and need no message passing.
  */
 
 future_p create_future(thread_p thread, bool lazy);
@@ -215,7 +232,8 @@ void delete_future(future_p future);
  * More precisely,
  * 1. instrategy of `thread` is `ready`
  * 2. outstrategy of `thread` is `unary` pointing on `cont`
- * 2. instrategy of `cont` is as specified by `in` or else `distributed`
+ * 2. instrategy of `cont` is as specified by `in` or else by the
+ *    result of calling `new_finish_instrategy(cont)`
  */
 
 void async(thread_p thread, thread_p cont);
@@ -224,10 +242,40 @@ void finish(thread_p thread, thread_p cont);
 
 /** @} */
 
+/*---------------------------------------------------------------------*/
+/** \defgroup submit Submission from outside the worker group
+ *  @{
+ *
+ * Adds `thread` to the DAG as an independent root: its instrategy
+ * is `ready`, and its outstrategy, unless already set, is `noop`.
+ *
+ * May be called by any thread, including threads which are not
+ * workers, at any time between `init()` and `destroy()`. The thread
+ * goes to an injection queue (see `injection.hpp`), from which it is
+ * picked up by the next worker that runs out of work.
+ *
+ * \pre threads submitted must have completed before `destroy()`
+ */
+void submit(thread_p thread);
+
+/** @} */
+
 /** @} */
 /*---------------------------------------------------------------------*/
   
+/*! \brief Returns a fresh instrategy for the join of a fork2
+ *
+ * Selected by `-forkjoin_instrategy fetch_add|snzi` (default
+ * `fetch_add`).
+ */
 instrategy_p new_forkjoin_instrategy();
+/*! \brief Returns a fresh instrategy for the continuation `cont` of a
+ *  finish block
+ *
+ * Selected by `-finish_instrategy distributed|fetch_add|snzi`
+ * (default `distributed`).
+ */
+instrategy_p new_finish_instrategy(thread_p cont);
 outstrategy_p new_forkjoin_outstrategy(branch_t branch);
   
 void change_factory(util::worker::controller_factory_t* factory);
@@ -0,0 +1,50 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file workspan.cpp
+ *
+ */
+
+#include "workspan.hpp"
+
+namespace pasl {
+namespace sched {
+namespace workspan {
+
+/***********************************************************************/
+
+static bool measured = false;
+static double last_work = 0.;
+static double last_span = 0.;
+
+void report(const strand_t& root) {
+  measured = true;
+  last_work = util::ticks::seconds((util::ticks::ticks_t) root.work);
+  last_span = util::ticks::seconds((util::ticks::ticks_t) root.span);
+}
+
+/* a greedy scheduler runs in at most work / P + span with P workers,
+ * and no scheduler runs in less than max(work / P, span)
+ */
+void print(FILE* f, int nb_workers, double exectime) {
+  if (! measured)
+    return;
+  double parallelism = (last_span > 0.) ? last_work / last_span : 0.;
+  double p = (double) std::max(1, nb_workers);
+  double greedy_time = last_work / p + last_span;
+  fprintf(f, "work\t%.6lf\n", last_work);
+  fprintf(f, "span\t%.6lf\n", last_span);
+  fprintf(f, "parallelism\t%.2lf\n", parallelism);
+  fprintf(f, "speedup_bound\t%.2lf\n", std::min(p, parallelism));
+  fprintf(f, "greedy_speedup\t%.2lf\n", (greedy_time > 0.) ? last_work / greedy_time : 0.);
+  double cumulated_time = p * exectime;
+  if (cumulated_time > 0.)
+    fprintf(f, "relative_overhead\t%.4lf\n", std::max(0., 1. - last_work / cumulated_time));
+}
+
+/***********************************************************************/
+
+} // end namespace
+} // end namespace
+} // end namespace
@@ -0,0 +1,103 @@
+/* COPYRIGHT (c) 2014 Umut Acar, Arthur Chargueraud, and Michael
+ * Rainey
+ * All rights reserved.
+ *
+ * \file workspan.hpp
+ * \brief Measurement of the work and the span of a computation
+ *
+ */
+
+#ifndef _PASL_SCHED_WORKSPAN_H_
+#define _PASL_SCHED_WORKSPAN_H_
+
+#include <algorithm>
+#include <stdio.h>
+
+#include "ticks.hpp"
+
+/***********************************************************************/
+
+namespace pasl {
+namespace sched {
+namespace workspan {
+
+/*---------------------------------------------------------------------*/
+
+/**
+ * When `WORKSPAN` is defined (build mode `ws`), the computation run
+ * by `native::measure_workspan` is cut into strands at each `fork2`;
+ * `parallel_for` and `forkjoin` are built on `fork2`, so that their
+ * branches are strands too.
+ * Each thread carries the strand that it is running. A strand
+ * accumulates the time it spent running (its work) and the time of the
+ * longest chain of strands which ends with it (its span). At a fork,
+ * the two branches start with the span of the strand of the caller,
+ * and at the join, the caller continues with the sum of the works of
+ * the branches and the maximum of their spans.
+ *
+ * The time spent by the workers in forks and joins, in waiting for
+ * threads, or in the scheduler, belongs to no strand: the work is the
+ * time spent in the code of the program, and the fraction of the time
+ * of the workers spent elsewhere measures the overheads of parallelism.
+ * `-proc 1` gives the measures least disturbed by the scheduler. Forks
+ * made by other means than `fork2` (futures, `async`) are not tracked:
+ * their time is counted in the strand that waits for them.
+ */
+
+#if defined(WORKSPAN) && defined(USE_CILK_RUNTIME)
+#error "the work/span measure needs the native runtime"
+#endif
+
+class strand_t {
+public:
+  util::ticks::ticks_t start;
+  double work;
+  double span;
+
+  strand_t() : work(0.), span(0.) { }
+
+  //! A branch of a fork made by the thread running this strand
+  strand_t branch() const {
+    strand_t s;
+    s.span = span;
+    return s;
+  }
+
+  void open() {
+    start = util::ticks::now();
+  }
+
+  void close() {
+    double elapsed = util::ticks::since(start);
+    work += elapsed;
+    span += elapsed;
+  }
+
+  void join(const strand_t& branch1, const strand_t& branch2) {
+    work += branch1.work + branch2.work;
+    span = std::max(branch1.span, branch2.span);
+  }
+};
+
+//! Records the work and the span of a measured computation
+void report(const strand_t& root);
+
+/*! \brief Prints the last measure, with the speedups predicted for
+ *  `nb_workers`, and the fraction of the `exectime` of the workers
+ *  spent outside of strands
+ */
+void print(FILE* f, int nb_workers, double exectime);
+
+} // end namespace
+} // end namespace
+} // end namespace
+
+#ifdef WORKSPAN
+#define WORKSPAN_ONLY(code) code
+#else
+#define WORKSPAN_ONLY(code)
+#endif
+
+/***********************************************************************/
+
+#endif /*! _PASL_SCHED_WORKSPAN_H_ */
@@ -16,6 +16,9 @@
 #include "workstealing.hpp"
 #include "barrier.hpp"
 #include "cmdline.hpp"
+#include "injection.hpp"
+#include "polling.hpp"
+#include "replay.hpp"
 
 namespace pasl {
 namespace sched {
@@ -23,6 +26,122 @@ namespace workstealing {
 
 /***********************************************************************/
 
+void victim_selector::init(worker_id_t my_id, int nb_workers) {
+  std::string victimstr =
+    util::cmdline::parse_or_default_string("victim", "random", false);
+  if (victimstr.compare("random") == 0)
+    hierarchical = false;
+  else if (victimstr.compare("hierarchical") == 0)
+    hierarchical = true;
+  else
+    util::atomic::die("bogus victim selection policy %s\n", victimstr.c_str());
+  nb_tries_at_level[util::machine::LOCALITY_CORE] =
+    util::cmdline::parse_or_default_int("victim_tries_core", 1, false);
+  nb_tries_at_level[util::machine::LOCALITY_L3] =
+    util::cmdline::parse_or_default_int("victim_tries_l3", 2, false);
+  nb_tries_at_level[util::machine::LOCALITY_NODE] =
+    util::cmdline::parse_or_default_int("victim_tries_node", 4, false);
+  nb_tries_at_level[util::machine::LOCALITY_REMOTE] =
+    util::cmdline::parse_or_default_int("victim_tries_remote", 1, false);
+  for (int l = 0; l < nb_levels; l++)
+    nb_tries_at_level[l] = std::max(1, nb_tries_at_level[l]);
+  locality_of_worker.clear();
+  level = 0;
+  nb_tries = 0;
+  this->my_id = my_id;
+  this->nb_workers = nb_workers;
+  picks_thieves = false;
+}
+
+/* Called on the first transfer, that is, after the creation barrier
+ * of the workers, by which point each one has recorded its location. */
+void victim_selector::init_levels() {
+  for (int l = 0; l < nb_levels; l++)
+    workers_at_level[l].clear();
+  locality_of_worker.assign(nb_workers, util::machine::LOCALITY_REMOTE);
+  for (worker_id_t id = 0; id < nb_workers; id++) {
+    if (id == my_id)
+      continue;
+    locality_t l = util::machine::the_bindpolicy.locality_of_workers(my_id, id);
+    locality_of_worker[id] = l;
+    workers_at_level[l].push_back(id);
+  }
+  if (hierarchical && my_id == 0)
+    util::machine::the_bindpolicy.check_localities();
+}
+
+bool victim_selector::may_pick() {
+  return ! replay::replaying || replay::may_decide();
+}
+
+worker_id_t victim_selector::pick(util::worker::controller_t& controller) {
+  if (replay::replaying) {
+    worker_id_t id = replay::next_target();
+    if (id != util::worker::undef)
+      return id;
+  }
+  if (! hierarchical)
+    return controller.random_other();
+  if (locality_of_worker.empty())
+    init_levels();
+  while (workers_at_level[level].empty() || nb_tries >= nb_tries_at_level[level]) {
+    level = (level + 1) % nb_levels;
+    nb_tries = 0;
+  }
+  nb_tries++;
+  std::vector<worker_id_t>& workers = workers_at_level[level];
+  return workers[controller.myrand() % workers.size()];
+}
+
+void victim_selector::found(worker_id_t id, thread_p thread) {
+  if (locality_of_worker.empty())
+    init_levels();
+  STAT(report_steal(locality_of_worker[id]));
+  level = 0;
+  nb_tries = 0;
+  if (replay::recording) {
+    if (picks_thieves)
+      replay::record(my_id, id, thread);
+    else
+      replay::record(id, my_id, thread);
+  }
+  if (replay::replaying)
+    replay::decided(id);
+}
+
+/*---------------------------------------------------------------------*/
+
+priority_board the_priority_board;
+
+// the counters of `the_priority_board`, which has static storage, start zeroed
+priority_board::priority_board() : nb_total(0) {
+}
+
+worker_id_t priority_board::pick(worker_id_t my_id, int nb_workers) {
+  for (int k = 1; k < nb_workers; k++) {
+    worker_id_t id = (my_id + k) % nb_workers;
+    if (nb_of_worker[id].load(std::memory_order_relaxed) > 0)
+      return id;
+  }
+  return util::worker::undef;
+}
+
+/* the board is consulted only every other attempt, so that a worker
+ * whose only ready thread is urgent (and which will not give it away)
+ * does not attract all the thieves
+ */
+worker_id_t pick_victim(victim_selector& victims, util::worker::controller_t& controller,
+                        worker_id_t my_id, int nb_workers) {
+  if (! replay::replaying && the_priority_board.any() && controller.myrand() % 2 == 0) {
+    worker_id_t id = the_priority_board.pick(my_id, nb_workers);
+    if (id != util::worker::undef)
+      return id;
+  }
+  return victims.pick(controller);
+}
+
+/*---------------------------------------------------------------------*/
+
 threadset_shared::threadset_shared() {
   nb_tries_per_communicate =
     util::cmdline::parse_or_default_int("nb_tries_per_communicate", 1, false);
@@ -31,10 +150,31 @@ threadset_shared::threadset_shared() {
 threadset_shared::~threadset_shared() {
 }
 
+void threadset_private::init() {
+  scheduler::_private::init();
+  victims.init(my_id, nb_workers);
+}
+
 bool threadset_private::stay_in_acquire() {
   return scheduler::_private::stay() && ! local_has();
 }
 
+/*---------------------------------------------------------------------*/
+/* Worker with a private deque */
+
+void private_deque::init() {
+  std::string dequestr =
+    util::cmdline::parse_or_default_string("private_deque", "ring", false);
+  long capacity = 0;
+  if (dequestr.compare("ring") == 0)
+    capacity = util::cmdline::parse_or_default_int("private_deque_capacity", 1024, false);
+  else if (dequestr.compare("stl") != 0)
+    util::atomic::die("bogus private deque %s\n", dequestr.c_str());
+  for (int l = 0; l < NB_PRIORITIES; l++)
+    my_ready_threads[l].init((size_t)capacity);
+  threadset_private::init();
+}
+
 /*---------------------------------------------------------------------*/
 
 class alarm_by_ticks : public alarm {
@@ -124,7 +264,8 @@ cas_si_shared::~cas_si_shared() {
 
 void cas_si_private::init() {
   allow_interrupt = false;
-  scheduler::_private::init();
+  private_deque::init();
+  victims.picks_thieves = true;
   _alarm = create_alarm();
   _alarm->init(this);
 }
@@ -137,16 +278,23 @@ void cas_si_private::destroy() {
 void cas_si_private::acquire() {
   assert(shared->states[my_id].load() == WORKING);
   shared->states[my_id].store(WAITING);
+  idle::enter();
   while (true) {
     if (shared->states[my_id].load() == WAITING || shared->states[my_id].load() == INCOMING) {
+      injection::poll();
       if (! stay_in_acquire()) {
         cancel_acquire();
+        idle::exit(false);
         return;
-      } else
+      } else {
         util::worker::controller_t::yield();
+        // senders wake us up, see `communicate()`
+        idle::pause(periodic_set.empty());
+      }
     } else {
       thread_p thread = (thread_p) shared->states[my_id].load();
       shared->states[my_id].store(WORKING);
+      idle::exit(true);
       remote_push(thread);
       LOG_THREAD(THREAD_SEND, thread);
       STAT_COUNT(THREAD_SEND);
@@ -179,13 +327,19 @@ void cas_si_private::communicate() {
   _alarm->reset();
   should_communicate = false;
   for (int nb_tries = 0; nb_tries < shared->nb_tries_per_communicate; nb_tries++) {
-    worker_id_t id = random_other();
+    if (! victims.may_pick())
+      return;
+    worker_id_t id = victims.pick(*this);
     if (shared->states[id].load() != WAITING) continue;
     thread_p orig = WAITING;
     bool s = shared->states[id].compare_exchange_strong(orig, INCOMING);
     if (! s) continue;
     else {
-      shared->states[id].store(remote_pop());
+      thread_p t = remote_pop();
+      // recorded before the thief may act on `t`
+      victims.found(id, t);
+      shared->states[id].store(t);
+      idle::notify(id);
       return;
     }
   }
@@ -193,6 +347,8 @@ void cas_si_private::communicate() {
 
 void cas_si_private::run() {
   while (stay()) {
+    while (replay::replaying && replay::must_hold())
+      communicate();
     thread_p t = try_local_pop();
     if (t != NULL) {
       should_communicate = false;
@@ -218,6 +374,13 @@ void cas_si_private::check() {
 }
   
 bool cas_si_private::should_call_communicate() {
+  return has_pending_request();
+}
+
+// probes a few workers for one that waits for a thread
+bool cas_si_private::has_pending_request() {
+  if (nb_workers < 2)
+    return false;
   for (int nb_tries = 0; nb_tries < shared->nb_tries_per_communicate; nb_tries++) {
     worker_id_t id = random_other();
     if (shared->states[id].load() == WAITING)
@@ -246,9 +409,11 @@ void cas_si_private::check_on_interrupt() {
 //! \todo: factorize code!
 
 cas_ri_shared::cas_ri_shared() : threadset_shared::threadset_shared() {
+  // each worker accepts requests once it enters its scheduling loop
   for (worker_id_t id = 0; id < util::worker::get_nb(); id++)
-    requests[id].store(REQUEST_WAITING);
+    requests[id].store(REQUEST_BLOCKED);
   answers.init(ANSWER_REJECT);
+  steal_half = util::cmdline::parse_or_default_bool("steal_half", false, false);
 }
 
 cas_ri_shared::~cas_ri_shared() {
@@ -259,7 +424,7 @@ cas_ri_shared::~cas_ri_shared() {
 
 void cas_ri_private::init() {
   allow_interrupt = false;
-  scheduler::_private::init();
+  private_deque::init();
   last_communicate = util::ticks::now();
   my_request_ptr = & (shared->requests[my_id]);
 }
@@ -297,9 +462,22 @@ void cas_ri_private::unblock() {
   my_request_ptr->store(REQUEST_WAITING);
 }
 
+// pushes the answer to a steal request, along with its batch if any
+void cas_ri_private::receive(thread_p thread) {
+  std::vector<thread_p>& batch = shared->batches[my_id];
+  std::atomic_thread_fence(std::memory_order_acquire);
+  // keeps the oldest threads at the front of the deque; each thread
+  // goes to the level of its own priority
+  for (size_t i = batch.size(); i > 0; i--)
+    remote_push(batch[i - 1]);
+  batch.clear();
+  remote_push(thread);
+}
+
 void cas_ri_private::acquire() {
   if (nb_workers < 2) {
     scheduler::_private::check_periodic();
+    injection::poll();
     return;
   }
   reject();
@@ -307,16 +485,20 @@ void cas_ri_private::acquire() {
 
   thread_p thread = NULL;
   answer_t* answer_ptr = & (shared->answers[my_id]);
+  idle::enter();
   while (true) {
     scheduler::_private::check_periodic();
+    injection::poll();
     if (! stay_in_acquire())
       goto cleanup;
 
-    // may yield here
-    sleep_in_acquire(1);
+    // may yield, or park, here
+    idle::pause(periodic_set.empty());
+    if (! victims.may_pick())
+      continue;
 
     *answer_ptr = ANSWER_WAITING;
-    worker_id_t id = random_other();
+    worker_id_t id = pick_victim(victims, *this, my_id, nb_workers);
     if (shared->requests[id].load() != REQUEST_WAITING){
       continue;
     }
@@ -324,6 +506,7 @@ void cas_ri_private::acquire() {
     bool s = shared->requests[id].compare_exchange_strong(orig, my_id);
     if (! s)
       continue;
+    notify_victim(id);
 
     while (*answer_ptr == ANSWER_WAITING) {
       sleep_in_acquire(1); // may yield here as well
@@ -339,14 +522,16 @@ void cas_ri_private::acquire() {
       continue;
     }
     thread = (thread_p) *answer_ptr;
+    victims.found(id, thread);
     break;
   }
-  remote_push(thread);
+  receive(thread);
   //! \todo: thread_receive event?
   LOG_THREAD(THREAD_SEND, thread);
   STAT_COUNT(THREAD_SEND);
 
   cleanup:
+  idle::exit(thread != NULL);
   unblock();
 }
 
@@ -367,7 +552,18 @@ void cas_ri_private::communicate() {
   if (j == REQUEST_WAITING)
     return;
   if (remote_has()) {
-    shared->answers[j] = remote_pop();
+    if (replay::recording)
+      replay::gave(j);
+    if (shared->steal_half) {
+      int l = top_level();
+      size_t nb = my_ready_threads[l].size();
+      thread_p t = remote_pop();
+      remote_pop_batch(l, nb, shared->batches[j]);
+      // the batch must be visible to worker j before the answer
+      std::atomic_thread_fence(std::memory_order_release);
+      shared->answers[j] = t;
+    } else
+      shared->answers[j] = remote_pop();
   } else {
     shared->answers[j] = ANSWER_REJECT;
   }
@@ -388,8 +584,16 @@ bool cas_ri_private::should_call_communicate() {
   return my_request_ptr->load() != REQUEST_WAITING;
 }
 
+// the request slot may also hold `REQUEST_BLOCKED`, which is no request
+bool cas_ri_private::has_pending_request() {
+  return my_request_ptr->load() >= 0;
+}
+
 void cas_ri_private::run() {
+  unblock();
   while (stay()) {
+    while (replay::replaying && replay::must_hold())
+      communicate();
     thread_p t = try_local_pop();
     if (t != NULL) {
       should_communicate = false;
@@ -398,6 +602,9 @@ void cas_ri_private::run() {
     } else
       wait();
   }
+  // worker 0 leaves this loop between two launches: thieves must not
+  // wait for its answer in the meantime
+  reject();
 }
 
 void cas_ri_private::wait() {
@@ -429,6 +636,19 @@ void cas_ri_private::check_on_interrupt() {
 }
 
 
+/*---------------------------------------------------------------------*/
+// with polling
+
+void cas_ri_polling_private::notify_victim(worker_id_t id) {
+  polling::request(id);
+}
+
+void cas_ri_polling_private::communicate() {
+  if (my_request_ptr->load() >= 0)
+    polling::acknowledge();
+  cas_ri_private::communicate();
+}
+
 /*---------------------------------------------------------------------*/
 // with interrupts
 
@@ -440,8 +660,10 @@ void cas_ri_interrupt_private::acquire() {
       goto cleanup;
 
     // may yield here
+    if (! victims.may_pick())
+      continue;
     *answer_ptr = ANSWER_WAITING;
-    worker_id_t id = random_other();
+    worker_id_t id = pick_victim(victims, *this, my_id, nb_workers);
     if (shared->requests[id].load() != REQUEST_WAITING)
       continue;
     worker_id_t orig = REQUEST_WAITING;
@@ -459,10 +681,11 @@ void cas_ri_interrupt_private::acquire() {
     if (*answer_ptr == ANSWER_REJECT)
       continue;
     thread = (thread_p) *answer_ptr;
+    victims.found(id, thread);
     break;
     communicate();
   }
-  remote_push(thread);
+  receive(thread);
   //! \todo: thread_receive event?
   LOG_THREAD(THREAD_SEND, thread);
   STAT_COUNT(THREAD_SEND);
@@ -497,6 +720,8 @@ void cas_ri_interrupt_private::acquire() {
       goto cleanup;
 
     // may yield here
+    if (! victims.may_pick())
+      continue;
     *answer_ptr = ANSWER_WAITING;
     worker_id_t id = random_other();
     request_t* request_ptr = & (shared->requests[id]);
@@ -623,6 +848,40 @@ thread_p chase_lev_deque::pop_front() {
   return item;
 }
 
+/* Steals up to half of the items of the deque, and at least one.
+ * The first item, or the result of the failed first steal attempt,
+ * is returned; the other items are appended to `extra`.
+ *
+ * This is deliberately not the steal-half of the literature, which
+ * claims the whole range with one update of `top`: here, the items
+ * are claimed one at a time, from the front, by the protocol of
+ * `pop_front`, so a batch of n items costs n CASes on `top`. A single
+ * CAS checked against `bottom` is not enough with this deque,
+ * because `pop_back` takes all but the last item without any CAS:
+ * the owner may pop an item of the range between the thief's read of
+ * `bottom` and its CAS, then push a new item in the same cell, so
+ * that a later check of `bottom` by the thief passes while the item
+ * is owned twice. Making the range claim safe would require a CAS in
+ * each `pop_back`, which is the fast path of the owner. A batch thus
+ * stops at the first failed CAS, and may be smaller than half of the
+ * deque.
+ */
+thread_p chase_lev_deque::pop_front_half(std::vector<thread_p>& extra) {
+  int64_t t = top.load();
+  int64_t b = bottom.load();
+  int64_t nb = (b - t) / 2;
+  thread_p item = pop_front();
+  if (item == STEAL_RES_EMPTY || item == STEAL_RES_ABORT)
+    return item;
+  for (int64_t i = 1; i < nb; i++) {
+    thread_p x = pop_front();
+    if (x == STEAL_RES_EMPTY || x == STEAL_RES_ABORT)
+      break;
+    extra.push_back(x);
+  }
+  return item;
+}
+
 thread_p chase_lev_deque::pop_back() {
   int64_t b = bottom.load() - 1;
   bottom.store(b);
@@ -652,37 +911,104 @@ bool chase_lev_deque::empty() {
 
 shared_deques_shared::shared_deques_shared() {
   //  scheduler::_shared();
-  deques.init(NULL);
-  creation_barrier.init(util::worker::get_nb());
+  deques.for_each([] (worker_id_t, std::atomic<chase_lev_deque*>& d) {
+    d.store(NULL, std::memory_order_relaxed);
+  });
+  steal_half = util::cmdline::parse_or_default_bool("steal_half", false, false);
 }
 
 shared_deques_shared::~shared_deques_shared() {
 }
 
 void shared_deques_private::init() {
-  my_deque.init(1024l);
+  for (int l = 0; l < NB_PRIORITIES; l++)
+    my_deques[l].init(1024l);
   scheduler::_private::init();
-  _shared->deques[util::worker::get_my_id()] = &my_deque;
+  victims.init(my_id, nb_workers);
+  // worker 0 is initialized after the other workers have started
+  _shared->deques[util::worker::get_my_id()].store(my_deques, std::memory_order_release);
 }
 
 void shared_deques_private::destroy() {
   scheduler::_private::destroy();
 }
 
+void shared_deques_private::push(thread_p thread) {
+  assert(0 <= thread->priority && thread->priority < NB_PRIORITIES);
+  my_deques[thread->priority].push_back(thread);
+  if (priority_board::is_urgent(thread))
+    the_priority_board.add(my_id, +1);
+}
+
+// pops from the highest non-empty level
+thread_p shared_deques_private::pop() {
+  for (int l = NB_PRIORITIES - 1; l >= 0; l--) {
+    if (my_deques[l].empty())
+      continue;
+    thread_p t = my_deques[l].pop_back();
+    if (t == NULL)
+      continue;
+    if (priority_board::is_urgent(t))
+      the_priority_board.add(my_id, -1);
+    return t;
+  }
+  return NULL;
+}
+
+size_t shared_deques_private::nb_ready() {
+  size_t nb = 0;
+  for (int l = 0; l < NB_PRIORITIES; l++)
+    nb += my_deques[l].nb_threads();
+  return nb;
+}
+
+// counts the fresh threads, which are made ready at the next check
+size_t shared_deques_private::nb_threads() {
+  return nb_ready() + my_fresh.size();
+}
+
+// the local operations used by the lazy fork2; the fresh threads are
+// the newest ones
+bool shared_deques_private::local_has() {
+  return ! my_fresh.empty() || nb_ready() > 0;
+}
+
+// a thread of the deque is taken back among the fresh threads, so that
+// no thief takes it between the peek and the pop; it returns to the
+// deque at the next flush if it is not popped
+thread_p shared_deques_private::local_peek() {
+  if (my_fresh.empty()) {
+    thread_p t = pop();
+    if (t == NULL)
+      return NULL;
+    my_fresh.push_back(t);
+  }
+  return my_fresh.back();
+}
+
+thread_p shared_deques_private::local_pop() {
+  thread_p t = local_peek();
+  if (t != NULL)
+    my_fresh.pop_back();
+  return t;
+}
+
 // moves threads from fresh to ready set
 void shared_deques_private::flush() {
   for (int i = 0; i < my_fresh.size(); i++)
-    my_deque.push_back(my_fresh[i]);
+    push(my_fresh[i]);
+  // the last thread is popped right away by the worker itself
+  if (! my_fresh.empty() && nb_ready() > 1)
+    idle::notify_one();
   my_fresh.clear();
 }
 
 void shared_deques_private::run() {
-  if (!initialized)
-    _shared->creation_barrier.wait();
-  initialized = true;
   while (stay()) {
     flush();
-    thread_p t = my_deque.pop_back();
+    while (replay::replaying && replay::must_hold())
+      check();
+    thread_p t = pop();
     if (t != NULL) {
       exec(t);
       check();
@@ -701,15 +1027,32 @@ void shared_deques_private::check() {
 
 void shared_deques_private::acquire() {
   if (nb_workers < 2) {
+    injection::poll();
     check();
     return;
   }
   int nb_tries = 0;
+  idle::enter();
   while (stay()) {
+    if (injection::poll()) {
+      check();
+      idle::exit(true);
+      return;
+    }
     check();
-    worker_id_t id_target = random_other();
-    chase_lev_deque* target = _shared->deques[id_target];
-    thread_p thread = target->pop_front();
+    if (! victims.may_pick())
+      continue;
+    worker_id_t id_target = pick_victim(victims, *this, my_id, nb_workers);
+    chase_lev_deque* targets = _shared->deques[id_target].load(std::memory_order_acquire);
+    thread_p thread = STEAL_RES_EMPTY;
+    // tries the levels of the victim from the highest one; a batch is
+    // taken from a single level, so that it has a single priority
+    for (int l = NB_PRIORITIES - 1; targets != NULL && l >= 0 && thread == STEAL_RES_EMPTY; l--) {
+      if (_shared->steal_half)
+        thread = targets[l].pop_front_half(my_batch);
+      else
+        thread = targets[l].pop_front();
+    }
     if (thread == STEAL_RES_EMPTY) {
       LOG_BASIC(STEAL_FAIL);
     } else if (thread == STEAL_RES_ABORT) {
@@ -717,17 +1060,27 @@ void shared_deques_private::acquire() {
     } else {
       LOG_BASIC(STEAL_SUCCESS);
       STAT_COUNT(THREAD_SEND);
-      my_deque.push_back(thread);
+      victims.found(id_target, thread);
+      if (priority_board::is_urgent(thread))
+        the_priority_board.add(id_target, - (int64_t)(1 + my_batch.size()));
+      push(thread);
+      for (size_t i = 0; i < my_batch.size(); i++) {
+        STAT_COUNT(THREAD_BATCHED);
+        push(my_batch[i]);
+      }
+      my_batch.clear();
+      if (nb_ready() > 1)
+        idle::notify_one();
+      idle::exit(true);
       return;
     }
     nb_tries++;
     if (nb_tries > util::worker::get_nb()) {
       nb_tries = 0;
-
-      //controller_t::yield();
-      // TODO: microsleep
+      idle::pause(periodic_set.empty());
     }
   }
+  idle::exit(false);
 }
 
 void shared_deques_private::check_on_interrupt() {
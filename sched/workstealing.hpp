@@ -10,10 +10,15 @@
 #define _WORKSTEALING_H_
 
 #include <math.h>
+#include <vector>
 
 #include "classes.hpp"
+#include "thread.hpp"
+#include "perworker.hpp"
 #include "container.hpp"
 #include "scheduler.hpp"
+#include "machine.hpp"
+#include "idle.hpp"
 
 /*! \defgroup workstealing Work stealing
  *  \ingroup scheduler
@@ -34,6 +39,123 @@ class threadset_private;
 typedef threadset_private* threadset_private_p;
 typedef threadset_shared* threadset_shared_p;
 
+/*---------------------------------------------------------------------*/
+/* Victim selection */
+
+/*! \class victim_selector
+ *  \brief Per-worker policy that chooses the worker to steal from
+ *  (or, in sender-initiated work stealing, the worker to send a
+ *  thread to).
+ *
+ * The policy is selected by the command line:
+ * - `-victim random` (default): picks uniformly among the other workers;
+ * - `-victim hierarchical`: picks first among the workers that share
+ *   a core with the calling worker, then among those that share an L3
+ *   cache, then a NUMA node, and then among all the remaining ones.
+ *   The number of attempts made at each level before moving on to the
+ *   next one is given by `-victim_tries_core`, `-victim_tries_l3`,
+ *   `-victim_tries_node` and `-victim_tries_remote`. Levels with no
+ *   workers are skipped. The search restarts from the closest level
+ *   after a successful steal, or after the farthest level.
+ *
+ * The levels are computed on the first transfer, from the processing
+ * elements on which each worker may run (see
+ * `util::machine::binding_policy::locality_of_workers`). They are thus
+ * only meaningful with a binding policy that confines the workers
+ * (e.g., `-numa_binding_policy sparse`): with the default policy,
+ * `none`, the levels are unknown, all the other workers fall in a
+ * single level, and `-victim hierarchical` picks uniformly among them,
+ * as `-victim random` does.
+ *
+ * The selector is also where steal decisions are recorded and
+ * replayed (see `replay.hpp`): when replaying, `pick()` returns the
+ * recorded target and `may_pick()` holds back the worker until its
+ * turn.
+ */
+class victim_selector {
+private:
+  typedef util::machine::locality_t locality_t;
+  static constexpr int nb_levels = util::machine::NB_LOCALITIES;
+
+  bool hierarchical;
+  std::vector<locality_t> locality_of_worker;
+  std::vector<worker_id_t> workers_at_level[nb_levels];
+  int nb_tries_at_level[nb_levels];
+  int level;
+  int nb_tries;
+  worker_id_t my_id;
+  int nb_workers;
+
+  void init_levels();
+
+public:
+  //! True if the calling worker is the victim of its transfers (sender-initiated)
+  bool picks_thieves;
+
+  void init(worker_id_t my_id, int nb_workers);
+
+  //! Returns false if the worker must not attempt a transfer for now
+  bool may_pick();
+
+  /*! \brief Returns the id of a worker other than the calling one.
+   *  \pre there are at least two workers
+   */
+  worker_id_t pick(util::worker::controller_t& controller);
+
+  //! To be called after `thread` was transferred with worker `id`
+  void found(worker_id_t id, thread_p thread);
+};
+
+/*---------------------------------------------------------------------*/
+/* Priority board */
+
+/*! \class priority_board
+ *  \brief Counts the ready threads of priority above `PRIORITY_NORMAL`
+ *  held by each worker, so that thieves can find them.
+ *
+ * The counters are only updated when such threads are pushed to, or
+ * popped from, a ready queue; when there are none, a thief pays one
+ * load to learn it (`any()`). The counts are only hints: a thief may
+ * still find the ready queue of the worker returned by `pick()` empty.
+ */
+class priority_board {
+private:
+  std::atomic<int64_t> nb_total;
+  char padding[64];
+  data::perworker::array<std::atomic<int64_t>> nb_of_worker;
+
+public:
+  priority_board();
+
+  static inline bool is_urgent(thread_p t) {
+    return t->priority > PRIORITY_NORMAL;
+  }
+
+  //! Records that worker `id` gained (or lost, if `d < 0`) `d` urgent threads
+  void add(worker_id_t id, int64_t d) {
+    nb_of_worker[id] += d;
+    nb_total += d;
+  }
+
+  bool any() {
+    return nb_total.load(std::memory_order_relaxed) > 0;
+  }
+
+  /*! \brief Returns a worker other than `my_id` which holds urgent
+   *  threads, or `util::worker::undef` if there is none
+   */
+  worker_id_t pick(worker_id_t my_id, int nb_workers);
+};
+
+extern priority_board the_priority_board;
+
+/*! \brief Returns the victim of a steal attempt by worker `my_id`:
+ *  a worker holding urgent threads if there is one, otherwise the
+ *  choice of `victims`
+ */
+worker_id_t pick_victim(victim_selector& victims, util::worker::controller_t& controller,
+                        worker_id_t my_id, int nb_workers);
+
 /*---------------------------------------------------------------------*/
 
 // LATER: find a better name instead of threadset
@@ -54,6 +176,8 @@ public:
 
 class threadset_private : public scheduler::_private {
 protected:
+  victim_selector victims;
+
   bool stay_in_acquire();
 
   virtual void add_to_pool_of_ready_threads(thread_p t) {
@@ -61,6 +185,8 @@ protected:
   }
 
 public:
+  virtual void init();
+
   virtual void acquire() = 0;
   virtual void communicate() = 0;
   virtual void wait() = 0;
@@ -81,53 +207,84 @@ public:
 
 class private_deque : public threadset_private {
 protected:
-  data::stl::deque_seq<thread_p> my_ready_threads;
+  /* one deque per priority level; each deque is a ring buffer of
+   * thread pointers that spills into an STL deque (`-private_deque
+   * ring`, the default), or just an STL deque (`-private_deque stl`)
+   */
+  data::stl::ringbuffer_seq<thread_p> my_ready_threads[NB_PRIORITIES];
+
+  // returns the highest level whose deque is non empty, or -1
+  inline int top_level() {
+    for (int l = NB_PRIORITIES - 1; l >= 0; l--)
+      if (! my_ready_threads[l].empty())
+        return l;
+    return -1;
+  }
 
-/*
-  void check_for_duplicates() {
-#ifndef NDEBUG
-    for (int i = 0; i < my_ready_threads.size(); i++) {
-      thread_p t = my_ready_threads[i];
-      int cnt = 0;
-      for (int j = 0; j < my_ready_threads.size(); j++) {
-        if (my_ready_threads[j] == t)
-          cnt++;
-      }
-      assert(cnt == 1);
-    }
-#endif
+  inline void push_back_at_level(thread_p thread) {
+    assert(0 <= thread->priority && thread->priority < NB_PRIORITIES);
+    my_ready_threads[thread->priority].push_back(thread);
+    if (priority_board::is_urgent(thread))
+      the_priority_board.add(my_id, +1);
+  }
+
+  inline void push_front_at_level(thread_p thread) {
+    assert(0 <= thread->priority && thread->priority < NB_PRIORITIES);
+    my_ready_threads[thread->priority].push_front(thread);
+    if (priority_board::is_urgent(thread))
+      the_priority_board.add(my_id, +1);
+  }
+
+  inline thread_p pop_back_at_level(int l) {
+    thread_p t = my_ready_threads[l].pop_back();
+    if (priority_board::is_urgent(t))
+      the_priority_board.add(my_id, -1);
+    return t;
+  }
+
+  inline thread_p pop_front_at_level(int l) {
+    thread_p t = my_ready_threads[l].pop_front();
+    if (priority_board::is_urgent(t))
+      the_priority_board.add(my_id, -1);
+    return t;
   }
-  */
 
 public:
+  virtual void init();
+
   inline size_t nb_threads() {
-    return my_ready_threads.size();
+    size_t nb = 0;
+    for (int l = 0; l < NB_PRIORITIES; l++)
+      nb += my_ready_threads[l].size();
+    return nb;
   }
 
   inline bool local_has() {
-    return nb_threads() > 0;
+    return top_level() >= 0;
   }
 
   inline virtual void local_push(thread_p thread) {
-    my_ready_threads.push_back(thread);
+    push_back_at_level(thread);
+    // a parked worker can steal from us as soon as we have two threads
+    if (nb_threads() > 1)
+      idle::notify_one();
   }
 
   inline virtual thread_p local_pop() {
-    thread_p t = my_ready_threads.pop_back();
+    thread_p t = pop_back_at_level(top_level());
     LOG_THREAD(THREAD_POP, t);
     return t;
   }
 
   inline virtual thread_p local_peek() {
-    thread_p t = my_ready_threads.back();
+    thread_p t = my_ready_threads[top_level()].back();
     return t;
   }
 
   template <class Func>
   void for_each_in_deque(const Func& f) {
-    for (auto it = my_ready_threads.begin(); it != my_ready_threads.end(); it++) {
-      f(*it);
-    }
+    for (int l = 0; l < NB_PRIORITIES; l++)
+      my_ready_threads[l].for_each(f);
   }
 
 /*
@@ -145,10 +302,12 @@ public:
     return current_thread != NULL;
   }
 
+  // threads are given away from the front of the highest level
   inline bool remote_can_split() {
-    if (nb_threads() < 1)
+    int l = top_level();
+    if (l < 0)
       return false;
-    thread_p thread = my_ready_threads.front();
+    thread_p thread = my_ready_threads[l].front();
     bool b = thread->size() > 1;
     //! \todo this condition is overly conservative because it fails in the case where we're just rescheduling ourselves
     // if (b && is_one_thread_running())
@@ -161,26 +320,47 @@ public:
   }
 
   inline void remote_push(thread_p thread) {
-    my_ready_threads.push_front(thread);
+    push_front_at_level(thread);
+    if (nb_threads() > 1)
+      idle::notify_one();
   }
 
   inline thread_p remote_peek() {
     if (remote_can_split())
       assert(false);
     else
-      return my_ready_threads.front();
+      return my_ready_threads[top_level()].front();
   }
 
   inline thread_p remote_pop() {
+    int l = top_level();
     if (remote_can_split()) {
       STAT_COUNT(THREAD_SPLIT);
-      thread_p t = my_ready_threads.front();
+      thread_p t = my_ready_threads[l].front();
       size_t sz = t->size();
       assert(sz > 1);
-      return t->split(sz / 2);
+      thread_p t2 = t->split(sz / 2);
+      t2->priority = t->priority;
+      return t2;
     } else {
       assert(remote_has());
-      return my_ready_threads.pop_front();
+      return pop_front_at_level(l);
+    }
+  }
+
+  /* to be called right after `remote_pop`, with `l` the level of the
+   * thread it returned and `nb` the number of threads at that level
+   * before that call: moves from the front of level `l` to `dst` the
+   * threads that are stolen along with the one returned by
+   * `remote_pop`, so that at most `nb / 2` threads are stolen in
+   * total; stops at the first splittable thread, and always leaves
+   * one thread in the deque. A batch thus never mixes priorities.
+   */
+  inline void remote_pop_batch(int l, size_t nb, std::vector<thread_p>& dst) {
+    while (   dst.size() + 1 < nb / 2 && nb_threads() > 1
+           && top_level() == l && ! remote_can_split()) {
+      STAT_COUNT(THREAD_BATCHED);
+      dst.push_back(pop_front_at_level(l));
     }
   }
 
@@ -251,6 +431,7 @@ public:
   void wait();
   void check_on_interrupt();
   bool should_call_communicate();
+  bool has_pending_request();
 };
 
 /*---------------------------------------------------------------------*/
@@ -272,6 +453,12 @@ class cas_ri_shared : public threadset_shared {
 protected:
   data::perworker::array<answer_t> answers;
   data::perworker::array<std::atomic<request_t>> requests;
+  /* with `-steal_half 1`, a victim answers the request of worker `j`
+   * with the oldest thread of its highest level and stores in
+   * `batches[j]` the other threads stolen by `j`, all from that level
+   */
+  bool steal_half;
+  data::perworker::array<std::vector<thread_p>> batches;
 
 public:
   cas_ri_shared();
@@ -289,6 +476,9 @@ protected:
   void sleep_in_acquire(double nb_microseconds);
   bool time_to_communicate();
   std::atomic<request_t>* my_request_ptr;
+  void receive(thread_p thread);
+  //! Called by a thief which has just posted a request to worker `id`
+  virtual void notify_victim(worker_id_t id) { }
 
 public:
   cas_ri_private(cas_ri_shared* shared) : shared(shared) {}
@@ -301,6 +491,7 @@ public:
   void wait();
   void check_on_interrupt();
   bool should_call_communicate();
+  bool has_pending_request();
   void unblock();
 };
 
@@ -335,6 +526,22 @@ public:
 
 };
 
+/*---------------------------------------------------------------------*/
+/* CAS-based receiver-initiated work stealing with polling */
+
+/* a thief raises the polling flag of its victim, which the victim
+ * checks in the sequential code run by the granularity controller;
+ * see polling.hpp
+ */
+class cas_ri_polling_private : public cas_ri_private {
+protected:
+  void notify_victim(worker_id_t id);
+
+public:
+  cas_ri_polling_private(cas_ri_shared* shared) : cas_ri_private(shared) {}
+  void communicate();
+};
+
 /*---------------------------------------------------------------------*/
 /* Work stealing with shared deques */
 
@@ -369,6 +576,7 @@ public:
   void destroy();
   void push_back(thread_p item);
   thread_p pop_front();
+  thread_p pop_front_half(std::vector<thread_p>& extra);
   thread_p pop_back();
   size_t nb_threads();
   bool empty();
@@ -377,8 +585,11 @@ public:
 
 class shared_deques_shared : public scheduler::_shared {
 protected:
-  data::perworker::array<chase_lev_deque*> deques;
-  barrier_t creation_barrier;
+  // for each worker, its array of `NB_PRIORITIES` deques, or NULL
+  // until the worker is initialized; published with release semantics
+  // so that a thief sees the deques initialized
+  data::perworker::array<std::atomic<chase_lev_deque*>> deques;
+  bool steal_half;
 
 public:
   shared_deques_shared();
@@ -389,15 +600,20 @@ public:
 class shared_deques_private : public scheduler::_private {
 protected:
   shared_deques_shared* _shared;
-  chase_lev_deque my_deque;
+  // one deque per priority level
+  chase_lev_deque my_deques[NB_PRIORITIES];
   std::vector<thread_p> my_fresh;
-  bool initialized;
+  victim_selector victims;
+  std::vector<thread_p> my_batch;
 
   void flush();
+  void push(thread_p thread);
+  thread_p pop();
+  size_t nb_ready();
 
 public:
   shared_deques_private(shared_deques_shared* _shared)
-    : _shared(_shared),initialized(false) { }
+    : _shared(_shared) { }
   void init();
   void destroy();
   void run();
@@ -405,6 +621,10 @@ public:
   void check();
   void check_on_interrupt();
   void add_to_pool_of_ready_threads(thread_p thread);
+  size_t nb_threads();
+  bool local_has();
+  thread_p local_peek();
+  thread_p local_pop();
 
 };
 
@@ -502,6 +502,164 @@ public:
   
 };
   
+/*---------------------------------------------------------------------*/
+/* Ring buffer with overflow */
+
+/*! \class ringbuffer_seq
+ *  \brief Double-ended sequence stored in a ring buffer of fixed
+ *  capacity, backed by an STL deque for the items that do not fit.
+ *
+ * The sequence is the contents of the overflow deque followed by the
+ * contents of the ring. When the ring is full, `push_back` moves the
+ * front item of the ring to the back of the overflow deque, so that
+ * the ring always holds the items closest to the back of the
+ * sequence. As long as the ring does not fill up, `push_back` and
+ * `pop_back` access a single contiguous array and never allocate.
+ *
+ * The capacity is rounded up to a power of two. A capacity of zero
+ * disables the ring, in which case the structure behaves as a plain
+ * `deque_seq`.
+ */
+template <class Item>
+class ringbuffer_seq {
+public:
+
+  typedef ringbuffer_seq<Item> self_type;
+  typedef Item value_type;
+  typedef size_t size_type;
+
+private:
+
+  value_type* items;
+  size_type capacity;
+  size_type mask;
+  // index in `items` of the front item of the ring
+  size_type head;
+  // number of items in the ring
+  size_type nb;
+  std::deque<value_type> overflow;
+
+  value_type& at(size_type i) const {
+    return items[(head + i) & mask];
+  }
+
+public:
+
+  ringbuffer_seq()
+  : items(NULL), capacity(0), mask(0), head(0), nb(0) { }
+
+  ~ringbuffer_seq() {
+    if (items != NULL)
+      myfree(items);
+  }
+
+  //! \pre the sequence is empty
+  void init(size_type min_capacity) {
+    assert(empty());
+    if (items != NULL)
+      myfree(items);
+    items = NULL;
+    capacity = 0;
+    if (min_capacity > 0) {
+      capacity = 1;
+      while (capacity < min_capacity)
+        capacity *= 2;
+      items = mynew_array<value_type>(capacity);
+    }
+    mask = (capacity == 0) ? 0 : capacity - 1;
+    head = 0;
+    nb = 0;
+  }
+
+  size_type size() const {
+    return nb + overflow.size();
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  //! Returns the number of items that spilled out of the ring
+  size_type nb_spilled() const {
+    return overflow.size();
+  }
+
+  Item& back() {
+    if (nb > 0)
+      return at(nb - 1);
+    return overflow.back();
+  }
+
+  Item& front() {
+    if (! overflow.empty())
+      return overflow.front();
+    return at(0);
+  }
+
+  Item pop_back() {
+    if (nb > 0) {
+      nb--;
+      return at(nb);
+    }
+    Item x = overflow.back();
+    overflow.pop_back();
+    return x;
+  }
+
+  Item pop_front() {
+    if (! overflow.empty()) {
+      Item x = overflow.front();
+      overflow.pop_front();
+      return x;
+    }
+    assert(nb > 0);
+    Item x = at(0);
+    head = (head + 1) & mask;
+    nb--;
+    return x;
+  }
+
+  void push_back(const Item& x) {
+    if (nb == capacity) {
+      if (capacity == 0) {
+        overflow.push_back(x);
+        return;
+      }
+      // spill the front item of the ring
+      overflow.push_back(at(0));
+      head = (head + 1) & mask;
+      nb--;
+    }
+    at(nb) = x;
+    nb++;
+  }
+
+  void push_front(const Item& x) {
+    if (! overflow.empty() || nb == capacity) {
+      overflow.push_front(x);
+      return;
+    }
+    head = (head - 1) & mask;
+    at(0) = x;
+    nb++;
+  }
+
+  void clear() {
+    overflow.clear();
+    head = 0;
+    nb = 0;
+  }
+
+  template <class Loop_body>
+  void for_each(const Loop_body& body) const {
+    for (auto it = overflow.begin(); it != overflow.end(); it++)
+      body(*it);
+    for (size_type i = 0; i < nb; i++)
+      body(at(i));
+  }
+
+};
+  
 /*---------------------------------------------------------------------*/
 /* Wrapper for STL rope */
   
@@ -63,9 +63,11 @@ public:
     swapcontext(&(cxt1->ucxt), &(cxt2->ucxt));
   }
   
+  /* `stack` must point to the lowest address of a region of
+   * `thread_stack_szb` bytes provided by the caller
+   */
   template <class Value>
-  static char* spawn(context_pointer cxt, Value val) {
-    char* stack = (char*)malloc(thread_stack_szb);
+  static char* spawn(context_pointer cxt, Value val, char* stack) {
     Value val2 = capture<Value>(cxt);
     cxt->ucxt.uc_link = nullptr;
     cxt->ucxt.uc_stack.ss_sp = stack;
@@ -116,14 +118,16 @@ public:
     return (Value)r;
   }
   
+  /* `stack` must point to the lowest address of a region of
+   * `thread_stack_szb` bytes provided by the caller
+   */
   template <class Value>
-  static char* spawn(context_pointer cxt, Value val) {
+  static char* spawn(context_pointer cxt, Value val, char* stack) {
     Value target;
     if (target = (Value)_pasl_cxt_save(cxt)) {
       target->enter(target);
       assert(false);
     }
-    char* stack = (char*)malloc(thread_stack_szb);
     void** _cxt = (void**)cxt;
     _cxt[_X86_64_SP_OFFSET] = &stack[thread_stack_szb];
     return stack;
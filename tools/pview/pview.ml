@@ -34,6 +34,7 @@ type evttype =
   | Evt_algo_phase
   | Evt_locality_start of int
   | Evt_locality_stop of int
+  | Evt_steal_decision of int * int
   (*
   | Evt_task_exec
   | Evt_poll_and_deal
@@ -63,6 +64,12 @@ let parse_event ch =
       | 8 -> Evt_algo_phase
       | 9 -> Evt_locality_start (read_int ch)
       | 10 -> Evt_locality_stop (read_int ch)
+      | 27 ->
+         let victim = read_int ch in
+         let thief = read_int ch in
+         let _thread = read_int ch in
+         let _progress = read_int ch in
+         Evt_steal_decision (victim, thief)
       | _ -> Evt_other
       in
    (time,proc,evttype)
@@ -83,6 +90,7 @@ let string_of_evttype = function
    | Evt_algo_phase -> "algo_phase"
    | Evt_locality_start pos -> sprintf "locality_start\t%d" pos
    | Evt_locality_stop pos -> sprintf "locality_stop\t%d" pos
+   | Evt_steal_decision (victim, thief) -> sprintf "steal_decision\t%d\t%d" victim thief
    | Evt_other -> "other"
 
 let print_event evt =
@@ -168,6 +176,9 @@ let drawing events range =
             working_since.(proc) <- not_working
           end
 
+      | Evt_steal_decision (victim, thief) ->
+         draw_box range victim green 0 (height/2) timestamp timestamp;
+         draw_box range thief green (height/2) (height/2) timestamp timestamp
       | Evt_other -> 
          draw_box range proc gray 0 1 timestamp timestamp
       );